@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) Nemirtingas
+ * This file is part of System.
+ *
+ * System is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * System is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the System; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <System/SystemCompiler.h>
+
+// C++20 only, the header is empty for older language levels.
+#if defined(SYSTEM_HAS_COROUTINES)
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include <System/ThreadPool.hpp>
+
+namespace System {
+
+template <typename T = void>
+class Task;
+
+namespace details {
+    // Resume the awaiting coroutine from the final suspend point of the awaited one, without growing the stack.
+    struct TaskFinalAwaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        template <class Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            auto continuation = handle.promise().Continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept
+        {}
+    };
+
+    struct TaskPromiseBase
+    {
+        std::coroutine_handle<> Continuation;
+        std::exception_ptr Exception;
+
+        std::suspend_always initial_suspend() const noexcept
+        {
+            return {};
+        }
+
+        TaskFinalAwaiter final_suspend() const noexcept
+        {
+            return {};
+        }
+
+        void unhandled_exception() noexcept
+        {
+            Exception = std::current_exception();
+        }
+
+        void Rethrow()
+        {
+            if (Exception != nullptr)
+                std::rethrow_exception(Exception);
+        }
+    };
+
+    template <typename T>
+    struct TaskPromise : TaskPromiseBase
+    {
+        std::optional<T> Value;
+
+        Task<T> get_return_object() noexcept;
+
+        template <class U>
+        void return_value(U&& value)
+        {
+            Value.emplace(std::forward<U>(value));
+        }
+
+        T Take()
+        {
+            Rethrow();
+            return std::move(*Value);
+        }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase
+    {
+        Task<void> get_return_object() noexcept;
+
+        void return_void() noexcept
+        {}
+
+        void Take()
+        {
+            Rethrow();
+        }
+    };
+
+    // Eager coroutine destroying itself at the end, the body must not throw.
+    struct DetachedTask
+    {
+        struct promise_type
+        {
+            DetachedTask get_return_object() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never initial_suspend() const noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never final_suspend() const noexcept
+            {
+                return {};
+            }
+
+            void return_void() noexcept
+            {}
+
+            void unhandled_exception() noexcept
+            {
+                std::terminate();
+            }
+        };
+    };
+}
+
+// Lazy coroutine: the body starts when the task is awaited and the awaiting coroutine resumes right where the task
+// ends, on the same thread, through symmetric transfer. Start the body on a pool with co_await pool.Schedule().
+template <typename T>
+class Task
+{
+public:
+    using promise_type = details::TaskPromise<T>;
+
+private:
+    std::coroutine_handle<promise_type> _Handle;
+
+public:
+    Task() noexcept = default;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept:
+        _Handle(handle)
+    {}
+
+    Task(Task&& other) noexcept:
+        _Handle(std::exchange(other._Handle, nullptr))
+    {}
+
+    Task& operator=(Task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (_Handle)
+                _Handle.destroy();
+
+            _Handle = std::exchange(other._Handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    Task(Task const&) = delete;
+    Task& operator=(Task const&) = delete;
+
+    ~Task()
+    {
+        if (_Handle)
+            _Handle.destroy();
+    }
+
+    bool Valid() const noexcept
+    {
+        return static_cast<bool>(_Handle);
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> Handle;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                Handle.promise().Continuation = awaiting;
+                return Handle;
+            }
+
+            T await_resume()
+            {
+                return Handle.promise().Take();
+            }
+        };
+
+        return Awaiter{ _Handle };
+    }
+};
+
+namespace details {
+    template <typename T>
+    Task<T> TaskPromise<T>::get_return_object() noexcept
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() noexcept
+    {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+
+    template <typename T>
+    DetachedTask RunAndSignal(Task<T>& task, std::optional<std::conditional_t<std::is_void<T>::value, bool, T>>& result, std::exception_ptr& exception, std::atomic<bool>& done)
+    {
+        try
+        {
+            if constexpr (std::is_void<T>::value)
+            {
+                co_await std::move(task);
+                result.emplace(true);
+            }
+            else
+            {
+                result.emplace(co_await std::move(task));
+            }
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+
+        done.store(true, std::memory_order_release);
+        done.notify_all();
+    }
+}
+
+// Run the task and block the calling thread until it is done. Don't call it from a worker with a task that needs
+// that worker to make progress.
+template <typename T>
+T SyncWait(Task<T> task)
+{
+    std::optional<std::conditional_t<std::is_void<T>::value, bool, T>> result;
+    std::exception_ptr exception;
+    std::atomic<bool> done{ false };
+
+    details::RunAndSignal(task, result, exception, done);
+    done.wait(false, std::memory_order_acquire);
+
+    if (exception != nullptr)
+        std::rethrow_exception(exception);
+
+    if constexpr (!std::is_void<T>::value)
+        return std::move(*result);
+}
+
+// Owns fire-and-forget tasks: Spawn starts them right away, Join completes once they all finished and rethrows the
+// first exception one of them threw. The scope is joined again by its destructor.
+class AsyncScope
+{
+    // Spawned tasks plus one held until Join, so the count only reaches 0 once Join waits.
+    std::atomic<std::size_t> _Count;
+    std::coroutine_handle<> _Joiner;
+    std::mutex _Mutex;
+    std::exception_ptr _Exception;
+
+    static details::DetachedTask _Run(AsyncScope& scope, Task<void> task)
+    {
+        try
+        {
+            co_await std::move(task);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(scope._Mutex);
+            if (scope._Exception == nullptr)
+                scope._Exception = std::current_exception();
+        }
+
+        scope._Release();
+    }
+
+    void _Release()
+    {
+        if (_Count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            _Joiner.resume();
+    }
+
+    struct JoinAwaiter
+    {
+        AsyncScope& Scope;
+
+        bool await_ready() const noexcept
+        {
+            return Scope._Count.load(std::memory_order_acquire) == 1;
+        }
+
+        bool await_suspend(std::coroutine_handle<> joiner) noexcept
+        {
+            Scope._Joiner = joiner;
+            // Drop the Join reference: when the tasks are already done, don't suspend.
+            return Scope._Count.fetch_sub(1, std::memory_order_acq_rel) != 1;
+        }
+
+        void await_resume() noexcept
+        {
+            Scope._Count.store(1, std::memory_order_relaxed);
+        }
+    };
+
+public:
+    AsyncScope():
+        _Count(1)
+    {}
+
+    AsyncScope(AsyncScope const&) = delete;
+    AsyncScope& operator=(AsyncScope const&) = delete;
+
+    ~AsyncScope()
+    {
+        if (_Count.load(std::memory_order_acquire) != 1)
+        {
+            try
+            {
+                SyncWait(Join());
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    // Start the task on the calling thread until its first suspension point.
+    void Spawn(Task<void> task)
+    {
+        _Count.fetch_add(1, std::memory_order_relaxed);
+        _Run(*this, std::move(task));
+    }
+
+    Task<void> Join()
+    {
+        co_await JoinAwaiter{ *this };
+
+        std::exception_ptr exception;
+        {
+            std::lock_guard<std::mutex> lock(_Mutex);
+            exception = std::exchange(_Exception, nullptr);
+        }
+
+        if (exception != nullptr)
+            std::rethrow_exception(exception);
+    }
+
+    // Tasks spawned and not finished yet.
+    std::size_t Pending() const
+    {
+        return _Count.load(std::memory_order_relaxed) - 1;
+    }
+};
+
+}
+
+#endif
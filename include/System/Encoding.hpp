@@ -22,6 +22,7 @@
 #include <string>
 #include <string_view>
 #include <cstdint>
+#include <iosfwd>
 
 namespace System
 {
@@ -52,9 +53,121 @@ std::string Utf32ToUtf8(std::u32string const &str);
 
 std::string Utf32ToUtf8(std::u32string_view str);
 
+// Whether str is well-formed UTF-8: no overlong forms, surrogates or code points above U+10FFFF.
+bool IsValidUtf8(std::string_view str);
+
 // Size of UTF8 chars (not the size of the byte buffer).
 size_t EncodedLength(std::string_view str);
 
+// Exact output lengths, in units of the target encoding, of the conversions of valid input. A buffer of that size is
+// always large enough: the conversion of invalid input stops at its first error.
+size_t Utf8ToWCharLength(std::string_view str);
+
+size_t Utf8ToUtf16Length(std::string_view str);
+
+size_t Utf8ToUtf32Length(std::string_view str);
+
+size_t WCharToUtf8Length(std::wstring_view str);
+
+size_t Utf16ToUtf8Length(std::u16string_view str);
+
+size_t Utf32ToUtf8Length(std::u32string_view str);
+
+enum class ConvertError : uint8_t
+{
+    None,
+    // src holds an invalid sequence at Consumed.
+    InvalidSequence,
+    // src ends in the middle of the sequence at Consumed, convert it again once the rest is there.
+    Incomplete,
+    // The code point at Consumed doesn't fit in what is left of dst.
+    OutputTooSmall,
+};
+
+struct ConvertResult
+{
+    // Units written to dst.
+    size_t Written;
+    // Units of src converted, always a code point boundary.
+    size_t Consumed;
+    ConvertError Error;
+};
+
+// Convert src into a caller buffer of dst_size units, without allocating.
+// The conversion stops at the first error, everything before it is written.
+ConvertResult Convert(std::string_view src, wchar_t *dst, size_t dst_size);
+
+ConvertResult Convert(std::string_view src, char16_t *dst, size_t dst_size);
+
+ConvertResult Convert(std::string_view src, char32_t *dst, size_t dst_size);
+
+ConvertResult Convert(std::wstring_view src, char *dst, size_t dst_size);
+
+ConvertResult Convert(std::u16string_view src, char *dst, size_t dst_size);
+
+ConvertResult Convert(std::u32string_view src, char *dst, size_t dst_size);
+
+enum class ErrorPolicy : uint8_t
+{
+    // Stop at the first invalid sequence.
+    Strict,
+    // Write U+FFFD for every maximal invalid subpart, as the Unicode standard recommends.
+    Replace,
+};
+
+// Converts a stream chunk by chunk, the chunks can split a sequence anywhere: its first units are carried over to the
+// next Write. Only a sequence (4 bytes at most) is kept between calls, out can be cleared and reused for every chunk.
+// One side of the conversion is UTF-8, the other is UTF-16, UTF-32 or wchar_t.
+template <typename InputUnit, typename OutputUnit>
+class StreamTranscoder
+{
+    static_assert(sizeof(InputUnit) == 1 || sizeof(OutputUnit) == 1, "StreamTranscoder converts from or to UTF-8.");
+
+    ErrorPolicy _Policy;
+    InputUnit _Carry[4];
+    uint8_t _CarryLength;
+    bool _Failed;
+    size_t _Position;
+
+    bool _Invalid(size_t length, std::basic_string<OutputUnit> &out);
+
+public:
+    explicit StreamTranscoder(ErrorPolicy policy = ErrorPolicy::Replace);
+
+    // Append the conversion of chunk to out. false once the Strict policy met an invalid sequence: out then ends
+    // before it, Position() is its offset in the stream and every call fails until Reset().
+    bool Write(std::basic_string_view<InputUnit> chunk, std::basic_string<OutputUnit> &out);
+
+    // End of the stream: a sequence still carried over is incomplete, so it is invalid.
+    bool Finish(std::basic_string<OutputUnit> &out);
+
+    void Reset();
+
+    ErrorPolicy Policy() const { return _Policy; }
+
+    bool Failed() const { return _Failed; }
+
+    // Units of input converted so far, the carried over ones excluded.
+    size_t Position() const { return _Position; }
+
+    // Units of input carried over to the next Write.
+    size_t Pending() const { return _CarryLength; }
+};
+
+extern template class StreamTranscoder<char, wchar_t>;
+extern template class StreamTranscoder<char, char16_t>;
+extern template class StreamTranscoder<char, char32_t>;
+extern template class StreamTranscoder<wchar_t, char>;
+extern template class StreamTranscoder<char16_t, char>;
+extern template class StreamTranscoder<char32_t, char>;
+
+using Utf8ToWCharTranscoder = StreamTranscoder<char, wchar_t>;
+using Utf8ToUtf16Transcoder = StreamTranscoder<char, char16_t>;
+using Utf8ToUtf32Transcoder = StreamTranscoder<char, char32_t>;
+using WCharToUtf8Transcoder = StreamTranscoder<wchar_t, char>;
+using Utf16ToUtf8Transcoder = StreamTranscoder<char16_t, char>;
+using Utf32ToUtf8Transcoder = StreamTranscoder<char32_t, char>;
+
 namespace Base64
 {
 
@@ -120,6 +233,83 @@ inline std::string UrlDecode(std::string_view data)
     return dest;
 }
 
+enum class Alphabet : uint8_t
+{
+    Standard,
+    // RFC 4648 base64url: - and _ instead of + and /.
+    Url,
+};
+
+// MIME (RFC 2045) lines hold 76 characters at most.
+static constexpr std::size_t MimeLineLength = 76;
+
+// Encodes a payload chunk by chunk, the bytes of an incomplete group are carried over to the next Update.
+// line_length wraps the output with CRLF, 0 doesn't wrap. It must be a multiple of 4, so groups are never split.
+class Encoder
+{
+    Alphabet _Alphabet;
+    bool _Padding;
+    std::size_t _LineLength;
+    std::size_t _Column;
+    std::uint8_t _Carry[3];
+    std::uint8_t _CarryLength;
+
+    void _Write(std::uint8_t const *in, std::size_t groups, std::string &out);
+
+public:
+    explicit Encoder(Alphabet alphabet = Alphabet::Standard, bool padding = true, std::size_t line_length = 0);
+
+    // Append the characters of the whole groups to out.
+    void Update(void const *data, std::size_t len, std::string &out);
+
+    void Update(std::string_view chunk, std::string &out) { Update(chunk.data(), chunk.size(), out); }
+
+    // Append the last group, padded when padding is on, and start over.
+    void Finish(std::string &out);
+
+    void Reset();
+};
+
+// Decodes a payload chunk by chunk, the characters of an incomplete group are carried over to the next Update.
+// Whitespace is skipped anywhere, so wrapped lines decode as they are. Nothing but whitespace can follow the padding.
+// strict_padding also wants the last group padded to 4 characters and its unused bits cleared, the canonical form.
+class Decoder
+{
+    Alphabet _Alphabet;
+    bool _StrictPadding;
+    bool _Failed;
+    bool _Ended;
+    std::uint8_t _GroupLength;
+    std::uint8_t _PaddingLength;
+    std::uint8_t _Group[4];
+    std::size_t _Position;
+
+    bool _Fail();
+    bool _EndGroup(std::string &out, std::size_t &written);
+
+public:
+    explicit Decoder(Alphabet alphabet = Alphabet::Standard, bool strict_padding = false);
+
+    // Append the bytes of the whole groups to out. false on a character out of the alphabet or a misplaced padding:
+    // Position() is its offset in the stream and every call fails until Reset().
+    bool Update(std::string_view chunk, std::string &out);
+
+    // End of the payload: append the bytes of the last group, false when it can't end there. Starts over.
+    bool Finish(std::string &out);
+
+    void Reset();
+
+    bool Failed() const { return _Failed; }
+
+    // Characters read so far, the offending one when Failed().
+    std::size_t Position() const { return _Position; }
+};
+
+// Encode or decode all of in to out, a chunk at a time. false when a stream fails or the input is not valid.
+bool Encode(std::istream &in, std::ostream &out, Encoder &encoder);
+
+bool Decode(std::istream &in, std::ostream &out, Decoder &decoder);
+
 } // namespace Base64
 
 } // namespace Encoding
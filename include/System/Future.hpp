@@ -0,0 +1,562 @@
+/*
+ * Copyright (C) Nemirtingas
+ * This file is part of System.
+ *
+ * System is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * System is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the System; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <System/ThreadPool.hpp>
+#include <System/UniqueFunction.hpp>
+
+namespace System {
+
+template <typename T>
+class Future;
+
+template <typename T>
+class Promise;
+
+namespace details {
+    template <typename T>
+    struct FutureValue
+    {
+        std::optional<T> Value;
+
+        template <class... Args>
+        void Emplace(Args&&... args)
+        {
+            Value.emplace(std::forward<Args>(args)...);
+        }
+
+        T Take()
+        {
+            return std::move(*Value);
+        }
+    };
+
+    template <>
+    struct FutureValue<void>
+    {
+        void Emplace()
+        {}
+
+        void Take()
+        {}
+    };
+
+    // Shared state of a Promise and its Future. Continuations are posted to Pool once the state is satisfied, or run
+    // inline when there is no pool or when they only forward the result to another state.
+    template <typename T>
+    struct FutureState : FutureValue<T>
+    {
+        struct Continuation
+        {
+            UniqueFunction<void()> Fn;
+            bool Inline;
+        };
+
+        ThreadPool* Pool;
+        std::atomic<bool> Ready{ false };
+        std::mutex Mutex;
+        std::condition_variable Notifier;
+        bool Satisfied = false;
+        std::exception_ptr Exception;
+        std::vector<Continuation> Continuations;
+
+        explicit FutureState(ThreadPool* pool):
+            Pool(pool)
+        {}
+
+        // Returns false when the state was already satisfied.
+        template <class... Args>
+        bool SetValue(Args&&... args)
+        {
+            std::unique_lock<std::mutex> lock(Mutex);
+            if (Satisfied)
+                return false;
+
+            this->Emplace(std::forward<Args>(args)...);
+            _Complete(lock);
+            return true;
+        }
+
+        bool SetException(std::exception_ptr exception)
+        {
+            std::unique_lock<std::mutex> lock(Mutex);
+            if (Satisfied)
+                return false;
+
+            Exception = std::move(exception);
+            _Complete(lock);
+            return true;
+        }
+
+        void OnReady(UniqueFunction<void()>&& fn, bool run_inline = false)
+        {
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+                if (!Satisfied)
+                {
+                    Continuations.emplace_back(Continuation{ std::move(fn), run_inline });
+                    return;
+                }
+            }
+
+            _Run(std::move(fn), run_inline);
+        }
+
+        // Help the pool while waiting, like TaskGroup::Wait.
+        void Wait()
+        {
+            if (Pool != nullptr)
+            {
+                Pool->HelpUntil([this]() { return Ready.load(); });
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(Mutex);
+            Notifier.wait(lock, [this]() { return Satisfied; });
+        }
+
+    private:
+        void _Complete(std::unique_lock<std::mutex>& lock)
+        {
+            Satisfied = true;
+            Ready.store(true);
+            auto continuations = std::move(Continuations);
+            lock.unlock();
+
+            // Waiters of a state with a pool sleep in ThreadPool::HelpUntil.
+            if (Pool == nullptr)
+                Notifier.notify_all();
+            else
+                Pool->NotifyHelpers();
+            for (auto& continuation : continuations)
+                _Run(std::move(continuation.Fn), continuation.Inline);
+        }
+
+        void _Run(UniqueFunction<void()>&& fn, bool run_inline)
+        {
+            if (Pool == nullptr || run_inline)
+                fn();
+            else
+                Pool->Post(std::move(fn));
+        }
+    };
+
+    struct FutureAccess
+    {
+        template <typename T>
+        static std::shared_ptr<FutureState<T>>& State(Future<T>& future)
+        {
+            return future._State;
+        }
+    };
+
+    template <typename T>
+    struct IsFuture : std::false_type
+    {};
+
+    template <typename T>
+    struct IsFuture<Future<T>> : std::true_type
+    {};
+
+    template <typename T>
+    struct UnwrapFuture
+    {
+        using type = T;
+    };
+
+    template <typename T>
+    struct UnwrapFuture<Future<T>>
+    {
+        using type = T;
+    };
+
+    template <typename T>
+    struct TypeTag
+    {
+        using type = T;
+    };
+
+    // What a Then continuation returns: it takes the Future itself when it accepts one, else the value.
+    template <typename T, typename Func>
+    auto ContinuationResult()
+    {
+        if constexpr (std::is_invocable<Func&, Future<T>>::value)
+            return TypeTag<std::invoke_result_t<Func&, Future<T>>>{};
+        else if constexpr (std::is_void<T>::value)
+            return TypeTag<std::invoke_result_t<Func&>>{};
+        else
+            return TypeTag<std::invoke_result_t<Func&, T>>{};
+    }
+
+    template <typename T, typename Func>
+    using continuation_result_t = typename decltype(ContinuationResult<T, Func>())::type;
+
+    template <typename T>
+    void ForwardState(FutureState<T>& from, FutureState<T>& to)
+    {
+        if (from.Exception != nullptr)
+            to.SetException(from.Exception);
+        else if constexpr (std::is_void<T>::value)
+            to.SetValue();
+        else
+            to.SetValue(from.Take());
+    }
+
+    // Store the result of call() in state, a returned Future is unwrapped.
+    template <typename R, typename Call>
+    void FulfillState(std::shared_ptr<FutureState<typename UnwrapFuture<R>::type>> const& state, Call&& call)
+    {
+        try
+        {
+            if constexpr (IsFuture<R>::value)
+            {
+                R inner = call();
+                auto inner_state = FutureAccess::State(inner);
+                if (inner_state == nullptr)
+                    throw std::future_error(std::future_errc::no_state);
+
+                auto& ref = *inner_state;
+                ref.OnReady([inner_state = std::move(inner_state), state]() { ForwardState(*inner_state, *state); }, true);
+            }
+            else if constexpr (std::is_void<R>::value)
+            {
+                call();
+                state->SetValue();
+            }
+            else
+            {
+                state->SetValue(call());
+            }
+        }
+        catch (...)
+        {
+            state->SetException(std::current_exception());
+        }
+    }
+}
+
+// Future of a value computed in a ThreadPool. Unlike std::future, work can be chained with Then and combined with
+// WhenAll and WhenAny without blocking a thread, continuations are posted to the pool once the value is there.
+// Wait and Get run queued tasks of the pool while the value is not ready.
+template <typename T>
+class Future
+{
+    std::shared_ptr<details::FutureState<T>> _State;
+
+    friend struct details::FutureAccess;
+
+public:
+    Future() = default;
+
+    explicit Future(std::shared_ptr<details::FutureState<T>> state):
+        _State(std::move(state))
+    {}
+
+    Future(Future&&) noexcept = default;
+    Future& operator=(Future&&) noexcept = default;
+
+    Future(Future const&) = delete;
+    Future& operator=(Future const&) = delete;
+
+    // False once Get or Then consumed the future.
+    bool Valid() const
+    {
+        return _State != nullptr;
+    }
+
+    bool IsReady() const
+    {
+        return _State->Ready.load(std::memory_order_acquire);
+    }
+
+    void Wait() const
+    {
+        _State->Wait();
+    }
+
+    // Wait for the value and move it out, or rethrow the exception. The future is no longer valid afterward.
+    T Get()
+    {
+        if (_State == nullptr)
+            throw std::future_error(std::future_errc::no_state);
+
+        _State->Wait();
+        auto state = std::move(_State);
+        if (state->Exception != nullptr)
+            std::rethrow_exception(state->Exception);
+
+        return state->Take();
+    }
+
+    // Run fn once the future is ready and return the future of its result, the future is consumed.
+    // fn receives the Future itself when it accepts one, else the value: an exception then skips fn and goes to the
+    // returned future. When fn returns a Future, the returned future is ready once that one is.
+    template <class Func>
+    Future<typename details::UnwrapFuture<details::continuation_result_t<T, std::decay_t<Func>>>::type> Then(Func&& fn)
+    {
+        using result_type = details::continuation_result_t<T, std::decay_t<Func>>;
+        using value_type = typename details::UnwrapFuture<result_type>::type;
+
+        if (_State == nullptr)
+            throw std::future_error(std::future_errc::no_state);
+
+        auto next = std::make_shared<details::FutureState<value_type>>(_State->Pool);
+        auto state = std::move(_State);
+        auto& ref = *state;
+        ref.OnReady([state = std::move(state), next, fn = std::forward<Func>(fn)]() mutable
+        {
+            if constexpr (std::is_invocable<std::decay_t<Func>&, Future<T>>::value)
+            {
+                details::FulfillState<result_type>(next, [&]() { return fn(Future<T>(std::move(state))); });
+            }
+            else
+            {
+                if (state->Exception != nullptr)
+                    next->SetException(state->Exception);
+                else if constexpr (std::is_void<T>::value)
+                    details::FulfillState<result_type>(next, [&]() { return fn(); });
+                else
+                    details::FulfillState<result_type>(next, [&]() { return fn(state->Take()); });
+            }
+        });
+
+        return Future<value_type>(std::move(next));
+    }
+};
+
+template <typename T>
+class Promise
+{
+    std::shared_ptr<details::FutureState<T>> _State;
+    bool _Retrieved;
+
+public:
+    // Continuations of the future are posted to pool.
+    explicit Promise(ThreadPool& pool):
+        _State(std::make_shared<details::FutureState<T>>(&pool)),
+        _Retrieved(false)
+    {}
+
+    // Continuations of the future run on the thread satisfying the promise.
+    Promise():
+        _State(std::make_shared<details::FutureState<T>>(nullptr)),
+        _Retrieved(false)
+    {}
+
+    Promise(Promise&&) noexcept = default;
+    Promise& operator=(Promise&&) noexcept = default;
+
+    Promise(Promise const&) = delete;
+    Promise& operator=(Promise const&) = delete;
+
+    // A promise never satisfied breaks its future.
+    ~Promise()
+    {
+        if (_State != nullptr)
+            _State->SetException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+    }
+
+    Future<T> GetFuture()
+    {
+        if (_State == nullptr)
+            throw std::future_error(std::future_errc::no_state);
+
+        if (_Retrieved)
+            throw std::future_error(std::future_errc::future_already_retrieved);
+
+        _Retrieved = true;
+        return Future<T>(_State);
+    }
+
+    template <class... Args>
+    void SetValue(Args&&... args)
+    {
+        if (_State == nullptr)
+            throw std::future_error(std::future_errc::no_state);
+
+        if (!_State->SetValue(std::forward<Args>(args)...))
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+    }
+
+    void SetException(std::exception_ptr exception)
+    {
+        if (_State == nullptr)
+            throw std::future_error(std::future_errc::no_state);
+
+        if (!_State->SetException(std::move(exception)))
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+    }
+};
+
+// Run fn(args...) in pool, the Future holds its result or its exception. A returned Future is unwrapped.
+template <class Func, class... Args, class = std::enable_if_t<!std::is_same<std::decay_t<Func>, TaskOptions>::value>>
+auto Async(ThreadPool& pool, Func&& fn, Args &&...args)
+{
+    return Async(pool, TaskOptions{}, std::forward<Func>(fn), std::forward<Args>(args)...);
+}
+
+template <class Func, class... Args>
+auto Async(ThreadPool& pool, TaskOptions const& options, Func&& fn, Args &&...args)
+{
+    using result_type = std::invoke_result_t<std::decay_t<Func>&, std::decay_t<Args>&...>;
+    using value_type = typename details::UnwrapFuture<result_type>::type;
+
+    auto state = std::make_shared<details::FutureState<value_type>>(&pool);
+    pool.Post(options, [state, fn = std::forward<Func>(fn), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+    {
+        details::FulfillState<result_type>(state, [&]() { return std::apply(fn, args); });
+    });
+
+    return Future<value_type>(std::move(state));
+}
+
+// Future of every value, in the futures order. When some futures fail, it holds the exception of the first one in
+// that order, once they are all ready.
+template <typename T>
+auto WhenAll(std::vector<Future<T>> futures)
+{
+    using result_type = std::conditional_t<std::is_void<T>::value, void, std::vector<T>>;
+
+    struct Shared
+    {
+        std::vector<std::shared_ptr<details::FutureState<T>>> States;
+        std::atomic<std::size_t> Remaining;
+        std::shared_ptr<details::FutureState<result_type>> Result;
+
+        void Complete()
+        {
+            for (auto& state : States)
+            {
+                if (state->Exception != nullptr)
+                {
+                    Result->SetException(state->Exception);
+                    return;
+                }
+            }
+
+            if constexpr (std::is_void<T>::value)
+            {
+                Result->SetValue();
+            }
+            else
+            {
+                std::vector<T> values;
+                values.reserve(States.size());
+                for (auto& state : States)
+                    values.emplace_back(state->Take());
+
+                Result->SetValue(std::move(values));
+            }
+        }
+    };
+
+    auto shared = std::make_shared<Shared>();
+    for (auto& future : futures)
+    {
+        auto& state = details::FutureAccess::State(future);
+        if (state == nullptr)
+            throw std::future_error(std::future_errc::no_state);
+
+        shared->States.emplace_back(std::move(state));
+    }
+
+    shared->Result = std::make_shared<details::FutureState<result_type>>(shared->States.empty() ? nullptr : shared->States.front()->Pool);
+    shared->Remaining = shared->States.size();
+    if (shared->States.empty())
+        shared->Result->SetValue();
+
+    Future<result_type> result(shared->Result);
+    // Completing a state runs these inline, the last one may run before the loop ends.
+    const auto states = shared->States;
+    for (auto& state : states)
+    {
+        state->OnReady([shared]()
+        {
+            if (--shared->Remaining == 0)
+                shared->Complete();
+        }, true);
+    }
+
+    return result;
+}
+
+template <typename T>
+struct WhenAnyResult
+{
+    // Index of the first ready future, or the size of Futures when there was none.
+    std::size_t Index;
+    std::vector<Future<T>> Futures;
+};
+
+// Future ready as soon as one of the futures is, it gives them back with the index of that one.
+template <typename T>
+Future<WhenAnyResult<T>> WhenAny(std::vector<Future<T>> futures)
+{
+    struct Shared
+    {
+        std::atomic<bool> Fired{ false };
+        std::vector<Future<T>> Futures;
+        std::shared_ptr<details::FutureState<WhenAnyResult<T>>> Result;
+    };
+
+    std::vector<std::shared_ptr<details::FutureState<T>>> states;
+    for (auto& future : futures)
+    {
+        auto& state = details::FutureAccess::State(future);
+        if (state == nullptr)
+            throw std::future_error(std::future_errc::no_state);
+
+        states.emplace_back(state);
+    }
+
+    auto shared = std::make_shared<Shared>();
+    shared->Result = std::make_shared<details::FutureState<WhenAnyResult<T>>>(states.empty() ? nullptr : states.front()->Pool);
+    shared->Futures = std::move(futures);
+
+    Future<WhenAnyResult<T>> result(shared->Result);
+    if (states.empty())
+    {
+        shared->Result->SetValue(WhenAnyResult<T>{ 0, {} });
+        return result;
+    }
+
+    for (std::size_t i = 0; i < states.size(); ++i)
+    {
+        states[i]->OnReady([shared, i]()
+        {
+            if (!shared->Fired.exchange(true, std::memory_order_acq_rel))
+                shared->Result->SetValue(WhenAnyResult<T>{ i, std::move(shared->Futures) });
+        }, true);
+    }
+
+    return result;
+}
+
+}
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) Nemirtingas
+ * This file is part of System.
+ *
+ * System is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * System is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the System; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace System {
+namespace String {
+
+namespace details {
+    inline uint64_t InternHashMix(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // 64 bits hash of 8 bytes words, StringSwitch::Hash goes a byte at a time and its low bits are too weak for a
+    // power of 2 table.
+    inline uint64_t InternHash(std::string_view str)
+    {
+        const char* data = str.data();
+        size_t len = str.length();
+        uint64_t h = 0x9E3779B97F4A7C15ull ^ (len * 0xC2B2AE3D27D4EB4Full);
+        for (; len >= 8; data += 8, len -= 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data, 8);
+            h ^= word * 0x87C37B91114253D5ull;
+            h = ((h << 31) | (h >> 33)) * 0x4CF5AD432745937Full;
+        }
+
+        if (len > 0)
+        {
+            uint64_t word = 0;
+            std::memcpy(&word, data, len);
+            h ^= word * 0x87C37B91114253D5ull;
+        }
+
+        return InternHashMix(h);
+    }
+}
+
+// Stores one copy of each distinct string and gives it a compact handle. Handles compare in O(1) and the views stay
+// valid, at the same address, for the life of the pool. Strings are never removed.
+// Thread-safe: lookups, Find and View, take no lock; Intern only locks to add a new string.
+class InternPool
+{
+public:
+    class Handle
+    {
+        uint32_t _Id;
+
+        friend class InternPool;
+
+        explicit constexpr Handle(uint32_t id):
+            _Id(id)
+        {}
+
+    public:
+        // An invalid handle.
+        constexpr Handle():
+            _Id(0xFFFFFFFF)
+        {}
+
+        constexpr bool Valid() const
+        {
+            return _Id != 0xFFFFFFFF;
+        }
+
+        // Ids are given in insertion order from 0, they can index side tables.
+        constexpr uint32_t Id() const
+        {
+            return _Id;
+        }
+
+        constexpr bool operator==(Handle other) const { return _Id == other._Id; }
+        constexpr bool operator!=(Handle other) const { return _Id != other._Id; }
+        constexpr bool operator <(Handle other) const { return _Id < other._Id; }
+    };
+
+private:
+    struct Entry
+    {
+        const char* Data;
+        size_t Length;
+    };
+
+    // Open addressing table of (hash >> 32) << 32 | (id + 1), 0 is an empty slot. Readers may still walk a table
+    // after a resize replaced it, so the old ones are kept until the pool dies.
+    struct Table
+    {
+        size_t Mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> Slots;
+
+        explicit Table(size_t capacity):
+            Mask(capacity - 1),
+            Slots(new std::atomic<uint64_t>[capacity])
+        {
+            for (size_t i = 0; i < capacity; ++i)
+                Slots[i].store(0, std::memory_order_relaxed);
+        }
+    };
+
+    static constexpr size_t _ArenaChunkSize = 64 * 1024;
+    // Entries live in segments of doubling size: segment k holds _FirstSegmentSize << k entries and is never moved.
+    static constexpr size_t _FirstSegmentSize = 256;
+    static constexpr size_t _SegmentCount = 24;
+    // Entries the segments hold, a little under the 2^32 - 1 ids a Handle can name.
+    static constexpr size_t _Capacity = _FirstSegmentSize * ((size_t(1) << _SegmentCount) - 1);
+    static_assert(_Capacity < 0xFFFFFFFF, "Every id must fit a Handle and differ from the invalid one.");
+
+    std::atomic<Table*> _Table;
+    std::atomic<Entry*> _Segments[_SegmentCount];
+    std::atomic<uint32_t> _Size;
+
+    // Writers only.
+    mutable std::mutex _Mutex;
+    std::vector<std::unique_ptr<Table>> _Tables;
+    std::vector<std::unique_ptr<char[]>> _Chunks;
+    char* _ArenaPosition;
+    size_t _ArenaLeft;
+    size_t _ArenaBytes;
+
+    static size_t _SegmentOf(uint32_t id, size_t& offset)
+    {
+        const size_t index = id / _FirstSegmentSize + 1;
+        size_t segment = 0;
+        while ((size_t(2) << segment) <= index)
+            ++segment;
+
+        offset = id - _FirstSegmentSize * ((size_t(1) << segment) - 1);
+        return segment;
+    }
+
+    Entry const& _GetEntry(uint32_t id) const
+    {
+        size_t offset;
+        const size_t segment = _SegmentOf(id, offset);
+        return _Segments[segment].load(std::memory_order_acquire)[offset];
+    }
+
+    Handle _Find(Table const& table, std::string_view str, uint64_t hash) const
+    {
+        const uint64_t tag = hash >> 32;
+        for (size_t i = hash & table.Mask;; i = (i + 1) & table.Mask)
+        {
+            const uint64_t slot = table.Slots[i].load(std::memory_order_acquire);
+            if (slot == 0)
+                return Handle();
+
+            if ((slot >> 32) != tag)
+                continue;
+
+            const uint32_t id = static_cast<uint32_t>(slot) - 1;
+            Entry const& entry = _GetEntry(id);
+            if (entry.Length == str.length() && (str.empty() || std::memcmp(entry.Data, str.data(), str.length()) == 0))
+                return Handle(id);
+        }
+    }
+
+    static void _Insert(Table& table, uint64_t hash, uint32_t id)
+    {
+        size_t i = hash & table.Mask;
+        while (table.Slots[i].load(std::memory_order_relaxed) != 0)
+            i = (i + 1) & table.Mask;
+
+        // Publishes the entry to the readers.
+        table.Slots[i].store(((hash >> 32) << 32) | (uint64_t(id) + 1), std::memory_order_release);
+    }
+
+    const char* _Store(std::string_view str)
+    {
+        // Views are null terminated, they can be used as C strings.
+        const size_t size = str.length() + 1;
+        if (size > _ArenaLeft)
+        {
+            const size_t chunk_size = size > _ArenaChunkSize ? size : _ArenaChunkSize;
+            _Chunks.emplace_back(new char[chunk_size]);
+            _ArenaPosition = _Chunks.back().get();
+            _ArenaLeft = chunk_size;
+            _ArenaBytes += chunk_size;
+        }
+
+        char* data = _ArenaPosition;
+        if (!str.empty())
+            std::memcpy(data, str.data(), str.length());
+
+        data[str.length()] = '\0';
+        _ArenaPosition += size;
+        _ArenaLeft -= size;
+        return data;
+    }
+
+    void _Grow(Table const& table)
+    {
+        const size_t capacity = (table.Mask + 1) * 2;
+        _Tables.emplace_back(new Table(capacity));
+        Table& grown = *_Tables.back();
+
+        const uint32_t size = _Size.load(std::memory_order_relaxed);
+        for (uint32_t id = 0; id < size; ++id)
+        {
+            Entry const& entry = _GetEntry(id);
+            _Insert(grown, details::InternHash(std::string_view(entry.Data, entry.Length)), id);
+        }
+
+        _Table.store(&grown, std::memory_order_release);
+    }
+
+public:
+    explicit InternPool(size_t capacity = 1024):
+        _Size(0),
+        _ArenaPosition(nullptr),
+        _ArenaLeft(0),
+        _ArenaBytes(0)
+    {
+        size_t table_capacity = 16;
+        while (table_capacity < capacity * 2)
+            table_capacity *= 2;
+
+        _Tables.emplace_back(new Table(table_capacity));
+        _Table.store(_Tables.back().get(), std::memory_order_relaxed);
+
+        for (auto& segment : _Segments)
+            segment.store(nullptr, std::memory_order_relaxed);
+    }
+
+    InternPool(InternPool const&) = delete;
+    InternPool& operator=(InternPool const&) = delete;
+
+    ~InternPool()
+    {
+        for (size_t segment = 0; segment < _SegmentCount; ++segment)
+            delete[] _Segments[segment].load(std::memory_order_relaxed);
+    }
+
+    // The handle of str, added to the pool if needed.
+    Handle Intern(std::string_view str)
+    {
+        const uint64_t hash = details::InternHash(str);
+        Handle handle = _Find(*_Table.load(std::memory_order_acquire), str, hash);
+        if (handle.Valid())
+            return handle;
+
+        std::lock_guard<std::mutex> lock(_Mutex);
+        // Another writer may have added it meanwhile.
+        Table* table = _Table.load(std::memory_order_relaxed);
+        handle = _Find(*table, str, hash);
+        if (handle.Valid())
+            return handle;
+
+        const uint32_t id = _Size.load(std::memory_order_relaxed);
+        if (id >= _Capacity)
+            throw std::length_error("InternPool is full.");
+
+        size_t offset;
+        const size_t segment = _SegmentOf(id, offset);
+        Entry* entries = _Segments[segment].load(std::memory_order_relaxed);
+        if (entries == nullptr)
+        {
+            entries = new Entry[_FirstSegmentSize << segment];
+            _Segments[segment].store(entries, std::memory_order_release);
+        }
+
+        entries[offset] = Entry{ _Store(str), str.length() };
+        _Size.store(id + 1, std::memory_order_release);
+
+        // Keep the load factor under 1/2 so probes stay short.
+        if ((size_t(id) + 1) * 2 > table->Mask + 1)
+            _Grow(*table);
+        else
+            _Insert(*table, hash, id);
+
+        return Handle(id);
+    }
+
+    // The stable copy of str in the pool.
+    std::string_view InternView(std::string_view str)
+    {
+        return View(Intern(str));
+    }
+
+    // The handle of str when it was interned, an invalid handle otherwise. Never locks.
+    Handle Find(std::string_view str) const
+    {
+        return _Find(*_Table.load(std::memory_order_acquire), str, details::InternHash(str));
+    }
+
+    // The string of a valid handle of this pool. Never locks.
+    std::string_view View(Handle handle) const
+    {
+        Entry const& entry = _GetEntry(handle._Id);
+        return std::string_view(entry.Data, entry.Length);
+    }
+
+    size_t Size() const
+    {
+        return _Size.load(std::memory_order_acquire);
+    }
+
+    // Bytes reserved by the string storage.
+    size_t ArenaBytes() const
+    {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        return _ArenaBytes;
+    }
+};
+
+}
+}
+
+namespace std {
+template<>
+struct hash<System::String::InternPool::Handle>
+{
+    size_t operator()(System::String::InternPool::Handle handle) const
+    {
+        return std::hash<uint32_t>()(handle.Id());
+    }
+};
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) Nemirtingas
+ * This file is part of System.
+ *
+ * System is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * System is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the System; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace System {
+
+// Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design).
+// Each cell carries a sequence number telling producers and consumers whose turn it is, so a push or a pop is one CAS
+// on the shared position plus a store on the cell. The positions sit on their own cache lines.
+// The capacity is rounded up to a power of 2.
+template <typename T>
+class MPMCQueue
+{
+    // A claimed cell must always be published, so values move in and out without throwing.
+    static_assert(std::is_nothrow_move_constructible<T>::value && std::is_nothrow_move_assignable<T>::value,
+                  "MPMCQueue needs noexcept move operations.");
+
+    static constexpr std::size_t CacheLineSize = 64;
+
+    struct Cell
+    {
+        std::atomic<std::size_t> Sequence;
+        alignas(T) unsigned char Storage[sizeof(T)];
+
+        T* Value()
+        {
+            return reinterpret_cast<T*>(&Storage);
+        }
+    };
+
+    std::unique_ptr<Cell[]> _Cells;
+    std::size_t _Mask;
+    alignas(CacheLineSize) std::atomic<std::size_t> _EnqueuePosition;
+    alignas(CacheLineSize) std::atomic<std::size_t> _DequeuePosition;
+
+    static std::size_t _RoundCapacity(std::size_t capacity)
+    {
+        std::size_t rounded = 2;
+        while (rounded < capacity)
+            rounded *= 2;
+
+        return rounded;
+    }
+
+    // Claims a cell and constructs the value in it, constructing T from args must not throw.
+    template <typename... Args>
+    bool _TryEmplace(Args&&... args)
+    {
+        Cell* cell;
+        std::size_t position = _EnqueuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &_Cells[position & _Mask];
+            const std::size_t sequence = cell->Sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0)
+            {
+                if (_EnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = _EnqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (cell->Value()) T(std::forward<Args>(args)...);
+        cell->Sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+public:
+    explicit MPMCQueue(std::size_t capacity):
+        _Cells(new Cell[_RoundCapacity(capacity)]),
+        _Mask(_RoundCapacity(capacity) - 1),
+        _EnqueuePosition(0),
+        _DequeuePosition(0)
+    {
+        for (std::size_t i = 0; i <= _Mask; ++i)
+            _Cells[i].Sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MPMCQueue(MPMCQueue const&) = delete;
+    MPMCQueue& operator=(MPMCQueue const&) = delete;
+
+    ~MPMCQueue()
+    {
+        const std::size_t enqueue_position = _EnqueuePosition.load(std::memory_order_relaxed);
+        for (std::size_t position = _DequeuePosition.load(std::memory_order_relaxed); position != enqueue_position; ++position)
+            _Cells[position & _Mask].Value()->~T();
+    }
+
+    // Returns false when the queue is full, args are left untouched then. When constructing T from args can throw, the
+    // value is constructed before a cell is claimed so an exception leaves the queue as it was: rvalue args are then
+    // moved from even when the queue is full.
+    template <typename... Args>
+    bool TryEmplace(Args&&... args)
+    {
+        if constexpr (std::is_nothrow_constructible<T, Args&&...>::value)
+        {
+            return _TryEmplace(std::forward<Args>(args)...);
+        }
+        else
+        {
+            T value(std::forward<Args>(args)...);
+            return _TryEmplace(std::move(value));
+        }
+    }
+
+    bool TryPush(T&& value)
+    {
+        return TryEmplace(std::move(value));
+    }
+
+    bool TryPush(T const& value)
+    {
+        return TryEmplace(value);
+    }
+
+    // Returns false when the queue is empty.
+    bool TryPop(T& value)
+    {
+        Cell* cell;
+        std::size_t position = _DequeuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &_Cells[position & _Mask];
+            const std::size_t sequence = cell->Sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (difference == 0)
+            {
+                if (_DequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = _DequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(*cell->Value());
+        cell->Value()->~T();
+        cell->Sequence.store(position + _Mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t Capacity() const
+    {
+        return _Mask + 1;
+    }
+
+    // Only a hint while other threads push or pop.
+    std::size_t SizeApprox() const
+    {
+        const std::size_t enqueue_position = _EnqueuePosition.load(std::memory_order_relaxed);
+        const std::size_t dequeue_position = _DequeuePosition.load(std::memory_order_relaxed);
+        return enqueue_position > dequeue_position ? enqueue_position - dequeue_position : 0;
+    }
+
+    bool EmptyApprox() const
+    {
+        return SizeApprox() == 0;
+    }
+};
+
+}
@@ -21,10 +21,13 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
+#include <initializer_list>
 #include <iterator>
 #include <string_view>
+#include <type_traits>
 
 #include "StringSwitch.hpp"
 
@@ -35,6 +38,10 @@ namespace String {
 // Implementations
 
 namespace details {
+    size_t CountLeadingSpaces(const char* str, size_t len);
+
+    size_t CountTrailingSpaces(const char* str, size_t len);
+
     void LeftTrim(std::string& str);
 
     void RightTrim(std::string& str);
@@ -46,9 +53,16 @@ namespace details {
     char* CloneString(std::string_view src);
 
     size_t CopyString(std::string_view src, char *dst, size_t dst_size);
+
+    // Index of the first byte of str found in set, len when there is none.
+    size_t FindAnyOf(const char* str, size_t len, const char* set, size_t set_len);
+
+    // Index of the first occurrence of pattern in str, std::string_view::npos when there is none.
+    size_t Find(const char* str, size_t len, const char* pattern, size_t pattern_len);
 }
 
 
+// Whitespace is the std::isspace set of the "C" locale: space, \t, \n, \v, \f and \r.
 inline void LeftTrim(std::string& str)
 {
     details::LeftTrim(str);
@@ -61,8 +75,25 @@ inline void RightTrim(std::string& str)
 
 inline void Trim(std::string& str)
 {
-    LeftTrim(str);
+    // Right first, the left trim then moves only what is kept.
     RightTrim(str);
+    LeftTrim(str);
+}
+
+// Views of str without the whitespace, nothing is copied or allocated.
+inline std::string_view LeftTrimView(std::string_view str)
+{
+    return str.substr(details::CountLeadingSpaces(str.data(), str.length()));
+}
+
+inline std::string_view RightTrimView(std::string_view str)
+{
+    return str.substr(0, str.length() - details::CountTrailingSpaces(str.data(), str.length()));
+}
+
+inline std::string_view TrimView(std::string_view str)
+{
+    return RightTrimView(LeftTrimView(str));
 }
 
 inline std::string CopyLeftTrim(const char* str)
@@ -70,23 +101,17 @@ inline std::string CopyLeftTrim(const char* str)
     if (str == nullptr)
         return std::string();
 
-    std::string r(str);
-    LeftTrim(r);
-    return r;
+    return std::string(LeftTrimView(str));
 }
 
 inline std::string CopyLeftTrim(std::string_view str)
 {
-    std::string r(str);
-    LeftTrim(r);
-    return r;
+    return std::string(LeftTrimView(str));
 }
 
 inline std::string CopyLeftTrim(std::string const& str)
 {
-    std::string r(str);
-    LeftTrim(r);
-    return r;
+    return std::string(LeftTrimView(str));
 }
 
 inline std::string CopyRightTrim(const char* str)
@@ -94,23 +119,17 @@ inline std::string CopyRightTrim(const char* str)
     if (str == nullptr)
         return std::string();
 
-    std::string r(str);
-    RightTrim(r);
-    return r;
+    return std::string(RightTrimView(str));
 }
 
 inline std::string CopyRightTrim(std::string_view str)
 {
-    std::string r(str);
-    RightTrim(r);
-    return r;
+    return std::string(RightTrimView(str));
 }
 
 inline std::string CopyRightTrim(std::string const& str)
 {
-    std::string r(str);
-    RightTrim(r);
-    return r;
+    return std::string(RightTrimView(str));
 }
 
 inline std::string CopyTrim(const char* str)
@@ -118,25 +137,20 @@ inline std::string CopyTrim(const char* str)
     if (str == nullptr)
         return std::string();
 
-    std::string r(str);
-    Trim(r);
-    return r;
+    return std::string(TrimView(str));
 }
 
 inline std::string CopyTrim(std::string_view str)
 {
-    std::string r(str);
-    Trim(r);
-    return r;
+    return std::string(TrimView(str));
 }
 
 inline std::string CopyTrim(std::string const& str)
 {
-    std::string r(str);
-    Trim(r);
-    return r;
+    return std::string(TrimView(str));
 }
 
+// ASCII case conversion, locale independent: bytes outside [A-Za-z] are left untouched.
 inline void ToLower(std::string& str)
 {
     details::ToLower(&str[0], str.length());
@@ -150,6 +164,11 @@ inline void ToLower(char* str)
     details::ToLower(str, strlen(str));
 }
 
+inline void ToLower(char* str, size_t len)
+{
+    details::ToLower(str, len);
+}
+
 inline std::string CopyLower(std::string const& str)
 {
     std::string r(str);
@@ -184,6 +203,11 @@ inline void ToUpper(char* str)
     details::ToUpper(str, strlen(str));
 }
 
+inline void ToUpper(char* str, size_t len)
+{
+    details::ToUpper(str, len);
+}
+
 inline std::string CopyUpper(std::string const& str)
 {
     std::string r(str);
@@ -205,29 +229,105 @@ inline std::string CopyUpper(std::string_view str)
     return r;
 }
 
-template<typename IteratorType>
-inline std::string Join(IteratorType begin, IteratorType end, const std::string& sep)
-{
-    std::string res;
+namespace details {
+    // The elements of a join are viewed, never converted to std::string.
+    template<typename T, typename std::enable_if<std::is_convertible<T const&, std::string_view>::value, int>::type = 0>
+    inline std::string_view JoinPiece(T const& value)
+    {
+        return std::string_view(value);
+    }
+
+    inline std::string_view JoinPiece(char const& c)
+    {
+        return std::string_view(&c, 1);
+    }
+
+    inline char* JoinCopy(char* dst, std::string_view piece)
+    {
+        // An empty view may have a null data().
+        if (!piece.empty())
+            std::memcpy(dst, piece.data(), piece.length());
 
-    if (begin != end)
-        res = *begin++;
+        return dst + piece.length();
+    }
 
-    while (begin != end)
+    template<typename IteratorType>
+    inline void AppendJoin(std::string& out, IteratorType begin, IteratorType end, std::string_view sep, std::input_iterator_tag)
     {
-        res += sep;
-        res += *begin++;
+        if (begin == end)
+            return;
+
+        out += JoinPiece(*begin);
+        while (++begin != end)
+        {
+            out += sep;
+            out += JoinPiece(*begin);
+        }
     }
 
+    // Forward ranges can be walked twice: size everything first, grow out once and copy the pieces in place.
+    template<typename IteratorType>
+    inline void AppendJoin(std::string& out, IteratorType begin, IteratorType end, std::string_view sep, std::forward_iterator_tag)
+    {
+        if (begin == end)
+            return;
+
+        size_t size = 0;
+        for (IteratorType it = begin; it != end; ++it)
+            size += JoinPiece(*it).length() + sep.length();
+
+        size -= sep.length();
+        const size_t offset = out.length();
+        // Before C++20, a smaller reserve may shrink the caller buffer.
+        if (offset + size > out.capacity())
+            out.reserve(offset + size);
+
+        out.resize(offset + size);
+        char* dst = &out[offset];
+        // Pieces are only viewed within one expression, *begin may be a temporary.
+        dst = JoinCopy(dst, JoinPiece(*begin));
+        while (++begin != end)
+            dst = JoinCopy(JoinCopy(dst, sep), JoinPiece(*begin));
+    }
+}
+
+// Append the elements, separated by sep, to out. Elements can be anything convertible to std::string_view or chars.
+template<typename IteratorType>
+inline void AppendJoin(std::string& out, IteratorType begin, IteratorType end, std::string_view sep)
+{
+    details::AppendJoin(out, begin, end, sep, typename std::iterator_traits<IteratorType>::iterator_category());
+}
+
+template<typename T>
+inline void AppendJoin(std::string& out, T const& container, std::string_view sep)
+{
+    AppendJoin(out, std::begin(container), std::end(container), sep);
+}
+
+inline void AppendJoin(std::string& out, std::initializer_list<std::string_view> list, std::string_view sep)
+{
+    AppendJoin(out, list.begin(), list.end(), sep);
+}
+
+template<typename IteratorType>
+inline std::string Join(IteratorType begin, IteratorType end, std::string_view sep)
+{
+    std::string res;
+    AppendJoin(res, begin, end, sep);
     return res;
 }
 
 template<typename T>
-inline std::string Join(T const& container, const std::string& sep)
+inline std::string Join(T const& container, std::string_view sep)
 {
     return Join(std::begin(container), std::end(container), sep);
 }
 
+inline std::string Join(std::initializer_list<std::string_view> list, std::string_view sep)
+{
+    return Join(list.begin(), list.end(), sep);
+}
+
 // Clone a string allocated with the "new" operator, if str is nullptr, an empty string ("") will be returned, NOT nullptr !
 inline char* CloneString(const char* str)
 {
@@ -287,39 +387,368 @@ inline size_t CopyString(std::string const& src, char(&dst)[N])
     return details::CopyString(std::string_view(src), dst, N);
 }
 
-inline std::vector<std::string> SplitString(std::string const& str, char delimiter)
+struct SplitOptions
 {
-    std::vector<std::string> result;
-    size_t pos = 0;
-    size_t oldPos = 0;
+    // Once that many tokens were produced, the rest of the string is the last token.
+    size_t MaxSplit = size_t(-1);
+    // Drop the empty tokens found between consecutive delimiters and at both ends.
+    bool SkipEmpty = false;
+};
 
-    while ((pos = str.find(delimiter, oldPos)) != std::string::npos)
+// Lazy split of a string_view, tokens are string_views of the source and are found while iterating: nothing is
+// allocated. The source must outlive the range. Without SkipEmpty, n delimiters give n + 1 tokens.
+class SplitRange
+{
+public:
+    enum class DelimiterKind : uint8_t
+    {
+        Char,
+        // The whole delimiter string separates tokens.
+        Sequence,
+        // Any byte of the delimiter string separates tokens.
+        AnyOf,
+    };
+
+    class Iterator
+    {
+        SplitRange const* _Range;
+        // Start of the next token, past the end of the source once the last token was produced.
+        size_t _Next;
+        size_t _Count;
+        std::string_view _Token;
+
+        friend class SplitRange;
+
+        Iterator(SplitRange const* range, size_t next):
+            _Range(range),
+            _Next(next),
+            _Count(0)
+        {
+            if (_Range != nullptr)
+                _Advance();
+        }
+
+        void _Advance()
+        {
+            const std::string_view str = _Range->_Str;
+            while (_Next <= str.length())
+            {
+                if (_Count == _Range->_Options.MaxSplit)
+                {
+                    if (_Range->_Options.SkipEmpty)
+                        _Next = _Range->_SkipDelimiters(_Next);
+
+                    _Token = str.substr(std::min(_Next, str.length()));
+                    _Next = str.length() + 1;
+                }
+                else
+                {
+                    const size_t position = _Range->_Find(_Next);
+                    if (position == str.length())
+                    {
+                        _Token = str.substr(_Next);
+                        _Next = str.length() + 1;
+                    }
+                    else
+                    {
+                        _Token = str.substr(_Next, position - _Next);
+                        _Next = position + _Range->_DelimiterLength();
+                    }
+                }
+
+                if (!_Token.empty() || !_Range->_Options.SkipEmpty)
+                {
+                    ++_Count;
+                    return;
+                }
+            }
+
+            _Range = nullptr;
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::string_view const*;
+        using reference = std::string_view const&;
+
+        Iterator():
+            _Range(nullptr),
+            _Next(0),
+            _Count(0)
+        {}
+
+        reference operator*() const
+        {
+            return _Token;
+        }
+
+        pointer operator->() const
+        {
+            return &_Token;
+        }
+
+        Iterator& operator++()
+        {
+            _Advance();
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator previous(*this);
+            _Advance();
+            return previous;
+        }
+
+        // Every finished iterator compares equal to end().
+        bool operator==(Iterator const& other) const
+        {
+            return _Range == other._Range && (_Range == nullptr || _Next == other._Next);
+        }
+
+        bool operator!=(Iterator const& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    SplitRange(std::string_view str, char delimiter, SplitOptions const& options = SplitOptions()):
+        _Str(str),
+        _Delimiter(),
+        _Char(delimiter),
+        _Kind(DelimiterKind::Char),
+        _Options(options)
+    {}
+
+    SplitRange(std::string_view str, std::string_view delimiter, DelimiterKind kind, SplitOptions const& options = SplitOptions()):
+        _Str(str),
+        _Delimiter(delimiter),
+        _Char(delimiter.empty() ? '\0' : delimiter[0]),
+        _Kind(delimiter.length() == 1 ? DelimiterKind::Char : kind),
+        _Options(options)
+    {}
+
+    Iterator begin() const
     {
-        result.emplace_back(std::string(str.begin() + oldPos, str.begin() + pos));
-        oldPos = ++pos;
+        return Iterator(this, 0);
     }
 
-    result.emplace_back(std::string(str.begin() + oldPos, str.end()));
+    Iterator end() const
+    {
+        return Iterator();
+    }
+
+    // Collect the tokens, for callers that need them all.
+    template<typename StringType = std::string_view>
+    std::vector<StringType> ToVector() const
+    {
+        std::vector<StringType> result;
+        for (auto token : *this)
+            result.emplace_back(token);
+
+        return result;
+    }
+
+private:
+    std::string_view _Str;
+    std::string_view _Delimiter;
+    char _Char;
+    DelimiterKind _Kind;
+    SplitOptions _Options;
+
+    size_t _DelimiterLength() const
+    {
+        return _Kind == DelimiterKind::Sequence ? _Delimiter.length() : 1;
+    }
+
+    // Position of the next delimiter at or after from, the source length when there is none.
+    size_t _Find(size_t from) const
+    {
+        const char* begin = _Str.data() + from;
+        const size_t length = _Str.length() - from;
+        switch (_Kind)
+        {
+            case DelimiterKind::Char:
+            {
+                const void* found = length == 0 ? nullptr : std::memchr(begin, _Char, length);
+                return found == nullptr ? _Str.length() : static_cast<const char*>(found) - _Str.data();
+            }
+
+            case DelimiterKind::Sequence:
+            {
+                // An empty sequence never matches.
+                const size_t found = _Delimiter.empty() ? std::string_view::npos : details::Find(begin, length, _Delimiter.data(), _Delimiter.length());
+                return found == std::string_view::npos ? _Str.length() : from + found;
+            }
+
+            case DelimiterKind::AnyOf:
+                return from + details::FindAnyOf(begin, length, _Delimiter.data(), _Delimiter.length());
+        }
+
+        return _Str.length();
+    }
+
+    size_t _SkipDelimiters(size_t position) const
+    {
+        while (position < _Str.length())
+        {
+            if (_Kind == DelimiterKind::Sequence)
+            {
+                if (_Delimiter.empty() || _Str.compare(position, _Delimiter.length(), _Delimiter) != 0)
+                    break;
+            }
+            else if (_Kind == DelimiterKind::Char ? _Str[position] != _Char : _Delimiter.find(_Str[position]) == std::string_view::npos)
+            {
+                break;
+            }
+
+            position += _DelimiterLength();
+        }
+
+        return position;
+    }
+};
+
+inline SplitRange Split(std::string_view str, char delimiter, SplitOptions const& options = SplitOptions())
+{
+    return SplitRange(str, delimiter, options);
+}
+
+// Split on every occurrence of the whole delimiter string.
+inline SplitRange Split(std::string_view str, std::string_view delimiter, SplitOptions const& options = SplitOptions())
+{
+    return SplitRange(str, delimiter, SplitRange::DelimiterKind::Sequence, options);
+}
+
+// Split on every byte found in delimiters.
+inline SplitRange SplitAnyOf(std::string_view str, std::string_view delimiters, SplitOptions const& options = SplitOptions())
+{
+    return SplitRange(str, delimiters, SplitRange::DelimiterKind::AnyOf, options);
+}
 
-    return result;
+inline std::vector<std::string> SplitString(std::string const& str, char delimiter)
+{
+    return Split(str, delimiter).ToVector<std::string>();
 }
 
 inline std::vector<std::string_view> SplitString(std::string_view str, char delimiter)
 {
-    std::vector<std::string_view> result;
-    size_t pos = 0;
-    size_t oldPos = 0;
+    return Split(str, delimiter).ToVector();
+}
 
-    while ((pos = str.find(delimiter, oldPos)) != std::string_view::npos)
+// Position of the first pattern found in str at or after from, std::string_view::npos when there is none.
+inline size_t Find(std::string_view str, std::string_view pattern, size_t from = 0)
+{
+    if (from > str.length())
+        return std::string_view::npos;
+
+    const size_t found = details::Find(str.data() + from, str.length() - from, pattern.data(), pattern.length());
+    return found == std::string_view::npos ? found : from + found;
+}
+
+// Searches a set of literal patterns at once: every match, overlapping ones included, is found in one pass over the
+// text. Build it once and reuse it, searches don't modify the searcher so it can be shared between threads.
+// Empty patterns never match.
+class MultiSearcher
+{
+public:
+    struct Match
     {
-        result.emplace_back(str.substr(oldPos, pos - oldPos));
-        oldPos = ++pos;
+        // Index of the pattern in the constructor list.
+        size_t Pattern;
+        size_t Position;
+        size_t Length;
+    };
+
+    MultiSearcher();
+
+    explicit MultiSearcher(std::vector<std::string> patterns);
+
+    MultiSearcher(std::initializer_list<std::string_view> patterns):
+        MultiSearcher(std::vector<std::string>(patterns.begin(), patterns.end()))
+    {}
+
+    size_t PatternCount() const
+    {
+        return _Patterns.size();
     }
 
-    result.emplace_back(str.substr(oldPos));
+    std::string const& Pattern(size_t index) const
+    {
+        return _Patterns[index];
+    }
 
-    return result;
-}
+    // Matches ordered by position, then by pattern index.
+    std::vector<Match> FindAll(std::string_view text) const;
+
+    // The first match of FindAll, Pattern is std::string_view::npos when there is none.
+    Match FindFirst(std::string_view text) const;
+
+    // Call fn(Match const&) for every match, in the FindAll order. When fn returns a bool, false stops the search.
+    template<typename Fn>
+    void ForEachMatch(std::string_view text, Fn&& fn) const
+    {
+        _Search(text, [](void* user, Match const& match)
+        {
+            Fn& fn = *static_cast<typename std::remove_reference<Fn>::type*>(user);
+            if constexpr (std::is_same<decltype(fn(match)), bool>::value)
+            {
+                return fn(match);
+            }
+            else
+            {
+                fn(match);
+                return true;
+            }
+        }, &fn);
+    }
+
+private:
+    enum class Engine : uint8_t
+    {
+        None,
+        // SIMD prefilter on the first bytes of the patterns, for small sets.
+        Teddy,
+        AhoCorasick,
+    };
+
+    using match_callback_t = bool(*)(void*, Match const&);
+
+    std::vector<std::string> _Patterns;
+    Engine _Engine;
+    size_t _MaxLength;
+
+    // Teddy: the patterns are split in 8 buckets of consecutive indexes, _Buckets[b] is the first pattern of bucket b.
+    // For each of the first _PrefixLength bytes, a table per nibble flags the buckets that can have that nibble there.
+    uint8_t _PrefixLength;
+    uint8_t _LowNibbleMasks[3][16];
+    uint8_t _HighNibbleMasks[3][16];
+    uint32_t _Buckets[9];
+
+    // Aho-Corasick: a DFA over byte classes, the patterns ending in state s are
+    // _OutputPatterns[_OutputOffsets[s]] to _OutputPatterns[_OutputOffsets[s + 1]].
+    uint8_t _ByteClasses[256];
+    uint32_t _ClassCount;
+    std::vector<uint32_t> _Transitions;
+    std::vector<uint32_t> _OutputOffsets;
+    std::vector<uint32_t> _OutputPatterns;
+    // The first bytes of the patterns, the text is skipped up to one of them while nothing is partially matched.
+    std::string _StartBytes;
+
+    void _BuildTeddy();
+
+    void _BuildAhoCorasick();
+
+    void _Search(std::string_view text, match_callback_t callback, void* user) const;
+
+    void _SearchTeddy(std::string_view text, match_callback_t callback, void* user) const;
+
+    void _SearchAhoCorasick(std::string_view text, match_callback_t callback, void* user) const;
+
+    bool _VerifyTeddy(std::string_view text, size_t position, uint32_t buckets, match_callback_t callback, void* user) const;
+};
 
 }
 }
\ No newline at end of file
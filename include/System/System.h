@@ -33,6 +33,25 @@ enum class TranslatedMode : uint8_t
 	Translated,
 };
 
+enum class CpuCoreType : uint8_t
+{
+	Unknown,
+	Performance,
+	Efficiency,
+};
+
+struct CpuLogicalProcessor_t
+{
+	uint32_t Id;
+	uint32_t CoreId;
+	uint32_t PackageId;
+	uint32_t NumaNode;
+	// Index of the hardware thread in its core, 0 for the first one
+	uint32_t SmtIndex;
+	// Only known on hybrid CPUs
+	CpuCoreType CoreType;
+};
+
 std::chrono::system_clock::time_point GetBootTime();
 std::chrono::microseconds GetUpTime();
 
@@ -56,6 +75,15 @@ std::string GetModulePath();
 std::vector<std::string> GetModules();
 // Set current thread name
 bool SetCurrentThreadName(std::string const& thread_name);
+// Get the logical processors the current process can run on
+std::vector<CpuLogicalProcessor_t> GetCpuTopology();
+// Get the logical processors the current thread can run on
+std::vector<uint32_t> GetCurrentThreadAffinity();
+// Restrict the current thread to the logical processors ids
+bool SetCurrentThreadAffinity(std::vector<uint32_t> const& cpus);
+// Get the number of processors the process can really use: its affinity, cgroup cpu quota and cpuset on Linux, its job
+// object cpu rate on Windows. Read again on every call.
+uint32_t GetEffectiveParallelism();
 // Get if the program is running in translated mode
 TranslatedMode GetTranslatedMode();
 
@@ -38,6 +38,15 @@ namespace CpuFeatures {
     };
 
     CpuId_t CpuId(int functionIndex);
+    CpuId_t CpuId(int functionIndex, int subFunctionIndex);
+
+    // Extended control register 0, the register states saved by the OS. Only valid when OSXSAVE is set.
+    unsigned long long GetXCR0();
+
+    static constexpr unsigned long long XCR0_SSE    = 1ull << 1;
+    static constexpr unsigned long long XCR0_AVX    = 1ull << 2;
+    // Opmask, upper ZMM0-15 and ZMM16-31 states.
+    static constexpr unsigned long long XCR0_AVX512 = 7ull << 5;
 
     struct CpuFeature_t
     {
@@ -56,6 +56,21 @@
     #define SYSTEM_COMPILER_HPUX
 #endif
 
+// Language level, MSVC keeps __cplusplus at 199711L unless /Zc:__cplusplus is used.
+#if defined(_MSVC_LANG) && _MSVC_LANG > __cplusplus
+    #define SYSTEM_CPLUSPLUS _MSVC_LANG
+#elif defined(__cplusplus)
+    #define SYSTEM_CPLUSPLUS __cplusplus
+#else
+    #define SYSTEM_CPLUSPLUS 0L
+#endif
+
+#if SYSTEM_CPLUSPLUS >= 202002L && defined(__cpp_impl_coroutine) && defined(__has_include)
+    #if __has_include(<coroutine>)
+        #define SYSTEM_HAS_COROUTINES
+    #endif
+#endif
+
 #ifdef __cplusplus
 #include <array>
 
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) Nemirtingas
+ * This file is part of System.
+ *
+ * System is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * System is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the System; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <System/Future.hpp>
+
+namespace System {
+
+// Tasks and the dependencies between them, run in a ThreadPool without blocking: every node counts its unfinished
+// dependencies and is posted by the node bringing that count to 0. The graph can be run again once a run is done.
+class TaskGraph
+{
+    struct Node
+    {
+        UniqueFunction<void()> Work;
+        std::vector<std::size_t> Successors;
+        std::size_t DependencyCount = 0;
+    };
+
+    struct RunState
+    {
+        TaskGraph& Graph;
+        ThreadPool& Pool;
+        std::unique_ptr<std::atomic<std::size_t>[]> Remaining;
+        std::atomic<std::size_t> Pending;
+        std::atomic<bool> Failed{ false };
+        std::exception_ptr Exception;
+        std::shared_ptr<details::FutureState<void>> Result;
+
+        RunState(TaskGraph& graph, ThreadPool& pool):
+            Graph(graph),
+            Pool(pool),
+            Remaining(new std::atomic<std::size_t>[graph._Nodes.size()]),
+            Pending(graph._Nodes.size()),
+            Result(std::make_shared<details::FutureState<void>>(&pool))
+        {
+            for (std::size_t i = 0; i < graph._Nodes.size(); ++i)
+                Remaining[i].store(graph._Nodes[i].DependencyCount, std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<Node> _Nodes;
+    // Set once the graph is known to have no cycle, cleared by every change.
+    bool _Checked = false;
+
+public:
+    // Add a node running fn(args...), returns its index.
+    template <class Func, class... Args>
+    std::size_t Add(Func&& fn, Args &&...args)
+    {
+        Node node;
+        if constexpr (sizeof...(Args) == 0)
+        {
+            node.Work = UniqueFunction<void()>(std::forward<Func>(fn));
+        }
+        else
+        {
+            node.Work = [fn = std::forward<Func>(fn), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+            {
+                std::apply(fn, args);
+            };
+        }
+
+        _Nodes.emplace_back(std::move(node));
+        _Checked = false;
+        return _Nodes.size() - 1;
+    }
+
+    // node starts once dependency is done.
+    void AddDependency(std::size_t node, std::size_t dependency)
+    {
+        if (node >= _Nodes.size() || dependency >= _Nodes.size())
+            throw std::out_of_range("TaskGraph node index out of range.");
+
+        _Nodes[dependency].Successors.emplace_back(node);
+        ++_Nodes[node].DependencyCount;
+        _Checked = false;
+    }
+
+    std::size_t Size() const
+    {
+        return _Nodes.size();
+    }
+
+    // Run every node in pool, the future is ready once they all finished. The first exception skips the nodes not
+    // started yet and goes to the future. The graph must outlive the run and not change during it.
+    // Throws std::logic_error when the dependencies have a cycle.
+    Future<void> Run(ThreadPool& pool)
+    {
+        _CheckAcyclic();
+
+        auto state = std::make_shared<RunState>(*this, pool);
+        Future<void> result(state->Result);
+        if (_Nodes.empty())
+        {
+            state->Result->SetValue();
+            return result;
+        }
+
+        for (std::size_t i = 0; i < _Nodes.size(); ++i)
+        {
+            if (_Nodes[i].DependencyCount == 0)
+                pool.Post([state, i]() { _RunNode(state, i); });
+        }
+
+        return result;
+    }
+
+private:
+    // Kahn's algorithm, only counts the nodes that would run.
+    void _CheckAcyclic()
+    {
+        if (_Checked)
+            return;
+
+        std::vector<std::size_t> remaining(_Nodes.size());
+        std::vector<std::size_t> ready;
+        for (std::size_t i = 0; i < _Nodes.size(); ++i)
+        {
+            remaining[i] = _Nodes[i].DependencyCount;
+            if (remaining[i] == 0)
+                ready.emplace_back(i);
+        }
+
+        std::size_t visited = 0;
+        while (!ready.empty())
+        {
+            const std::size_t node = ready.back();
+            ready.pop_back();
+            ++visited;
+            for (auto successor : _Nodes[node].Successors)
+            {
+                if (--remaining[successor] == 0)
+                    ready.emplace_back(successor);
+            }
+        }
+
+        if (visited != _Nodes.size())
+            throw std::logic_error("TaskGraph dependencies have a cycle.");
+
+        _Checked = true;
+    }
+
+    // Run the node, post the successors it made ready and keep the last one on this thread.
+    static void _RunNode(std::shared_ptr<RunState> const& state, std::size_t index)
+    {
+        while (true)
+        {
+            auto& node = state->Graph._Nodes[index];
+            if (!state->Failed.load(std::memory_order_acquire))
+            {
+                try
+                {
+                    node.Work();
+                }
+                catch (...)
+                {
+                    if (!state->Failed.exchange(true, std::memory_order_acq_rel))
+                        state->Exception = std::current_exception();
+                }
+            }
+
+            bool has_next = false;
+            std::size_t next = 0;
+            for (auto successor : node.Successors)
+            {
+                if (state->Remaining[successor].fetch_sub(1, std::memory_order_acq_rel) != 1)
+                    continue;
+
+                if (has_next)
+                    state->Pool.Post([state, next]() { _RunNode(state, next); });
+
+                has_next = true;
+                next = successor;
+            }
+
+            if (state->Pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                // The last node also sees the exception written by the first failing one.
+                if (state->Exception != nullptr)
+                    state->Result->SetException(state->Exception);
+                else
+                    state->Result->SetValue();
+                return;
+            }
+
+            if (!has_next)
+                return;
+
+            index = next;
+        }
+    }
+};
+
+}
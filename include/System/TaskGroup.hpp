@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) Nemirtingas
+ * This file is part of System.
+ *
+ * System is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * System is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the System; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <System/ThreadPool.hpp>
+
+namespace System {
+
+class CancellationToken
+{
+    std::shared_ptr<std::atomic<bool>> _Cancelled;
+
+    friend class CancellationSource;
+
+    explicit CancellationToken(std::shared_ptr<std::atomic<bool>> cancelled):
+        _Cancelled(std::move(cancelled))
+    {}
+
+public:
+    // A default token is never cancelled.
+    CancellationToken() = default;
+
+    bool IsCancellationRequested() const
+    {
+        return _Cancelled != nullptr && _Cancelled->load(std::memory_order_acquire);
+    }
+};
+
+class CancellationSource
+{
+    std::shared_ptr<std::atomic<bool>> _Cancelled;
+
+public:
+    CancellationSource():
+        _Cancelled(std::make_shared<std::atomic<bool>>(false))
+    {}
+
+    void Cancel()
+    {
+        _Cancelled->store(true, std::memory_order_release);
+    }
+
+    bool IsCancellationRequested() const
+    {
+        return _Cancelled->load(std::memory_order_acquire);
+    }
+
+    CancellationToken Token() const
+    {
+        return CancellationToken(_Cancelled);
+    }
+};
+
+// Every exception thrown by the tasks of a TaskGroup waited with TaskGroupExceptionPolicy::Aggregate.
+class AggregateException : public std::exception
+{
+    std::vector<std::exception_ptr> _Exceptions;
+    std::string _Message;
+
+public:
+    explicit AggregateException(std::vector<std::exception_ptr> exceptions):
+        _Exceptions(std::move(exceptions)),
+        _Message(std::to_string(_Exceptions.size()) + " task(s) failed")
+    {}
+
+    std::vector<std::exception_ptr> const& Exceptions() const
+    {
+        return _Exceptions;
+    }
+
+    const char* what() const noexcept override
+    {
+        return _Message.c_str();
+    }
+};
+
+enum class TaskGroupExceptionPolicy : uint8_t
+{
+    // Wait rethrows the first exception.
+    First,
+    // Wait throws an AggregateException holding every exception.
+    Aggregate,
+};
+
+// Tasks spawned in a pool and waited together. Wait runs queued tasks of the pool while the group is not done, so
+// waiting from a worker neither blocks it nor deadlocks the pool.
+// The first exception requests the group cancellation: tasks not started yet are skipped, running tasks can poll the
+// group token.
+class TaskGroup
+{
+    struct State
+    {
+        std::atomic<std::size_t> Pending{ 0 };
+        std::mutex Mutex;
+        std::vector<std::exception_ptr> Exceptions;
+        // Replaced by Wait for the next round, only read or replaced with Mutex held. Tasks check the token of the
+        // round they were run in.
+        CancellationSource Cancellation;
+    };
+
+    ThreadPool& _Pool;
+    TaskGroupExceptionPolicy _Policy;
+    std::shared_ptr<State> _State;
+
+public:
+    explicit TaskGroup(ThreadPool& pool, TaskGroupExceptionPolicy policy = TaskGroupExceptionPolicy::First):
+        _Pool(pool),
+        _Policy(policy),
+        _State(std::make_shared<State>())
+    {}
+
+    TaskGroup(TaskGroup const&) = delete;
+    TaskGroup& operator=(TaskGroup const&) = delete;
+
+    // Tasks reference the caller's data, they must be done before the group goes away. Exceptions are dropped.
+    ~TaskGroup()
+    {
+        _WaitDone();
+    }
+
+    template <class Func, class... Args, class = std::enable_if_t<!std::is_same<std::decay_t<Func>, TaskOptions>::value>>
+    void Run(Func&& fn, Args &&...args)
+    {
+        Run(TaskOptions{}, std::forward<Func>(fn), std::forward<Args>(args)...);
+    }
+
+    template <class Func, class... Args>
+    void Run(TaskOptions const& options, Func&& fn, Args &&...args)
+    {
+        ++_State->Pending;
+        _Pool.Post(options, [pool = &_Pool, state = _State, token = Token(), fn = std::forward<Func>(fn), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+        {
+            if (!token.IsCancellationRequested())
+            {
+                try
+                {
+                    std::apply(fn, args);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(state->Mutex);
+                    state->Exceptions.emplace_back(std::current_exception());
+                    state->Cancellation.Cancel();
+                }
+            }
+
+            if (--state->Pending == 0)
+                pool->NotifyHelpers();
+        });
+    }
+
+    // Wait for every task of the group, then rethrow their exceptions following the group policy.
+    // The group can be reused afterward.
+    void Wait()
+    {
+        _WaitDone();
+
+        std::vector<std::exception_ptr> exceptions;
+        {
+            std::lock_guard<std::mutex> lock(_State->Mutex);
+            exceptions.swap(_State->Exceptions);
+            // Start over with a fresh token, tasks of the next round must not see this round's cancellation.
+            _State->Cancellation = CancellationSource();
+        }
+
+        if (exceptions.empty())
+            return;
+
+        if (_Policy == TaskGroupExceptionPolicy::First)
+            std::rethrow_exception(exceptions.front());
+
+        throw AggregateException(std::move(exceptions));
+    }
+
+    // Safe to call from any thread, also while the owner returns from Wait.
+    void Cancel()
+    {
+        std::lock_guard<std::mutex> lock(_State->Mutex);
+        _State->Cancellation.Cancel();
+    }
+
+    bool IsCancelled() const
+    {
+        return Token().IsCancellationRequested();
+    }
+
+    // Token of the current round, for long tasks to stop early.
+    CancellationToken Token() const
+    {
+        std::lock_guard<std::mutex> lock(_State->Mutex);
+        return _State->Cancellation.Token();
+    }
+
+private:
+    void _WaitDone()
+    {
+        _Pool.HelpUntil([this]() { return _State->Pending == 0; });
+    }
+};
+
+}
@@ -27,142 +27,1969 @@
 #include <mutex>
 #include <thread>
 #include <type_traits>
-#include <queue>
+#include <tuple>
+#include <vector>
 #include <chrono>
 #include <list>
 #include <string>
+#include <cstdint>
+#include <algorithm>
+#include <exception>
+#include <iterator>
 
 #include <System/System.h>
+#include <System/SystemDetector.h>
+#include <System/SystemCompiler.h>
+#include <System/UniqueFunction.hpp>
+#include <System/MPMCQueue.hpp>
+#include <System/TimerWheel.hpp>
+
+#if defined(SYSTEM_HAS_COROUTINES)
+    #include <coroutine>
+#endif
+
+#if defined(SYSTEM_ARCH_X86) || defined(SYSTEM_ARCH_X64)
+    #include <immintrin.h>
+#elif (defined(SYSTEM_ARCH_ARM) || defined(SYSTEM_ARCH_ARM64)) && defined(SYSTEM_COMPILER_MSVC)
+    #include <intrin.h>
+#endif
 
 namespace System {
+
+enum class ThreadPoolMode : uint8_t
+{
+    // Every worker pops from the single mutex protected queue.
+    SharedQueue,
+    // Every worker owns a deque: LIFO pop for the owner, FIFO steal for the others.
+    // The shared queue is only used to inject tasks pushed from outside the pool.
+    WorkStealing,
+};
+
+// How an idle worker waits for work: poll with a cpu pause, then poll with a yield, then park on a condition variable.
+// Producers only wake a parked worker when nobody is polling. Set both counts to 0 to park right away.
+struct ThreadPoolIdleStrategy
+{
+    // Upper bound of the pause polls, each worker halves its own bound when polling found nothing and doubles it when it did.
+    uint32_t SpinCount = 1024;
+    uint32_t YieldCount = 8;
+};
+
+enum class TaskPriority : uint8_t
+{
+    Critical,
+    Normal,
+    Background,
+};
+
+struct TaskOptions
+{
+    TaskPriority Priority = TaskPriority::Normal;
+    // Tasks with a deadline run before the other tasks of their lane, earliest deadline first.
+    std::chrono::steady_clock::time_point Deadline = std::chrono::steady_clock::time_point::max();
+
+    bool IsDefault() const
+    {
+        return Priority == TaskPriority::Normal && Deadline == std::chrono::steady_clock::time_point::max();
+    }
+};
+
+// Where workers are pinned, processors are taken from ThreadPoolOptions::CpuSet or from every processor the process can
+// run on. Physical cores are used before their other hardware threads.
+enum class ThreadPoolPlacement : uint8_t
+{
+    // Workers are not pinned.
+    None,
+    // Fill a NUMA node before moving to the next one.
+    Compact,
+    // Round robin workers over the NUMA nodes.
+    Spread,
+};
+
+struct ThreadPoolWorkerPlacement
+{
+    std::size_t WorkerIndex;
+    // False when the pool doesn't pin its workers or when the system refused the affinity.
+    bool Pinned;
+    CpuLogicalProcessor_t Cpu;
+};
+
+struct ThreadPoolOptions
+{
+    // 0 uses System::GetEffectiveParallelism(), read at every Start.
+    std::size_t WorkerCount = 0;
+    std::string PoolName;
+    ThreadPoolMode Mode = ThreadPoolMode::SharedQueue;
+    ThreadPoolIdleStrategy Idle;
+    // A non empty lane passed over that many times in a row by higher priority lanes gets the next task, 0 disables it.
+    std::size_t StarvationLimit = 32;
+    ThreadPoolPlacement Placement = ThreadPoolPlacement::None;
+    // Logical processor ids the workers may be pinned to, empty for all of them.
+    std::vector<uint32_t> CpuSet;
+    // On hybrid CPUs, use the performance cores before the efficiency cores.
+    bool PreferPerformanceCores = true;
+    // When not 0, tasks with the default TaskOptions bound for the shared queue go through a lock-free queue of that
+    // capacity instead, the shared lanes take the overflow.
+    std::size_t InjectionQueueCapacity = 0;
+    // Measure the queued and running time of every task for ThreadPool::Metrics, costs two clock reads per task and
+    // an allocation when the task no longer fits the task inline storage.
+    bool CollectTimings = false;
+    // Elastic pool: Start runs WorkerCount workers, more are added up to MaxWorkers while queued tasks would wait longer
+    // than GrowLatency at the current throughput, and workers idle for IdleTimeout retire down to MinWorkers.
+    // MaxWorkers 0 (or not above WorkerCount) keeps the pool at WorkerCount and ignores MinWorkers, MinWorkers 0 means
+    // WorkerCount. ThreadPool::BlockingRegion also adds workers up to MaxWorkers.
+    std::size_t MinWorkers = 0;
+    std::size_t MaxWorkers = 0;
+    std::chrono::milliseconds GrowLatency{ 10 };
+    std::chrono::milliseconds IdleTimeout{ 10000 };
+};
+
+// Power of 2 buckets of nanoseconds, bucket i counts the durations in [2^i, 2^(i+1)).
+struct ThreadPoolHistogram
+{
+    static constexpr std::size_t BucketCount = 40;
+
+    uint64_t Buckets[BucketCount] = {};
+    uint64_t Count = 0;
+    std::chrono::nanoseconds Total{ 0 };
+
+    // Upper bound of the bucket holding the quantile, quantile in [0, 1].
+    std::chrono::nanoseconds Percentile(double quantile) const
+    {
+        if (Count == 0)
+            return std::chrono::nanoseconds(0);
+
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * Count + 0.5));
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < BucketCount; ++i)
+        {
+            seen += Buckets[i];
+            if (seen >= rank)
+                return std::chrono::nanoseconds(int64_t(2) << i);
+        }
+
+        return std::chrono::nanoseconds(int64_t(2) << (BucketCount - 1));
+    }
+
+    void Merge(ThreadPoolHistogram const& other)
+    {
+        for (std::size_t i = 0; i < BucketCount; ++i)
+            Buckets[i] += other.Buckets[i];
+
+        Count += other.Count;
+        Total += other.Total;
+    }
+};
+
+struct ThreadPoolWorkerMetrics
+{
+    // Tasks queued from the thread.
+    uint64_t TasksSubmitted = 0;
+    uint64_t TasksExecuted = 0;
+    // Tasks taken from another worker deque.
+    uint64_t Steals = 0;
+    uint64_t Parks = 0;
+    uint64_t Unparks = 0;
+    // Time spent waiting for the shared queue mutex.
+    std::chrono::nanoseconds MutexWait{ 0 };
+    // Only filled with ThreadPoolOptions::CollectTimings.
+    ThreadPoolHistogram QueuedTime;
+    ThreadPoolHistogram RunTime;
+
+    void Merge(ThreadPoolWorkerMetrics const& other)
+    {
+        TasksSubmitted += other.TasksSubmitted;
+        TasksExecuted += other.TasksExecuted;
+        Steals += other.Steals;
+        Parks += other.Parks;
+        Unparks += other.Unparks;
+        MutexWait += other.MutexWait;
+        QueuedTime.Merge(other.QueuedTime);
+        RunTime.Merge(other.RunTime);
+    }
+};
+
+struct ThreadPoolMetrics
+{
+    uint64_t TasksSubmitted = 0;
+    // Tasks removed by ThreadPool::Clear, once idle TasksSubmitted is TasksExecuted + TasksCleared.
+    uint64_t TasksCleared = 0;
+    std::size_t QueueDepth = 0;
+    std::size_t QueueDepthHighWater = 0;
+    // Sum of the workers and of the threads running tasks with RunPendingTask from outside the pool.
+    ThreadPoolWorkerMetrics Total;
+    std::vector<ThreadPoolWorkerMetrics> Workers;
+};
+
+namespace details {
+    using task_t = UniqueFunction<void()>;
+
+    // Lower bound of the adaptive spin count.
+    static constexpr uint32_t MinimumSpinCount = 64;
+
+    inline void CpuRelax()
+    {
+#if defined(SYSTEM_ARCH_X86) || defined(SYSTEM_ARCH_X64)
+        _mm_pause();
+#elif (defined(SYSTEM_ARCH_ARM) || defined(SYSTEM_ARCH_ARM64)) && defined(SYSTEM_COMPILER_MSVC)
+        __yield();
+#elif defined(SYSTEM_ARCH_ARM) || defined(SYSTEM_ARCH_ARM64)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+    // Growable circular buffer, storage is kept when tasks are popped so a pool in steady state
+    // doesn't allocate to queue tasks.
+    template<typename T>
+    class RingQueue
+    {
+        std::unique_ptr<T[]> _Items;
+        std::size_t _Capacity = 0;
+        std::size_t _Head = 0;
+        std::size_t _Size = 0;
+
+        void _Grow()
+        {
+            const std::size_t capacity = _Capacity == 0 ? 64 : _Capacity * 2;
+            std::unique_ptr<T[]> items(new T[capacity]);
+            for (std::size_t i = 0; i < _Size; ++i)
+                items[i] = std::move(_Items[(_Head + i) & (_Capacity - 1)]);
+
+            _Items = std::move(items);
+            _Capacity = capacity;
+            _Head = 0;
+        }
+
+    public:
+        void PushBack(T&& item)
+        {
+            if (_Size == _Capacity)
+                _Grow();
+
+            _Items[(_Head + _Size++) & (_Capacity - 1)] = std::move(item);
+        }
+
+        void PopFront(T& item)
+        {
+            item = std::move(_Items[_Head]);
+            _Head = (_Head + 1) & (_Capacity - 1);
+            --_Size;
+        }
+
+        void PopBack(T& item)
+        {
+            item = std::move(_Items[(_Head + --_Size) & (_Capacity - 1)]);
+        }
+
+        void Clear()
+        {
+            for (std::size_t i = 0; i < _Size; ++i)
+                _Items[(_Head + i) & (_Capacity - 1)] = T();
+
+            _Head = 0;
+            _Size = 0;
+        }
+
+        std::size_t Size() const
+        {
+            return _Size;
+        }
+
+        bool Empty() const
+        {
+            return _Size == 0;
+        }
+    };
+
+    // Per worker deque, the owner pushes and pops at the back, thieves take from the front.
+    // The lock is only contended when a thief hits a busy victim.
+    class WorkStealingQueue
+    {
+        std::mutex _Mutex;
+        RingQueue<task_t> _Tasks;
+        std::atomic<std::size_t> _Size;
+
+    public:
+        WorkStealingQueue():
+            _Size(0)
+        {
+        }
+
+        void Push(task_t&& task)
+        {
+            std::lock_guard<std::mutex> lock(_Mutex);
+            _Tasks.PushBack(std::move(task));
+            _Size.store(_Tasks.Size(), std::memory_order_relaxed);
+        }
+
+        void PushRange(task_t* tasks, std::size_t count)
+        {
+            std::lock_guard<std::mutex> lock(_Mutex);
+            for (std::size_t i = 0; i < count; ++i)
+                _Tasks.PushBack(std::move(tasks[i]));
+            _Size.store(_Tasks.Size(), std::memory_order_relaxed);
+        }
+
+        bool Pop(task_t& task)
+        {
+            if (Empty())
+                return false;
+
+            std::lock_guard<std::mutex> lock(_Mutex);
+            if (_Tasks.Empty())
+                return false;
+
+            _Tasks.PopBack(task);
+            _Size.store(_Tasks.Size(), std::memory_order_relaxed);
+            return true;
+        }
+
+        bool Steal(task_t& task)
+        {
+            if (Empty())
+                return false;
+
+            std::unique_lock<std::mutex> lock(_Mutex, std::try_to_lock);
+            if (!lock.owns_lock() || _Tasks.Empty())
+                return false;
+
+            _Tasks.PopFront(task);
+            _Size.store(_Tasks.Size(), std::memory_order_relaxed);
+            return true;
+        }
+
+        std::size_t Clear()
+        {
+            std::lock_guard<std::mutex> lock(_Mutex);
+            std::size_t count = _Tasks.Size();
+            _Tasks.Clear();
+            _Size.store(0, std::memory_order_relaxed);
+            return count;
+        }
+
+        bool Empty() const
+        {
+            return _Size.load(std::memory_order_relaxed) == 0;
+        }
+    };
+
+    // Shared queue with one lane per TaskPriority. Each lane runs its deadline tasks first (earliest first) and then
+    // its other tasks in FIFO order.
+    class PriorityTaskQueue
+    {
+        struct DeadlineTask
+        {
+            std::chrono::steady_clock::time_point Deadline;
+            uint64_t Sequence;
+            task_t Task;
+        };
+
+        struct DeadlineCompare
+        {
+            bool operator()(DeadlineTask const& l, DeadlineTask const& r) const
+            {
+                // std heaps are max-heaps, so the latest deadline compares lower.
+                return l.Deadline != r.Deadline ? l.Deadline > r.Deadline : l.Sequence > r.Sequence;
+            }
+        };
+
+        struct Lane
+        {
+            RingQueue<task_t> Tasks;
+            std::vector<DeadlineTask> Deadlines;
+            std::size_t Skipped = 0;
+
+            std::size_t Size() const
+            {
+                return Tasks.Size() + Deadlines.size();
+            }
+        };
+
+        static constexpr std::size_t LaneCount = 3;
+
+        Lane _Lanes[LaneCount];
+        std::size_t _Size = 0;
+        uint64_t _Sequence = 0;
+        std::size_t _StarvationLimit = 0;
+
+    public:
+        void SetStarvationLimit(std::size_t limit)
+        {
+            _StarvationLimit = limit;
+        }
+
+        void Push(task_t&& task)
+        {
+            _Lanes[static_cast<std::size_t>(TaskPriority::Normal)].Tasks.PushBack(std::move(task));
+            ++_Size;
+        }
+
+        void Push(task_t&& task, TaskOptions const& options)
+        {
+            auto& lane = _Lanes[static_cast<std::size_t>(options.Priority)];
+            if (options.Deadline == std::chrono::steady_clock::time_point::max())
+            {
+                lane.Tasks.PushBack(std::move(task));
+            }
+            else
+            {
+                lane.Deadlines.emplace_back(DeadlineTask{ options.Deadline, _Sequence++, std::move(task) });
+                std::push_heap(lane.Deadlines.begin(), lane.Deadlines.end(), DeadlineCompare{});
+            }
+            ++_Size;
+        }
+
+        bool Pop(task_t& task)
+        {
+            std::size_t selected = LaneCount;
+
+            if (_StarvationLimit != 0)
+            {
+                for (std::size_t i = LaneCount; i-- > 1;)
+                {
+                    if (_Lanes[i].Skipped >= _StarvationLimit && _Lanes[i].Size() != 0)
+                    {
+                        selected = i;
+                        break;
+                    }
+                }
+            }
+
+            if (selected == LaneCount)
+            {
+                for (std::size_t i = 0; i < LaneCount; ++i)
+                {
+                    if (_Lanes[i].Size() != 0)
+                    {
+                        selected = i;
+                        break;
+                    }
+                }
+
+                if (selected == LaneCount)
+                    return false;
+            }
+
+            for (std::size_t i = selected + 1; i < LaneCount; ++i)
+            {
+                if (_Lanes[i].Size() != 0)
+                    ++_Lanes[i].Skipped;
+            }
+
+            auto& lane = _Lanes[selected];
+            lane.Skipped = 0;
+            if (!lane.Deadlines.empty())
+            {
+                std::pop_heap(lane.Deadlines.begin(), lane.Deadlines.end(), DeadlineCompare{});
+                task = std::move(lane.Deadlines.back().Task);
+                lane.Deadlines.pop_back();
+            }
+            else
+            {
+                lane.Tasks.PopFront(task);
+            }
+
+            --_Size;
+            return true;
+        }
+
+        std::size_t Clear()
+        {
+            const std::size_t count = _Size;
+            for (auto& lane : _Lanes)
+            {
+                lane.Tasks.Clear();
+                lane.Deadlines.clear();
+                lane.Skipped = 0;
+            }
+
+            _Size = 0;
+            return count;
+        }
+
+        std::size_t Size() const
+        {
+            return _Size;
+        }
+
+        std::size_t Size(TaskPriority priority) const
+        {
+            return _Lanes[static_cast<std::size_t>(priority)].Size();
+        }
+
+        bool Empty() const
+        {
+            return _Size == 0;
+        }
+    };
+
+    // Completion shared by every task of a batch, the last one to finish fulfills the promise.
+    struct BatchState
+    {
+        std::atomic<std::size_t> Remaining;
+        std::atomic<bool> Failed;
+        std::exception_ptr Exception;
+        std::promise<void> Promise;
+
+        explicit BatchState(std::size_t count):
+            Remaining(count),
+            Failed(false)
+        {
+        }
+
+        void Fail(std::exception_ptr exception)
+        {
+            // Only the first exception is kept.
+            if (!Failed.exchange(true))
+                Exception = std::move(exception);
+        }
+
+        void Done()
+        {
+            if (Remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+
+            if (Failed)
+                Promise.set_exception(Exception);
+            else
+                Promise.set_value();
+        }
+    };
+
+    template<typename Index, typename Func>
+    struct ParallelForState : BatchState
+    {
+        // Time a chunk should take when the grain size is picked automatically.
+        static constexpr std::chrono::microseconds TargetChunkDuration{ 100 };
+
+        std::atomic<Index> Next;
+        Index End;
+        std::size_t Grain;
+        Func Fn;
+
+        ParallelForState(std::size_t runners, Index begin, Index end, std::size_t grain, Func&& fn):
+            BatchState(runners),
+            Next(begin),
+            End(end),
+            Grain(grain),
+            Fn(std::move(fn))
+        {
+        }
+
+        bool Claim(std::size_t grain, Index& chunk_begin, Index& chunk_end)
+        {
+            Index current = Next.load(std::memory_order_relaxed);
+            do
+            {
+                if (current >= End)
+                    return false;
+
+                chunk_end = static_cast<std::size_t>(End - current) > grain ? static_cast<Index>(current + grain) : End;
+            } while (!Next.compare_exchange_weak(current, chunk_end, std::memory_order_relaxed));
+
+            chunk_begin = current;
+            return true;
+        }
+
+        void RunChunk(Index chunk_begin, Index chunk_end)
+        {
+            if constexpr (std::is_invocable<Func&, Index, Index>::value)
+            {
+                Fn(chunk_begin, chunk_end);
+            }
+            else
+            {
+                for (Index i = chunk_begin; i < chunk_end; ++i)
+                    Fn(i);
+            }
+        }
+
+        void Run(std::size_t runner_count)
+        {
+            std::size_t grain = Grain == 0 ? 1 : Grain;
+            Index chunk_begin, chunk_end;
+
+            try
+            {
+                while (!Failed.load(std::memory_order_relaxed) && Claim(grain, chunk_begin, chunk_end))
+                {
+                    if (Grain != 0)
+                    {
+                        RunChunk(chunk_begin, chunk_end);
+                        continue;
+                    }
+
+                    // Adaptive grain: size the next chunk from the measured cost per item.
+                    const auto start = std::chrono::steady_clock::now();
+                    RunChunk(chunk_begin, chunk_end);
+                    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+                    const std::size_t items = static_cast<std::size_t>(chunk_end - chunk_begin);
+                    const auto item_cost = std::max<std::chrono::nanoseconds::rep>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / static_cast<std::chrono::nanoseconds::rep>(items));
+                    std::size_t next_grain = static_cast<std::size_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(TargetChunkDuration).count() / item_cost);
+
+                    // Keep enough chunks around so the other runners still get some work.
+                    const Index next = Next.load(std::memory_order_relaxed);
+                    const std::size_t remaining = next < End ? static_cast<std::size_t>(End - next) : 0;
+                    const std::size_t fair_share = remaining / runner_count;
+                    grain = std::max<std::size_t>(1, std::min(std::min(next_grain, grain * 2), fair_share));
+                }
+            }
+            catch (...)
+            {
+                Fail(std::current_exception());
+            }
+
+            Done();
+        }
+    };
+}
+
+namespace details {
+    // Counters behind ThreadPoolMetrics. Worker counters have a single writer and are bumped with plain load/store,
+    // counters shared by outside threads use atomic adds. Readers only do relaxed loads.
+    struct alignas(64) MetricCounters
+    {
+        std::atomic<uint64_t> TasksSubmitted{ 0 };
+        std::atomic<uint64_t> TasksExecuted{ 0 };
+        std::atomic<uint64_t> Steals{ 0 };
+        std::atomic<uint64_t> Parks{ 0 };
+        std::atomic<uint64_t> Unparks{ 0 };
+        std::atomic<uint64_t> MutexWait{ 0 };
+        std::atomic<uint64_t> QueuedTime[ThreadPoolHistogram::BucketCount] = {};
+        std::atomic<uint64_t> QueuedTimeTotal{ 0 };
+        std::atomic<uint64_t> RunTime[ThreadPoolHistogram::BucketCount] = {};
+        std::atomic<uint64_t> RunTimeTotal{ 0 };
+
+        static void Add(std::atomic<uint64_t>& counter, uint64_t value, bool shared)
+        {
+            if (shared)
+                counter.fetch_add(value, std::memory_order_relaxed);
+            else
+                counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        static std::size_t Bucket(uint64_t nanoseconds)
+        {
+            std::size_t bucket = 0;
+            while (nanoseconds > 1 && bucket < ThreadPoolHistogram::BucketCount - 1)
+            {
+                nanoseconds >>= 1;
+                ++bucket;
+            }
+
+            return bucket;
+        }
+
+        static void Record(std::atomic<uint64_t>* buckets, std::atomic<uint64_t>& total, std::chrono::steady_clock::duration duration, bool shared)
+        {
+            const uint64_t nanoseconds = static_cast<uint64_t>(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+            Add(buckets[Bucket(nanoseconds)], 1, shared);
+            Add(total, nanoseconds, shared);
+        }
+
+        static void Load(std::atomic<uint64_t> const* buckets, std::atomic<uint64_t> const& total, ThreadPoolHistogram& histogram)
+        {
+            for (std::size_t i = 0; i < ThreadPoolHistogram::BucketCount; ++i)
+            {
+                histogram.Buckets[i] = buckets[i].load(std::memory_order_relaxed);
+                histogram.Count += histogram.Buckets[i];
+            }
+
+            histogram.Total = std::chrono::nanoseconds(total.load(std::memory_order_relaxed));
+        }
+
+        void Snapshot(ThreadPoolWorkerMetrics& metrics) const
+        {
+            metrics.TasksSubmitted = TasksSubmitted.load(std::memory_order_relaxed);
+            metrics.TasksExecuted = TasksExecuted.load(std::memory_order_relaxed);
+            metrics.Steals = Steals.load(std::memory_order_relaxed);
+            metrics.Parks = Parks.load(std::memory_order_relaxed);
+            metrics.Unparks = Unparks.load(std::memory_order_relaxed);
+            metrics.MutexWait = std::chrono::nanoseconds(MutexWait.load(std::memory_order_relaxed));
+            Load(QueuedTime, QueuedTimeTotal, metrics.QueuedTime);
+            Load(RunTime, RunTimeTotal, metrics.RunTime);
+        }
+    };
+
+    // Processor of each worker, workers wrap around when there are more workers than processors.
+    inline std::vector<CpuLogicalProcessor_t> ComputeWorkerPlacement(std::vector<CpuLogicalProcessor_t> topology, ThreadPoolOptions const& options, std::size_t worker_count)
+    {
+        std::vector<CpuLogicalProcessor_t> placement;
+        if (options.Placement == ThreadPoolPlacement::None || worker_count == 0)
+            return placement;
+
+        if (!options.CpuSet.empty())
+        {
+            topology.erase(std::remove_if(topology.begin(), topology.end(), [&options](CpuLogicalProcessor_t const& processor)
+            {
+                return std::find(options.CpuSet.begin(), options.CpuSet.end(), processor.Id) == options.CpuSet.end();
+            }), topology.end());
+        }
+
+        if (topology.empty())
+            return placement;
+
+        const auto core_rank = [&options](CpuLogicalProcessor_t const& processor)
+        {
+            return options.PreferPerformanceCores && processor.CoreType == CpuCoreType::Efficiency ? 1 : 0;
+        };
+
+        if (options.Placement == ThreadPoolPlacement::Compact)
+        {
+            std::sort(topology.begin(), topology.end(), [&core_rank](CpuLogicalProcessor_t const& l, CpuLogicalProcessor_t const& r)
+            {
+                return std::make_tuple(core_rank(l), l.NumaNode, l.SmtIndex, l.PackageId, l.CoreId, l.Id)
+                     < std::make_tuple(core_rank(r), r.NumaNode, r.SmtIndex, r.PackageId, r.CoreId, r.Id);
+            });
+        }
+        else
+        {
+            // Number the processors of each node, then interleave the nodes.
+            std::sort(topology.begin(), topology.end(), [&core_rank](CpuLogicalProcessor_t const& l, CpuLogicalProcessor_t const& r)
+            {
+                return std::make_tuple(core_rank(l), l.SmtIndex, l.NumaNode, l.PackageId, l.CoreId, l.Id)
+                     < std::make_tuple(core_rank(r), r.SmtIndex, r.NumaNode, r.PackageId, r.CoreId, r.Id);
+            });
+
+            std::vector<std::size_t> slots(topology.size(), 0);
+            for (std::size_t i = 1; i < topology.size(); ++i)
+            {
+                auto const& previous = topology[i - 1];
+                auto const& current = topology[i];
+                if (core_rank(previous) == core_rank(current) && previous.SmtIndex == current.SmtIndex && previous.NumaNode == current.NumaNode)
+                    slots[i] = slots[i - 1] + 1;
+            }
+
+            std::vector<std::size_t> order(topology.size());
+            for (std::size_t i = 0; i < order.size(); ++i)
+                order[i] = i;
+
+            std::stable_sort(order.begin(), order.end(), [&](std::size_t l, std::size_t r)
+            {
+                return std::make_tuple(core_rank(topology[l]), topology[l].SmtIndex, slots[l], topology[l].NumaNode)
+                     < std::make_tuple(core_rank(topology[r]), topology[r].SmtIndex, slots[r], topology[r].NumaNode);
+            });
+
+            std::vector<CpuLogicalProcessor_t> spread;
+            spread.reserve(order.size());
+            for (auto i : order)
+                spread.emplace_back(topology[i]);
+
+            topology = std::move(spread);
+        }
+
+        placement.reserve(worker_count);
+        for (std::size_t i = 0; i < worker_count; ++i)
+            placement.emplace_back(topology[i % topology.size()]);
+
+        return placement;
+    }
+}
+
 class ThreadPool
 {
-    using task_t = std::function<void()>;
+    using task_t = details::task_t;
+
+    struct alignas(64) Worker
+    {
+        details::WorkStealingQueue Queue;
+        std::thread Thread;
+        uint32_t RandomState;
+        uint32_t SpinLimit;
+        bool HasCpu;
+        std::atomic<bool> Pinned{ false };
+        CpuLogicalProcessor_t Cpu;
+        details::MetricCounters Counters;
+        // The slot runs a thread, cleared by the thread itself when it retires.
+        std::atomic<bool> Active{ false };
+        bool Retired;
+    };
+
+    struct WorkerContext
+    {
+        ThreadPool* Pool;
+        std::size_t Index;
+    };
+
+    std::atomic<bool> _StopWorkers;
+    std::atomic<std::size_t> _ActiveCount;
+    // Tasks queued anywhere in the pool, workers polling for work and workers parked on _WorkerNotifier.
+    std::atomic<std::size_t> _PendingCount;
+    std::atomic<std::size_t> _SpinningCount;
+    std::atomic<std::size_t> _SleepingCount;
+    std::atomic<std::size_t> _InjectedCount;
+    ThreadPoolMode _Mode;
+    ThreadPoolIdleStrategy _Idle;
+
+    std::condition_variable _WorkerNotifier;
+    std::mutex _Mutex;
+
+    std::vector<std::unique_ptr<Worker>> _Workers;
+    details::PriorityTaskQueue _Tasks;
+    // Critical tasks in _Tasks, work stealing workers look at the shared queue before their own deque when set.
+    std::atomic<std::size_t> _CriticalCount;
+    ThreadPoolOptions _Options;
+    // Only used while the workers run, Start replaces it once Join waited for the producers in _InjectionPushers.
+    std::unique_ptr<MPMCQueue<task_t>> _InjectionQueue;
+    std::atomic<std::size_t> _InjectionPushers;
+    // Tasks popped in a row from _InjectionQueue while the shared lanes had some, see _TryPopInjected.
+    std::atomic<std::size_t> _InjectionStreak;
+    // Timers are fired by the workers: a parked worker, the timer keeper, sleeps until the next timer event and busy
+    // workers check for due timers between two tasks. _TimerKeeper and _TimerEpoch are guarded by _Mutex.
+    std::shared_ptr<details::TimerQueue> _Timers;
+    bool _TimerKeeper;
+    uint64_t _TimerEpoch;
+    // Counters of the threads running tasks from outside the pool, see RunPendingTask.
+    details::MetricCounters _ExternalCounters;
+    // Counters of the workers removed by Join.
+    ThreadPoolWorkerMetrics _RetiredMetrics;
+    std::atomic<std::size_t> _QueueDepthHighWater;
+    std::atomic<uint64_t> _ClearedCount;
+    std::atomic<bool> _CollectTimings;
+    // _Workers holds MaxWorkers slots for the pool life, _WorkerCount of them run a thread. _BlockedCount counts the
+    // workers inside a BlockingRegion, they don't count toward _BaseWorkers and _MinWorkers.
+    std::atomic<std::size_t> _WorkerCount;
+    std::atomic<std::size_t> _BlockedCount;
+    std::size_t _BaseWorkers;
+    std::size_t _MinWorkers;
+    // Guards slot reuse and _Resizing, which turns off once Join starts.
+    std::mutex _ResizeMutex;
+    bool _Resizing;
+    // Elastic pools sample the queue every GrowLatency from _Monitor.
+    std::thread _Monitor;
+    std::mutex _MonitorMutex;
+    std::condition_variable _MonitorNotifier;
+    bool _StopMonitor;
+    // Threads blocked in HelpUntil, woken when a task is queued or by NotifyHelpers. _HelperEpoch changes with
+    // _HelperMutex held.
+    std::atomic<std::size_t> _HelperCount;
+    std::atomic<uint64_t> _HelperEpoch;
+    std::mutex _HelperMutex;
+    std::condition_variable _HelperNotifier;
+
+public:
+    // Tell the pool the calling task is about to block (I/O, lock, waiting on something outside the pool): while the
+    // region lives, the worker doesn't count as running capacity and a worker is added when the pool runs short, up to
+    // ThreadPoolOptions::MaxWorkers. Extra workers retire after IdleTimeout. Does nothing outside a worker of the pool.
+    class BlockingRegion
+    {
+        ThreadPool* _Pool;
+
+    public:
+        explicit BlockingRegion(ThreadPool& pool):
+            _Pool(_CurrentWorker().Pool == &pool ? &pool : nullptr)
+        {
+            if (_Pool != nullptr)
+                _Pool->_EnterBlockingRegion();
+        }
+
+        ~BlockingRegion()
+        {
+            if (_Pool != nullptr)
+                --_Pool->_BlockedCount;
+        }
+
+        BlockingRegion(BlockingRegion const&) = delete;
+        BlockingRegion& operator=(BlockingRegion const&) = delete;
+    };
+
+    explicit ThreadPool():
+        _StopWorkers(true),
+        _ActiveCount(0),
+        _PendingCount(0),
+        _SpinningCount(0),
+        _SleepingCount(0),
+        _InjectedCount(0),
+        _Mode(ThreadPoolMode::SharedQueue),
+        _CriticalCount(0),
+        _InjectionPushers(0),
+        _InjectionStreak(0),
+        _Timers(std::make_shared<details::TimerQueue>()),
+        _TimerKeeper(false),
+        _TimerEpoch(0),
+        _QueueDepthHighWater(0),
+        _ClearedCount(0),
+        _CollectTimings(false),
+        _WorkerCount(0),
+        _BlockedCount(0),
+        _BaseWorkers(0),
+        _MinWorkers(0),
+        _Resizing(false),
+        _StopMonitor(false),
+        _HelperCount(0),
+        _HelperEpoch(0)
+    {
+    }
+
+    ~ThreadPool()
+    {
+        Join();
+    }
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool(ThreadPool&&) = default;
+
+    ThreadPool&operator=(ThreadPool const &) = delete;
+    ThreadPool&operator=(ThreadPool&&) = default;
+
+    template <class Func, class... Args, class = std::enable_if_t<!std::is_same<std::decay_t<Func>, TaskOptions>::value>>
+    auto Push(Func&& fn, Args &&...args)
+    {
+        return Push(TaskOptions{}, std::forward<Func>(fn), std::forward<Args>(args)...);
+    }
+
+    // Push with a priority lane and an optional deadline.
+    template <class Func, class... Args>
+    auto Push(TaskOptions const& options, Func&& fn, Args &&...args)
+    {
+        using return_type = decltype(fn(args...));
+
+        // Only the packaged_task shared state (state and result) is allocated, the task itself is stored inline.
+        std::packaged_task<return_type()> task(
+            [fn = std::forward<Func>(fn), args = std::make_tuple(std::forward<Args>(args)...)]() mutable -> return_type
+            {
+                return std::apply(fn, args);
+            });
+
+        auto future{ task.get_future() };
+        _Enqueue([task = std::move(task)]() mutable { task(); }, options);
+        return future;
+    }
+
+    // Fire-and-forget version of Push, nothing is allocated when the callable fits in the task inline storage.
+    // An exception escaping the task terminates the program.
+    template <class Func, class... Args, class = std::enable_if_t<!std::is_same<std::decay_t<Func>, TaskOptions>::value>>
+    void Post(Func&& fn, Args &&...args)
+    {
+        Post(TaskOptions{}, std::forward<Func>(fn), std::forward<Args>(args)...);
+    }
+
+    template <class Func, class... Args>
+    void Post(TaskOptions const& options, Func&& fn, Args &&...args)
+    {
+        if constexpr (sizeof...(Args) == 0)
+        {
+            _Enqueue(task_t(std::forward<Func>(fn)), options);
+        }
+        else
+        {
+            _Enqueue([fn = std::forward<Func>(fn), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+            {
+                std::apply(fn, args);
+            }, options);
+        }
+    }
+
+    // Run fn once at time. Timers are kept across Join and Start, they fire while the pool has workers.
+    template <class Func, class... Args>
+    TimerHandle PushAt(std::chrono::steady_clock::time_point time, Func&& fn, Args &&...args)
+    {
+        return _AddTimer(time, std::chrono::steady_clock::duration::zero(), std::forward<Func>(fn), std::forward<Args>(args)...);
+    }
+
+    template <class Rep, class Period, class Func, class... Args>
+    TimerHandle PushAfter(std::chrono::duration<Rep, Period> delay, Func&& fn, Args &&...args)
+    {
+        return _AddTimer(std::chrono::steady_clock::now() + delay, std::chrono::steady_clock::duration::zero(), std::forward<Func>(fn), std::forward<Args>(args)...);
+    }
+
+    // Run fn every period, starting one period from now. Runs never overlap: a late run is not repeated, the next one
+    // is scheduled a period after the previous due time or right away when that time has passed.
+    template <class Rep, class Period, class Func, class... Args>
+    TimerHandle PushEvery(std::chrono::duration<Rep, Period> period, Func&& fn, Args &&...args)
+    {
+        const auto steady_period = std::max<std::chrono::steady_clock::duration>(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(period),
+            details::TimerWheel::Resolution);
+        return _AddTimer(std::chrono::steady_clock::now() + steady_period, steady_period, std::forward<Func>(fn), std::forward<Args>(args)...);
+    }
+
+    // Number of timers waiting in the wheel.
+    std::size_t TimerCount() const
+    {
+        return _Timers->Count.load(std::memory_order_relaxed);
+    }
+
+    // Push every callable of range under a single lock, the returned future is ready once all of them ran.
+    // If some tasks throw, the future holds the first exception.
+    template <class Range>
+    std::future<void> PushBatch(Range&& range)
+    {
+        std::vector<task_t> tasks;
+        auto state{ std::make_shared<details::BatchState>(std::distance(std::begin(range), std::end(range))) };
+        auto future{ state->Promise.get_future() };
+
+        if (state->Remaining == 0)
+        {
+            state->Promise.set_value();
+            return future;
+        }
+
+        tasks.reserve(state->Remaining);
+        for (auto&& fn : range)
+        {
+            using fn_type = std::decay_t<decltype(fn)>;
+            auto run = [state](fn_type& fn)
+            {
+                try
+                {
+                    fn();
+                }
+                catch (...)
+                {
+                    state->Fail(std::current_exception());
+                }
+                state->Done();
+            };
+
+            if constexpr (std::is_lvalue_reference<Range>::value)
+                tasks.emplace_back([run, fn]() mutable { run(fn); });
+            else
+                tasks.emplace_back([run, fn = std::move(fn)]() mutable { run(fn); });
+        }
+
+        _EnqueueBatch(tasks.data(), tasks.size());
+        return future;
+    }
+
+    // Call fn over [begin, end), either as fn(index) or as fn(chunk_begin, chunk_end).
+    // The range is split in chunks of grain indices claimed by at most WorkerCount() runner tasks.
+    // When grain is 0, each runner sizes its chunks from the measured duration of the previous one.
+    template <class Index, class Func>
+    std::future<void> ParallelFor(Index begin, Index end, std::size_t grain, Func&& fn)
+    {
+        static_assert(std::is_integral<Index>::value, "ParallelFor needs an integral index.");
+
+        using state_type = details::ParallelForState<Index, std::decay_t<Func>>;
+
+        const std::size_t count = begin < end ? static_cast<std::size_t>(end - begin) : 0;
+        const std::size_t chunk_count = grain == 0 ? count : (count + grain - 1) / grain;
+        const std::size_t runner_count = std::max<std::size_t>(1, std::min<std::size_t>(chunk_count, std::max<std::size_t>(1, WorkerCount())));
+
+        auto state{ std::make_shared<state_type>(runner_count, begin, end, grain, std::decay_t<Func>(std::forward<Func>(fn))) };
+        auto future{ state->Promise.get_future() };
+
+        if (count == 0)
+        {
+            state->Promise.set_value();
+            return future;
+        }
+
+        std::vector<task_t> tasks;
+        tasks.reserve(runner_count);
+        for (std::size_t i = 0; i < runner_count; ++i)
+            tasks.emplace_back([state, runner_count]() { state->Run(runner_count); });
+
+        _EnqueueBatch(tasks.data(), tasks.size());
+        return future;
+    }
+
+    // Remove all pending tasks from the queue
+    void Clear()
+    {
+        std::size_t cleared = 0;
+        {
+            std::lock_guard<std::mutex> lock(_Mutex);
+            cleared = _Tasks.Clear();
+            _InjectedCount = 0;
+            _CriticalCount = 0;
+        }
+
+        for (auto& worker : _Workers)
+            cleared += worker->Queue.Clear();
+
+        if (_InjectionQueue != nullptr)
+        {
+            for (task_t task; _InjectionQueue->TryPop(task); ++cleared)
+            {
+            }
+        }
+
+        _PendingCount -= cleared;
+        _ClearedCount += cleared;
+    }
+
+    // Stops all previous and creates new worker threads.
+    void Start(std::size_t worker_count = 0, std::string pool_name = std::string())
+    {
+        ThreadPoolOptions options;
+        options.WorkerCount = worker_count;
+        options.PoolName = std::move(pool_name);
+        Start(std::move(options));
+    }
+
+    void Start(ThreadPoolOptions options)
+    {
+        Join();
+
+        _Options = options;
+        if (options.WorkerCount == 0)
+            options.WorkerCount = System::GetEffectiveParallelism();
+
+        {
+            // Tasks pushed while the pool was stopped sit in the shared queue.
+            std::lock_guard<std::mutex> lock(_Mutex);
+            _Mode = options.Mode;
+            _Idle = options.Idle;
+            _Tasks.SetStarvationLimit(options.StarvationLimit);
+            // Tasks left in the previous injection queue move to the shared queue before it is replaced.
+            if (_InjectionQueue != nullptr)
+            {
+                for (task_t task; _InjectionQueue->TryPop(task);)
+                    _Tasks.Push(std::move(task));
+            }
+            if (options.InjectionQueueCapacity == 0)
+                _InjectionQueue.reset();
+            else if (_InjectionQueue == nullptr || _InjectionQueue->Capacity() < options.InjectionQueueCapacity)
+                _InjectionQueue = std::make_unique<MPMCQueue<task_t>>(options.InjectionQueueCapacity);
+            _InjectionStreak = 0;
+            _CollectTimings = options.CollectTimings;
+            _PendingCount = _Tasks.Size();
+            _InjectedCount = _Tasks.Size();
+            _CriticalCount = _Tasks.Size(TaskPriority::Critical);
+        }
+
+        // Every slot is allocated up front, workers read _Workers without locking.
+        const std::size_t slot_count = std::max(options.WorkerCount, options.MaxWorkers);
+        _BaseWorkers = options.WorkerCount;
+        // Without room to grow no worker would come back, so a pool that can't grow doesn't shrink either.
+        _MinWorkers = options.MinWorkers == 0 || slot_count == options.WorkerCount ? options.WorkerCount : std::min(options.MinWorkers, options.WorkerCount);
+
+        const auto placement = details::ComputeWorkerPlacement(
+            options.Placement == ThreadPoolPlacement::None ? std::vector<CpuLogicalProcessor_t>{} : System::GetCpuTopology(),
+            options,
+            slot_count);
+
+        _StopWorkers = false;
+        for (std::size_t i = 0; i < slot_count; ++i)
+        {
+            _Workers.emplace_back(std::make_unique<Worker>());
+            _Workers.back()->RandomState = static_cast<uint32_t>(i * 2654435761u + 1);
+            _Workers.back()->HasCpu = !placement.empty();
+            if (!placement.empty())
+                _Workers.back()->Cpu = placement[i];
+        }
+
+        // Workers pin themselves before running anything, Start returns once they all tried.
+        std::vector<std::future<bool>> pinned;
+        {
+            std::lock_guard<std::mutex> lock(_ResizeMutex);
+            for (std::size_t i = 0; i < options.WorkerCount; ++i)
+            {
+                std::promise<bool> pin_promise;
+                if (_Workers[i]->HasCpu)
+                    pinned.emplace_back(pin_promise.get_future());
+
+                _StartWorker(i, std::move(pin_promise));
+            }
+            _Resizing = true;
+        }
+
+        for (auto& pin : pinned)
+            pin.wait();
+
+        if (slot_count > options.WorkerCount)
+        {
+            _StopMonitor = false;
+            _Monitor = std::thread(&ThreadPool::_MonitorLoop, this, std::max(options.GrowLatency, std::chrono::milliseconds(1)));
+        }
+    }
+
+    // Wait all workers to finish
+    void Join()
+    {
+        {
+            // No worker is added past this point, the slots are stable while they are joined.
+            std::lock_guard<std::mutex> lock(_ResizeMutex);
+            _Resizing = false;
+        }
+
+        if (_Monitor.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(_MonitorMutex);
+                _StopMonitor = true;
+            }
+            _MonitorNotifier.notify_all();
+            _Monitor.join();
+        }
+
+        {
+            // Taking the lock orders the stop flag with workers about to park.
+            std::lock_guard<std::mutex> lock(_Mutex);
+            _StopWorkers = true;
+        }
+        _WorkerNotifier.notify_all();
+
+        // Producers that saw the pool running finish their push, later ones use the shared queue.
+        while (_InjectionPushers.load() != 0)
+            std::this_thread::yield();
+
+        for (auto &worker : _Workers)
+        {
+            if (worker->Thread.joinable())
+                worker->Thread.join();
+
+            ThreadPoolWorkerMetrics metrics;
+            worker->Counters.Snapshot(metrics);
+            _RetiredMetrics.Merge(metrics);
+        }
+
+        _Workers.clear();
+        _WorkerCount = 0;
+    }
+
+    // Workers running right now, between MinWorkers and MaxWorkers for an elastic pool.
+    std::size_t WorkerCount() const
+    {
+        return _WorkerCount.load(std::memory_order_relaxed);
+    }
+
+    // Get the number of active workers
+    std::size_t ActiveCount() const
+    {
+        return _ActiveCount;
+    }
+
+    // Read the effective parallelism again and restart the workers when it changed, for pools started with a WorkerCount
+    // of 0. Waits for the queued tasks like Join, must not be called from a worker. Returns the worker count.
+    std::size_t RefreshWorkerCount()
+    {
+        if (_Workers.empty() || _Options.WorkerCount != 0 || System::GetEffectiveParallelism() == _BaseWorkers)
+            return WorkerCount();
+
+        Start(_Options);
+        return WorkerCount();
+    }
 
-    std::atomic<bool> _StopWorkers;
-    std::atomic<std::size_t> _ActiveCount;
+    // Processor chosen for each worker slot by ThreadPoolOptions::Placement.
+    std::vector<ThreadPoolWorkerPlacement> WorkerPlacement() const
+    {
+        std::vector<ThreadPoolWorkerPlacement> placement;
+        placement.reserve(_Workers.size());
+        for (std::size_t i = 0; i < _Workers.size(); ++i)
+        {
+            auto const& worker = *_Workers[i];
+            placement.emplace_back(ThreadPoolWorkerPlacement{ i, worker.Pinned.load(std::memory_order_relaxed), worker.HasCpu ? worker.Cpu : CpuLogicalProcessor_t{} });
+        }
 
-    std::condition_variable _WorkerNotifier;
-    std::mutex _Mutex;
+        return placement;
+    }
 
-    std::vector<std::thread> _Workers;
-    std::queue<task_t> _Tasks;
+    ThreadPoolMode Mode() const
+    {
+        return _Mode;
+    }
 
-public:
-    explicit ThreadPool():
-        _ActiveCount(0)
+    // Snapshot of the pool counters, lock-free and safe to call while tasks run but not during Start or Join.
+    // Workers lists every worker slot, Total also counts the workers removed by Join.
+    ThreadPoolMetrics Metrics() const
     {
+        ThreadPoolMetrics metrics;
+        metrics.Workers.resize(_Workers.size());
+        for (std::size_t i = 0; i < _Workers.size(); ++i)
+        {
+            _Workers[i]->Counters.Snapshot(metrics.Workers[i]);
+            metrics.Total.Merge(metrics.Workers[i]);
+        }
+
+        ThreadPoolWorkerMetrics external;
+        _ExternalCounters.Snapshot(external);
+        metrics.Total.Merge(external);
+        metrics.Total.Merge(_RetiredMetrics);
+
+        metrics.QueueDepth = _PendingCount.load(std::memory_order_relaxed);
+        metrics.QueueDepthHighWater = _QueueDepthHighWater.load(std::memory_order_relaxed);
+        metrics.TasksSubmitted = metrics.Total.TasksSubmitted;
+        metrics.TasksCleared = _ClearedCount.load(std::memory_order_relaxed);
+        return metrics;
     }
 
-    ~ThreadPool()
+#if defined(SYSTEM_HAS_COROUTINES)
+    // co_await pool.Schedule() resumes the coroutine on a worker of the pool, see System/Coroutine.hpp.
+    class ScheduleAwaiter
     {
-        Join();
+        ThreadPool& _Pool;
+        TaskOptions _Options;
+
+    public:
+        ScheduleAwaiter(ThreadPool& pool, TaskOptions const& options):
+            _Pool(pool),
+            _Options(options)
+        {}
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        // The handle fits the task inline storage, resuming doesn't allocate.
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            _Pool.Post(_Options, [handle]() { handle.resume(); });
+        }
+
+        void await_resume() const noexcept
+        {}
+    };
+
+    ScheduleAwaiter Schedule(TaskOptions const& options = TaskOptions{})
+    {
+        return ScheduleAwaiter(*this, options);
     }
+#endif
 
-    ThreadPool(ThreadPool const &) = delete;
-    ThreadPool(ThreadPool&&) = default;
+    // Run one queued task on the calling thread, used to help instead of blocking while waiting on other tasks.
+    // Returns false when no task was found.
+    bool RunPendingTask()
+    {
+        task_t task;
+        auto& context = _CurrentWorker();
+        if (context.Pool == this)
+        {
+            if (!_TryFindTask(*_Workers[context.Index], context.Index, task))
+                return false;
+        }
+        else
+        {
+            if (_PendingCount.load(std::memory_order_relaxed) == 0)
+                return false;
 
-    ThreadPool&operator=(ThreadPool const &) = delete;
-    ThreadPool&operator=(ThreadPool&&) = default;
+            if (!_TryPopInjected(task) && !(_Mode == ThreadPoolMode::WorkStealing && _TrySteal(0, _Workers.size(), task)))
+                return false;
+
+            --_PendingCount;
+        }
+
+        auto counters = _CurrentCounters();
+        details::MetricCounters::Add(counters.first.TasksExecuted, 1, counters.second);
+        ++_ActiveCount;
+        task();
+        --_ActiveCount;
+        return true;
+    }
+
+    // Run queued tasks on the calling thread until done() returns true, sleeping while there is nothing to run.
+    // Queued tasks wake the sleeping helpers, whoever makes done() true must call NotifyHelpers afterward.
+    template <class Predicate>
+    void HelpUntil(Predicate&& done)
+    {
+        while (!done())
+        {
+            if (RunPendingTask())
+                continue;
+
+            // Registered before looking at the queue again: a task queued from here on changes the epoch.
+            ++_HelperCount;
+            const uint64_t epoch = _HelperEpoch.load();
+            if (_PendingCount.load() == 0)
+            {
+                std::unique_lock<std::mutex> lock(_HelperMutex);
+                _HelperNotifier.wait(lock, [this, &done, epoch]() { return done() || _HelperEpoch.load(std::memory_order_relaxed) != epoch; });
+            }
+            else
+            {
+                // Queued but not reachable yet, another thread is pushing or popping it.
+                std::this_thread::yield();
+            }
+            --_HelperCount;
+        }
+    }
+
+    // Wake the threads sleeping in HelpUntil so they check their condition again.
+    void NotifyHelpers()
+    {
+        if (_HelperCount.load() == 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(_HelperMutex);
+            _HelperEpoch.store(_HelperEpoch.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        _HelperNotifier.notify_all();
+    }
+
+private:
+    static WorkerContext& _CurrentWorker()
+    {
+        static thread_local WorkerContext context{ nullptr, 0 };
+        return context;
+    }
 
     template <class Func, class... Args>
-    auto Push(Func&& fn, Args &&...args)
+    TimerHandle _AddTimer(std::chrono::steady_clock::time_point time, std::chrono::steady_clock::duration period, Func&& fn, Args &&...args)
     {
-        using return_type = decltype(fn(args...));
+        auto timer = std::make_shared<details::TimerNode>();
+        if constexpr (sizeof...(Args) == 0)
+        {
+            timer->Callback = task_t(std::forward<Func>(fn));
+        }
+        else
+        {
+            timer->Callback = [fn = std::forward<Func>(fn), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+            {
+                std::apply(fn, args);
+            };
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_Timers->Mutex);
+            timer->Expiry = _Timers->Wheel.ToTick(time);
+            timer->Period = static_cast<uint64_t>((period + details::TimerWheel::Resolution - std::chrono::steady_clock::duration(1)) / details::TimerWheel::Resolution);
+        }
 
-        auto task{ std::make_shared<std::packaged_task<return_type()>>(
-            std::bind(std::forward<Func>(fn), std::forward<Args>(args)...)
-        ) };
+        TimerHandle handle(_Timers, timer);
+        _ScheduleTimer(std::move(timer));
+        return handle;
+    }
 
-        auto future{ task->get_future() };
+    void _ScheduleTimer(std::shared_ptr<details::TimerNode> timer)
+    {
+        bool due = false;
+        bool earlier = false;
         {
-            std::lock_guard<std::mutex> lock(_Mutex);
+            std::lock_guard<std::mutex> lock(_Timers->Mutex);
+            // Cancel flips the state before taking the mutex.
+            if (timer->State.load(std::memory_order_acquire) != details::TimerState::Scheduled)
+                return;
 
-            _Tasks.emplace([task]() { (*task)(); });
+            const auto previous_event = _Timers->NextEvent.load(std::memory_order_relaxed);
+            due = !_Timers->Wheel.Insert(timer);
+            if (!due)
+            {
+                _Timers->Update();
+                earlier = _Timers->NextEvent.load(std::memory_order_relaxed) < previous_event;
+            }
         }
 
-        _WorkerNotifier.notify_one();
-        return future;
+        if (due)
+            _FireTimer(std::move(timer));
+        else if (earlier)
+            _SignalTimerKeeper();
     }
 
-    // Remove all pending tasks from the queue
-    void Clear()
+    void _FireTimer(std::shared_ptr<details::TimerNode> timer)
+    {
+        _Enqueue([this, timer = std::move(timer)]() mutable
+        {
+            auto state = details::TimerState::Scheduled;
+            if (!timer->State.compare_exchange_strong(state, details::TimerState::Running, std::memory_order_acq_rel))
+                return;
+
+            timer->Callback();
+
+            state = details::TimerState::Running;
+            if (timer->Period == 0)
+            {
+                timer->State.compare_exchange_strong(state, details::TimerState::Done, std::memory_order_acq_rel);
+                return;
+            }
+
+            if (!timer->State.compare_exchange_strong(state, details::TimerState::Scheduled, std::memory_order_acq_rel))
+                return;
+
+            {
+                std::lock_guard<std::mutex> lock(_Timers->Mutex);
+                timer->Expiry = std::max(timer->Expiry + timer->Period, _Timers->Wheel.CurrentTick() + 1);
+            }
+            _ScheduleTimer(std::move(timer));
+        }, TaskOptions{});
+    }
+
+    // Wake the timer keeper so it waits for the new next event, or a parked worker to become the keeper.
+    void _SignalTimerKeeper()
     {
         std::lock_guard<std::mutex> lock(_Mutex);
-        _Tasks = {};
+        ++_TimerEpoch;
+        if (_TimerKeeper)
+            _WorkerNotifier.notify_all();
+        else if (_SleepingCount != 0)
+            _WorkerNotifier.notify_one();
     }
 
-    // Stops all previous and creates new worker threads.
-    void Start(std::size_t worker_count = std::thread::hardware_concurrency(), std::string pool_name = std::string())
+    void _PollTimers()
     {
-        Join();
+        if (_Timers->Count.load(std::memory_order_relaxed) == 0)
+            return;
 
-        _StopWorkers = false;
-        for (std::size_t i = 0; i < worker_count; ++i)
-            _Workers.emplace_back(std::bind(&ThreadPool::_WorkerLoop, this, pool_name.empty() ? pool_name : pool_name + ' ' + std::to_string(i)));
+        const auto next_event = _Timers->NextEvent.load(std::memory_order_acquire);
+        if (std::chrono::steady_clock::now().time_since_epoch().count() >= next_event)
+            _ProcessTimers();
     }
 
-    // Wait all workers to finish
-    void Join()
+    void _ProcessTimers()
     {
-        _StopWorkers = true;
-        _WorkerNotifier.notify_all();
+        std::vector<std::shared_ptr<details::TimerNode>> expired;
+        {
+            std::lock_guard<std::mutex> lock(_Timers->Mutex);
+            _Timers->Wheel.Advance(std::chrono::steady_clock::now(), expired);
+            _Timers->Update();
+        }
+
+        for (auto& timer : expired)
+            _FireTimer(std::move(timer));
+    }
+
+    // Counters of the calling thread, and whether other threads write them too.
+    std::pair<details::MetricCounters&, bool> _CurrentCounters()
+    {
+        auto& context = _CurrentWorker();
+        if (context.Pool == this)
+            return { _Workers[context.Index]->Counters, false };
+
+        return { _ExternalCounters, true };
+    }
 
-        for (auto &thread : _Workers)
+    // Lock the shared queue, the time spent waiting for it goes to the metrics.
+    std::unique_lock<std::mutex> _LockTasks()
+    {
+        std::unique_lock<std::mutex> lock(_Mutex, std::try_to_lock);
+        if (!lock.owns_lock())
         {
-            if (thread.joinable())
-                thread.join();
+            const auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            auto counters = _CurrentCounters();
+            details::MetricCounters::Add(
+                counters.first.MutexWait,
+                static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()),
+                counters.second);
         }
 
-        _Workers.clear();
+        return lock;
     }
 
-    std::size_t WorkerCount() const
+    void _UpdateQueueDepth(std::size_t depth)
     {
-        return _Workers.size();
+        std::size_t high_water = _QueueDepthHighWater.load(std::memory_order_relaxed);
+        while (depth > high_water && !_QueueDepthHighWater.compare_exchange_weak(high_water, depth, std::memory_order_relaxed))
+        {
+        }
     }
 
-    // Get the number of active workers
-    std::size_t ActiveCount() const
+    // Wrap the task to measure how long it waited and ran.
+    task_t _TimeTask(task_t&& task)
     {
-        return _ActiveCount;
+        return [this, enqueued = std::chrono::steady_clock::now(), task = std::move(task)]() mutable
+        {
+            const auto started = std::chrono::steady_clock::now();
+            task();
+            const auto finished = std::chrono::steady_clock::now();
+
+            auto counters = _CurrentCounters();
+            details::MetricCounters::Record(counters.first.QueuedTime, counters.first.QueuedTimeTotal, started - enqueued, counters.second);
+            details::MetricCounters::Record(counters.first.RunTime, counters.first.RunTimeTotal, finished - started, counters.second);
+        };
     }
 
-private:
-    void _WorkerLoop(std::string worker_name)
+    void _Enqueue(task_t&& task, TaskOptions const& options)
+    {
+        if (_CollectTimings.load(std::memory_order_relaxed))
+            task = _TimeTask(std::move(task));
+
+        auto counters = _CurrentCounters();
+        details::MetricCounters::Add(counters.first.TasksSubmitted, 1, counters.second);
+
+        auto& context = _CurrentWorker();
+        std::size_t depth;
+        // Prioritized tasks always go through the shared lanes.
+        if (_Mode == ThreadPoolMode::WorkStealing && context.Pool == this && options.IsDefault())
+        {
+            _Workers[context.Index]->Queue.Push(std::move(task));
+            depth = ++_PendingCount;
+        }
+        else if (!options.IsDefault() || !_TryPushInjected(task, depth))
+        {
+            auto lock = _LockTasks();
+
+            _Tasks.Push(std::move(task), options);
+            _InjectedCount.store(_Tasks.Size(), std::memory_order_relaxed);
+            _CriticalCount.store(_Tasks.Size(TaskPriority::Critical), std::memory_order_relaxed);
+            depth = ++_PendingCount;
+        }
+
+        _UpdateQueueDepth(depth);
+        _WakeWorkers(1);
+        NotifyHelpers();
+    }
+
+    // Push to the injection queue while the workers run, counted in _PendingCount before Join sees the push done.
+    bool _TryPushInjected(task_t& task, std::size_t& depth)
+    {
+        ++_InjectionPushers;
+        const bool pushed = !_StopWorkers.load() && _InjectionQueue != nullptr && _InjectionQueue->TryPush(std::move(task));
+        if (pushed)
+            depth = ++_PendingCount;
+        --_InjectionPushers;
+        return pushed;
+    }
+
+    void _EnqueueBatch(task_t* tasks, std::size_t count)
+    {
+        if (_CollectTimings.load(std::memory_order_relaxed))
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                tasks[i] = _TimeTask(std::move(tasks[i]));
+        }
+
+        auto counters = _CurrentCounters();
+        details::MetricCounters::Add(counters.first.TasksSubmitted, count, counters.second);
+
+        auto& context = _CurrentWorker();
+        std::size_t depth;
+        if (_Mode == ThreadPoolMode::WorkStealing && context.Pool == this)
+        {
+            _Workers[context.Index]->Queue.PushRange(tasks, count);
+            depth = _PendingCount += count;
+        }
+        else
+        {
+            auto lock = _LockTasks();
+
+            for (std::size_t i = 0; i < count; ++i)
+                _Tasks.Push(std::move(tasks[i]));
+            _InjectedCount.store(_Tasks.Size(), std::memory_order_relaxed);
+            depth = _PendingCount += count;
+        }
+
+        _UpdateQueueDepth(depth);
+        _WakeWorkers(count);
+        NotifyHelpers();
+    }
+
+    // Wake up to count parked workers, less the spinning workers that are going to pick some of the work up by
+    // themselves.
+    void _WakeWorkers(std::size_t count)
+    {
+        const std::size_t spinning = _SpinningCount.load();
+        if (count <= spinning || _SleepingCount == 0)
+            return;
+
+        count -= spinning;
+
+        {
+            // Pairs with the predicate check done under _Mutex by a parking worker.
+            std::lock_guard<std::mutex> lock(_Mutex);
+        }
+
+        if (count >= WorkerCount())
+        {
+            _WorkerNotifier.notify_all();
+        }
+        else
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                _WorkerNotifier.notify_one();
+        }
+    }
+
+    void _WorkerLoop(std::size_t worker_index, std::string worker_name, std::promise<bool> pin_promise)
     {
         if (!worker_name.empty())
             System::SetCurrentThreadName(worker_name);
 
+        auto& self = *_Workers[worker_index];
+        if (self.HasCpu)
+        {
+            self.Pinned = System::SetCurrentThreadAffinity({ self.Cpu.Id });
+            pin_promise.set_value(self.Pinned);
+        }
+
+        auto& context = _CurrentWorker();
+        context.Pool = this;
+        context.Index = worker_index;
+
         while (true)
         {
-            auto task{ _NextTask() };
+            auto task{ _NextTask(worker_index) };
 
             if (task)
             {
+                details::MetricCounters::Add(self.Counters.TasksExecuted, 1, false);
                 ++_ActiveCount;
                 task();
                 --_ActiveCount;
             }
-            else if (_StopWorkers)
+            else if (_StopWorkers || self.Retired)
             {
                 break;
             }
         }
+
+        context.Pool = nullptr;
+        // The slot can be reused from here, the next owner joins this thread first.
+        self.Active.store(false, std::memory_order_release);
+    }
+
+    // Run a worker thread in an unused slot, the caller holds _ResizeMutex.
+    void _StartWorker(std::size_t worker_index, std::promise<bool> pin_promise)
+    {
+        auto& worker = *_Workers[worker_index];
+        if (worker.Thread.joinable())
+            worker.Thread.join();
+
+        worker.SpinLimit = _Idle.SpinCount;
+        worker.Retired = false;
+        worker.Active.store(true, std::memory_order_relaxed);
+        ++_WorkerCount;
+        worker.Thread = std::thread(&ThreadPool::_WorkerLoop, this, worker_index, _Options.PoolName.empty() ? _Options.PoolName : _Options.PoolName + ' ' + std::to_string(worker_index), std::move(pin_promise));
+    }
+
+    // Add a worker when a slot is free, returns false when the pool is full or stopping.
+    bool _AddWorker()
+    {
+        std::lock_guard<std::mutex> lock(_ResizeMutex);
+        if (!_Resizing)
+            return false;
+
+        for (std::size_t i = 0; i < _Workers.size(); ++i)
+        {
+            if (!_Workers[i]->Active.load(std::memory_order_acquire))
+            {
+                _StartWorker(i, std::promise<bool>());
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Take the calling worker out of _WorkerCount when the pool has more workers than it needs.
+    bool _TryRetire()
+    {
+        std::size_t count = _WorkerCount.load(std::memory_order_relaxed);
+        while (count > _MinWorkers + _BlockedCount.load(std::memory_order_relaxed))
+        {
+            if (_WorkerCount.compare_exchange_weak(count, count - 1, std::memory_order_relaxed))
+                return true;
+        }
+
+        return false;
+    }
+
+    void _EnterBlockingRegion()
+    {
+        const std::size_t blocked = ++_BlockedCount;
+        if (_WorkerCount.load(std::memory_order_relaxed) < _BaseWorkers + blocked)
+            _AddWorker();
+    }
+
+    // Grow the pool when the tasks queued now would wait longer than an interval at the throughput of the last one.
+    void _MonitorLoop(std::chrono::milliseconds interval)
+    {
+        auto executed_count = [this]()
+        {
+            uint64_t executed = 0;
+            for (auto const& worker : _Workers)
+                executed += worker->Counters.TasksExecuted.load(std::memory_order_relaxed);
+            return executed;
+        };
+
+        uint64_t executed = executed_count();
+        std::unique_lock<std::mutex> lock(_MonitorMutex);
+        while (!_MonitorNotifier.wait_for(lock, interval, [this]() { return _StopMonitor; }))
+        {
+            const uint64_t previous = executed;
+            executed = executed_count();
+
+            const std::size_t pending = _PendingCount.load(std::memory_order_relaxed);
+            const bool idle_workers = _SpinningCount.load(std::memory_order_relaxed) != 0 || _SleepingCount.load(std::memory_order_relaxed) != 0;
+            if (pending != 0 && !idle_workers && pending > executed - previous)
+                _AddWorker();
+        }
+    }
+
+    task_t _NextTask(std::size_t worker_index)
+    {
+        task_t task;
+        auto& self = *_Workers[worker_index];
+
+        while (true)
+        {
+            _PollTimers();
+            if (_TryFindTask(self, worker_index, task) || _Spin(self, worker_index, task))
+                return task;
+
+            if (!_Park(self))
+                return {};
+        }
+    }
+
+    bool _TryFindTask(Worker& self, std::size_t worker_index, task_t& task)
+    {
+        const bool found = _Mode == ThreadPoolMode::WorkStealing
+            ? (_CriticalCount.load(std::memory_order_relaxed) != 0 && _TryPopInjected(task)) || self.Queue.Pop(task) || _TryPopInjected(task) || _TrySteal(self, worker_index, task)
+            : _TryPopInjected(task);
+
+        if (found)
+            --_PendingCount;
+
+        return found;
+    }
+
+    bool _TryPopInjected(task_t& task)
+    {
+        if (_InjectionQueue != nullptr)
+        {
+            // The lanes hold the prioritized tasks and the overflow: serve them first when they have critical tasks or
+            // after StarvationLimit tasks taken from the injection queue.
+            const bool lanes_waiting = _InjectedCount.load(std::memory_order_relaxed) != 0;
+            const bool lanes_first = lanes_waiting && (_CriticalCount.load(std::memory_order_relaxed) != 0 ||
+                (_Options.StarvationLimit != 0 && _InjectionStreak.load(std::memory_order_relaxed) >= _Options.StarvationLimit));
+            if (lanes_first && _TryPopLanes(task))
+            {
+                _InjectionStreak.store(0, std::memory_order_relaxed);
+                return true;
+            }
+
+            if (_InjectionQueue->TryPop(task))
+            {
+                if (lanes_waiting)
+                    _InjectionStreak.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        return _TryPopLanes(task);
+    }
+
+    bool _TryPopLanes(task_t& task)
+    {
+        if (_InjectedCount.load(std::memory_order_relaxed) == 0)
+            return false;
+
+        auto lock = _LockTasks();
+        if (!_Tasks.Pop(task))
+            return false;
+
+        _InjectedCount.store(_Tasks.Size(), std::memory_order_relaxed);
+        _CriticalCount.store(_Tasks.Size(TaskPriority::Critical), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool _TrySteal(Worker& self, std::size_t worker_index, task_t& task)
+    {
+        // xorshift32, only used to pick the first victim.
+        uint32_t x = self.RandomState;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        self.RandomState = x;
+
+        if (!_TrySteal(x % _Workers.size(), worker_index, task))
+            return false;
+
+        details::MetricCounters::Add(self.Counters.Steals, 1, false);
+        return true;
+    }
+
+    // Steal from every worker but skipped_index, starting with first.
+    bool _TrySteal(std::size_t first, std::size_t skipped_index, task_t& task)
+    {
+        const std::size_t worker_count = _Workers.size();
+        for (std::size_t i = 0; i < worker_count; ++i)
+        {
+            const std::size_t victim = (first + i) % worker_count;
+            if (victim != skipped_index && _Workers[victim]->Queue.Steal(task))
+                return true;
+        }
+
+        return false;
+    }
+
+    // Poll for work with a cpu pause, then with a yield, before the worker parks.
+    bool _Spin(Worker& self, std::size_t worker_index, task_t& task)
+    {
+        const uint32_t spin_count = self.SpinLimit;
+        const uint32_t poll_count = spin_count + _Idle.YieldCount;
+        if (poll_count == 0)
+            return false;
+
+        ++_SpinningCount;
+
+        bool found = false;
+        for (uint32_t i = 0; !found && i < poll_count && !_StopWorkers; ++i)
+        {
+            if (i < spin_count)
+                details::CpuRelax();
+            else
+                std::this_thread::yield();
+
+            found = _PendingCount.load(std::memory_order_relaxed) != 0 && _TryFindTask(self, worker_index, task);
+        }
+
+        // The last spinner took a task but there is more: producers skipped the wake up because of us.
+        if (--_SpinningCount == 0 && found && _PendingCount != 0)
+            _WakeWorkers(1);
+
+        // Spin longer when spinning paid off, shorter when the worker ended up parking anyway.
+        if (found)
+            self.SpinLimit = std::min(std::max<uint32_t>(self.SpinLimit * 2, 1), _Idle.SpinCount);
+        else
+            self.SpinLimit = std::max(self.SpinLimit / 2, std::min<uint32_t>(_Idle.SpinCount, details::MinimumSpinCount));
+
+        return found;
     }
 
-    std::function<void()> _NextTask()
+    // Returns false when the worker should exit: the pool stops or the worker retires after IdleTimeout.
+    bool _Park(Worker& self)
     {
         std::unique_lock<std::mutex> lock{ _Mutex };
+        if (_StopWorkers && _PendingCount == 0)
+            return false;
+
+        ++_SleepingCount;
+        bool parked = false;
+        bool timers_due = false;
+        while (_PendingCount == 0 && !_StopWorkers)
+        {
+            if (!parked)
+            {
+                parked = true;
+                details::MetricCounters::Add(self.Counters.Parks, 1, false);
+            }
+
+            const std::chrono::steady_clock::time_point next_event{ std::chrono::steady_clock::duration(_Timers->NextEvent.load(std::memory_order_acquire)) };
+            if (_TimerKeeper || _Timers->Count.load(std::memory_order_relaxed) == 0 || next_event == std::chrono::steady_clock::time_point::max())
+            {
+                // Pools that can't grow past MinWorkers never retire a worker.
+                if (_Workers.size() == _MinWorkers)
+                {
+                    _WorkerNotifier.wait(lock);
+                }
+                else if (_WorkerNotifier.wait_for(lock, _Options.IdleTimeout) == std::cv_status::timeout &&
+                    _PendingCount == 0 && !_StopWorkers && _TryRetire())
+                {
+                    self.Retired = true;
+                    break;
+                }
+                continue;
+            }
+
+            _TimerKeeper = true;
+            const uint64_t epoch = _TimerEpoch;
+            timers_due = !_WorkerNotifier.wait_until(lock, next_event, [this, epoch]()
+            {
+                return _PendingCount != 0 || _StopWorkers || _TimerEpoch != epoch;
+            });
+            _TimerKeeper = false;
+
+            if (timers_due)
+                break;
+        }
+        --_SleepingCount;
+        if (parked)
+            details::MetricCounters::Add(self.Counters.Unparks, 1, false);
+
+        // Hand the keeper role over to another parked worker.
+        if (!_TimerKeeper && _SleepingCount != 0 && _Timers->Count.load(std::memory_order_relaxed) != 0)
+            _WorkerNotifier.notify_one();
 
-        _WorkerNotifier.wait(lock, [this]() { return !_Tasks.empty() || _StopWorkers; });
+        lock.unlock();
 
-        if (_Tasks.empty())
-            return {};
+        if (timers_due)
+            _ProcessTimers();
 
-        auto task{ _Tasks.front() };
-        _Tasks.pop();
-        return task;
+        return !self.Retired;
     }
 };
 }
\ No newline at end of file
@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) Nemirtingas
+ * This file is part of System.
+ *
+ * System is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * System is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the System; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <System/UniqueFunction.hpp>
+
+namespace System {
+namespace details {
+    enum class TimerState : uint8_t
+    {
+        Scheduled,
+        Running,
+        Done,
+        Cancelled,
+    };
+
+    struct TimerNode
+    {
+        // In wheel ticks.
+        uint64_t Expiry = 0;
+        uint64_t Period = 0;
+        UniqueFunction<void()> Callback;
+        std::atomic<TimerState> State{ TimerState::Scheduled };
+
+        // Intrusive slot list, Self keeps the node alive while it is linked in the wheel.
+        TimerNode* Next = nullptr;
+        TimerNode* Prev = nullptr;
+        TimerNode** Head = nullptr;
+        std::shared_ptr<TimerNode> Self;
+    };
+
+    // Hierarchical timer wheel: LevelCount levels of SlotCount slots, a slot of level l spans SlotCount^l ticks.
+    // Insert and Remove are O(1), timers move to a lower level when the wheel reaches their slot and fire from level 0.
+    // Timers beyond the last level wait in an overflow list. Not thread safe.
+    class TimerWheel
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        static constexpr std::chrono::milliseconds Resolution{ 1 };
+        static constexpr uint32_t SlotBits = 6;
+        static constexpr uint32_t SlotCount = 1u << SlotBits;
+        static constexpr uint32_t LevelCount = 4;
+
+    private:
+        clock::time_point _Origin;
+        // Last processed tick.
+        uint64_t _Current;
+        std::size_t _Size;
+        // Timers per level, the last one is the overflow list.
+        std::size_t _LevelSizes[LevelCount + 1];
+        // Non empty slots bitmap of level 0.
+        uint64_t _Occupied;
+        TimerNode* _Slots[LevelCount][SlotCount];
+        TimerNode* _Overflow;
+
+        static void _Link(TimerNode*& head, TimerNode* timer)
+        {
+            timer->Prev = nullptr;
+            timer->Next = head;
+            timer->Head = &head;
+            if (head != nullptr)
+                head->Prev = timer;
+
+            head = timer;
+        }
+
+        static void _Unlink(TimerNode* timer)
+        {
+            if (timer->Prev != nullptr)
+                timer->Prev->Next = timer->Next;
+            else
+                *timer->Head = timer->Next;
+
+            if (timer->Next != nullptr)
+                timer->Next->Prev = timer->Prev;
+
+            timer->Next = nullptr;
+            timer->Prev = nullptr;
+            timer->Head = nullptr;
+        }
+
+        static constexpr uint64_t _LevelSpan(uint32_t level)
+        {
+            return uint64_t(1) << (SlotBits * level);
+        }
+
+        uint32_t _LevelOf(TimerNode** head) const
+        {
+            if (head == &_Overflow)
+                return LevelCount;
+
+            return static_cast<uint32_t>((head - &_Slots[0][0]) / SlotCount);
+        }
+
+        // Expiry must not be before _Current.
+        void _Place(TimerNode* timer)
+        {
+            const uint64_t delta = timer->Expiry - _Current;
+            for (uint32_t level = 0; level < LevelCount; ++level)
+            {
+                if (delta < _LevelSpan(level + 1))
+                {
+                    const uint32_t slot = static_cast<uint32_t>(timer->Expiry >> (SlotBits * level)) & (SlotCount - 1);
+                    _Link(_Slots[level][slot], timer);
+                    ++_LevelSizes[level];
+                    if (level == 0)
+                        _Occupied |= uint64_t(1) << slot;
+                    return;
+                }
+            }
+
+            _Link(_Overflow, timer);
+            ++_LevelSizes[LevelCount];
+        }
+
+        void _Detach(TimerNode* timer)
+        {
+            const uint32_t level = _LevelOf(timer->Head);
+            TimerNode** head = timer->Head;
+            _Unlink(timer);
+            --_LevelSizes[level];
+            if (level == 0 && *head == nullptr)
+                _Occupied &= ~(uint64_t(1) << (head - &_Slots[0][0]));
+        }
+
+        void _Cascade(TimerNode*& head, uint32_t level)
+        {
+            TimerNode* timer = head;
+            head = nullptr;
+            while (timer != nullptr)
+            {
+                TimerNode* next = timer->Next;
+                --_LevelSizes[level];
+                _Place(timer);
+                timer = next;
+            }
+        }
+
+    public:
+        explicit TimerWheel(clock::time_point origin = clock::now()):
+            _Origin(origin),
+            _Current(0),
+            _Size(0),
+            _LevelSizes{},
+            _Occupied(0),
+            _Slots{},
+            _Overflow(nullptr)
+        {}
+
+        TimerWheel(TimerWheel const&) = delete;
+        TimerWheel& operator=(TimerWheel const&) = delete;
+
+        ~TimerWheel()
+        {
+            std::vector<std::shared_ptr<TimerNode>> timers;
+            Clear(timers);
+        }
+
+        // First tick at or after time, so timers never fire early.
+        uint64_t ToTick(clock::time_point time) const
+        {
+            if (time <= _Origin)
+                return 0;
+
+            const auto elapsed = time - _Origin;
+            return static_cast<uint64_t>((elapsed + Resolution - clock::duration(1)) / Resolution);
+        }
+
+        uint64_t CurrentTick() const
+        {
+            return _Current;
+        }
+
+        clock::time_point ToTimePoint(uint64_t tick) const
+        {
+            return _Origin + std::chrono::duration_cast<clock::duration>(Resolution * tick);
+        }
+
+        std::size_t Size() const
+        {
+            return _Size;
+        }
+
+        // Returns false without taking the timer when it is already due.
+        bool Insert(std::shared_ptr<TimerNode> timer)
+        {
+            if (timer->Expiry <= _Current)
+                return false;
+
+            TimerNode* node = timer.get();
+            node->Self = std::move(timer);
+            _Place(node);
+            ++_Size;
+            return true;
+        }
+
+        bool Remove(TimerNode& timer)
+        {
+            if (timer.Head == nullptr)
+                return false;
+
+            _Detach(&timer);
+            --_Size;
+            // Might release the last reference.
+            auto self = std::move(timer.Self);
+            return true;
+        }
+
+        // Process every tick up to now and move the timers due to expired.
+        void Advance(clock::time_point now, std::vector<std::shared_ptr<TimerNode>>& expired)
+        {
+            if (now < _Origin)
+                return;
+
+            const uint64_t target = static_cast<uint64_t>((now - _Origin) / Resolution);
+            while (_Current < target)
+            {
+                if (_Size == 0)
+                {
+                    _Current = target;
+                    break;
+                }
+
+                // Nothing to fire in level 0: jump to the next cascade of the lowest non empty level.
+                if (_LevelSizes[0] == 0)
+                {
+                    uint32_t level = 1;
+                    while (level < LevelCount && _LevelSizes[level] == 0)
+                        ++level;
+
+                    const uint64_t span = _LevelSpan(level);
+                    const uint64_t next_cascade = (_Current / span + 1) * span;
+                    if (next_cascade > target)
+                    {
+                        _Current = target;
+                        break;
+                    }
+
+                    _Current = next_cascade - 1;
+                }
+
+                ++_Current;
+
+                // Cascade from the top so timers only move down.
+                if ((_Current & (_LevelSpan(LevelCount) - 1)) == 0)
+                    _Cascade(_Overflow, LevelCount);
+
+                for (uint32_t level = LevelCount - 1; level > 0; --level)
+                {
+                    if ((_Current & (_LevelSpan(level) - 1)) == 0)
+                        _Cascade(_Slots[level][(_Current >> (SlotBits * level)) & (SlotCount - 1)], level);
+                }
+
+                const uint32_t slot = static_cast<uint32_t>(_Current) & (SlotCount - 1);
+                while (_Slots[0][slot] != nullptr)
+                {
+                    TimerNode* timer = _Slots[0][slot];
+                    _Detach(timer);
+                    --_Size;
+                    expired.emplace_back(std::move(timer->Self));
+                }
+            }
+        }
+
+        // Time of the next tick with something to do: a level 0 timer or a cascade, time_point::max() when empty.
+        clock::time_point NextEvent() const
+        {
+            if (_Size == 0)
+                return clock::time_point::max();
+
+            uint64_t next_tick = UINT64_MAX;
+            if (_Occupied != 0)
+            {
+                // Rotate the bitmap so bit 0 is the slot right after the current tick.
+                const uint32_t shift = static_cast<uint32_t>(_Current + 1) & (SlotCount - 1);
+                const uint64_t rotated = shift == 0 ? _Occupied : (_Occupied >> shift) | (_Occupied << (SlotCount - shift));
+                uint32_t distance = 0;
+                while ((rotated & (uint64_t(1) << distance)) == 0)
+                    ++distance;
+
+                next_tick = _Current + 1 + distance;
+            }
+
+            // A higher level timer can cascade down before the next level 0 one.
+            if (_Size != _LevelSizes[0])
+            {
+                uint32_t level = 1;
+                while (level < LevelCount && _LevelSizes[level] == 0)
+                    ++level;
+
+                const uint64_t span = _LevelSpan(level);
+                next_tick = std::min(next_tick, (_Current / span + 1) * span);
+            }
+
+            return ToTimePoint(next_tick);
+        }
+
+        void Clear(std::vector<std::shared_ptr<TimerNode>>& removed)
+        {
+            for (auto& level : _Slots)
+            {
+                for (auto& head : level)
+                {
+                    while (head != nullptr)
+                    {
+                        TimerNode* timer = head;
+                        _Unlink(timer);
+                        removed.emplace_back(std::move(timer->Self));
+                    }
+                }
+            }
+
+            while (_Overflow != nullptr)
+            {
+                TimerNode* timer = _Overflow;
+                _Unlink(timer);
+                removed.emplace_back(std::move(timer->Self));
+            }
+
+            for (auto& size : _LevelSizes)
+                size = 0;
+
+            _Occupied = 0;
+            _Size = 0;
+        }
+    };
+
+    // Wheel shared by a pool and its timer handles, which can outlive the pool.
+    struct TimerQueue
+    {
+        std::mutex Mutex;
+        TimerWheel Wheel;
+        // Mirrors of the wheel state readable without the mutex.
+        std::atomic<std::size_t> Count{ 0 };
+        std::atomic<TimerWheel::clock::rep> NextEvent{ TimerWheel::clock::time_point::max().time_since_epoch().count() };
+
+        // Call with Mutex held.
+        void Update()
+        {
+            Count.store(Wheel.Size(), std::memory_order_relaxed);
+            NextEvent.store(Wheel.NextEvent().time_since_epoch().count(), std::memory_order_release);
+        }
+    };
+}
+
+// Handle of a timer scheduled with ThreadPool::PushAfter, PushAt or PushEvery.
+class TimerHandle
+{
+    std::weak_ptr<details::TimerQueue> _Queue;
+    std::weak_ptr<details::TimerNode> _Timer;
+
+public:
+    TimerHandle() = default;
+
+    TimerHandle(std::weak_ptr<details::TimerQueue> queue, std::weak_ptr<details::TimerNode> timer):
+        _Queue(std::move(queue)),
+        _Timer(std::move(timer))
+    {}
+
+    // Returns true when the callback won't run anymore because of this call. A running periodic callback finishes
+    // but is not scheduled again.
+    bool Cancel()
+    {
+        auto timer = _Timer.lock();
+        if (timer == nullptr)
+            return false;
+
+        auto state = timer->State.load(std::memory_order_acquire);
+        while (true)
+        {
+            if (state == details::TimerState::Done || state == details::TimerState::Cancelled)
+                return false;
+
+            // A one shot timer already running can't be stopped.
+            if (state == details::TimerState::Running && timer->Period == 0)
+                return false;
+
+            if (timer->State.compare_exchange_weak(state, details::TimerState::Cancelled, std::memory_order_acq_rel))
+                break;
+        }
+
+        if (auto queue = _Queue.lock())
+        {
+            std::lock_guard<std::mutex> lock(queue->Mutex);
+            if (queue->Wheel.Remove(*timer))
+                queue->Update();
+        }
+
+        return true;
+    }
+};
+
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) Nemirtingas
+ * This file is part of System.
+ *
+ * System is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * System is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the System; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace System {
+
+template<typename Signature, std::size_t InlineSize = 7 * sizeof(void*)>
+class UniqueFunction;
+
+// Move-only std::function replacement. Callables up to InlineSize bytes that can be moved without throwing
+// are stored inline, bigger ones fall back to a single heap allocation.
+template<typename R, typename... Args, std::size_t InlineSize>
+class UniqueFunction<R(Args...), InlineSize>
+{
+    struct VTable
+    {
+        R(*Invoke)(void* storage, Args&&... args);
+        void(*Move)(void* dst, void* src) noexcept;
+        void(*Destroy)(void* storage) noexcept;
+    };
+
+    template<typename F>
+    static constexpr bool IsInline = sizeof(F) <= InlineSize && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<F>::value;
+
+    template<typename F>
+    struct InlineOps
+    {
+        static R Invoke(void* storage, Args&&... args)
+        {
+            return static_cast<R>(std::invoke(*static_cast<F*>(storage), std::forward<Args>(args)...));
+        }
+
+        static void Move(void* dst, void* src) noexcept
+        {
+            ::new (dst) F(std::move(*static_cast<F*>(src)));
+            static_cast<F*>(src)->~F();
+        }
+
+        static void Destroy(void* storage) noexcept
+        {
+            static_cast<F*>(storage)->~F();
+        }
+
+        static constexpr VTable Table{ &Invoke, &Move, &Destroy };
+    };
+
+    template<typename F>
+    struct HeapOps
+    {
+        static R Invoke(void* storage, Args&&... args)
+        {
+            return static_cast<R>(std::invoke(**static_cast<F**>(storage), std::forward<Args>(args)...));
+        }
+
+        static void Move(void* dst, void* src) noexcept
+        {
+            *static_cast<F**>(dst) = *static_cast<F**>(src);
+        }
+
+        static void Destroy(void* storage) noexcept
+        {
+            delete *static_cast<F**>(storage);
+        }
+
+        static constexpr VTable Table{ &Invoke, &Move, &Destroy };
+    };
+
+    alignas(std::max_align_t) unsigned char _Storage[InlineSize];
+    VTable const* _VTable;
+
+public:
+    UniqueFunction() noexcept:
+        _VTable(nullptr)
+    {
+    }
+
+    UniqueFunction(std::nullptr_t) noexcept:
+        _VTable(nullptr)
+    {
+    }
+
+    template<typename Func, typename F = std::decay_t<Func>, typename = std::enable_if_t<!std::is_same<F, UniqueFunction>::value && std::is_invocable_r<R, F&, Args...>::value>>
+    UniqueFunction(Func&& fn):
+        _VTable(nullptr)
+    {
+        if constexpr (IsInline<F>)
+        {
+            ::new (static_cast<void*>(_Storage)) F(std::forward<Func>(fn));
+            _VTable = &InlineOps<F>::Table;
+        }
+        else
+        {
+            *reinterpret_cast<F**>(_Storage) = new F(std::forward<Func>(fn));
+            _VTable = &HeapOps<F>::Table;
+        }
+    }
+
+    UniqueFunction(UniqueFunction&& other) noexcept:
+        _VTable(other._VTable)
+    {
+        if (_VTable != nullptr)
+        {
+            _VTable->Move(_Storage, other._Storage);
+            other._VTable = nullptr;
+        }
+    }
+
+    UniqueFunction& operator=(UniqueFunction&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            if (other._VTable != nullptr)
+            {
+                other._VTable->Move(_Storage, other._Storage);
+                _VTable = other._VTable;
+                other._VTable = nullptr;
+            }
+        }
+
+        return *this;
+    }
+
+    UniqueFunction& operator=(std::nullptr_t) noexcept
+    {
+        Reset();
+        return *this;
+    }
+
+    UniqueFunction(UniqueFunction const&) = delete;
+    UniqueFunction& operator=(UniqueFunction const&) = delete;
+
+    ~UniqueFunction()
+    {
+        Reset();
+    }
+
+    void Reset() noexcept
+    {
+        if (_VTable != nullptr)
+        {
+            _VTable->Destroy(_Storage);
+            _VTable = nullptr;
+        }
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return _VTable != nullptr;
+    }
+
+    R operator()(Args... args)
+    {
+        return _VTable->Invoke(_Storage, std::forward<Args>(args)...);
+    }
+};
+
+}
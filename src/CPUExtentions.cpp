@@ -24,16 +24,33 @@
 namespace System {
 namespace CpuFeatures {
     CpuId_t CpuId(int functionIndex)
+    {
+        return CpuId(functionIndex, 0);
+    }
+
+    CpuId_t CpuId(int functionIndex, int subFunctionIndex)
     {
         CpuId_t cpuId;
         __asm__ __volatile__(
             "cpuid"
             : "=a"(cpuId.Registers.eax), "=b"(cpuId.Registers.ebx), "=c"(cpuId.Registers.ecx), "=d"(cpuId.Registers.edx)
-            : "a"(functionIndex)
+            : "a"(functionIndex), "c"(subFunctionIndex)
         );
 
         return cpuId;
     }
+
+    unsigned long long GetXCR0()
+    {
+        unsigned int eax, edx;
+        __asm__ __volatile__(
+            "xgetbv"
+            : "=a"(eax), "=d"(edx)
+            : "c"(0)
+        );
+
+        return (static_cast<unsigned long long>(edx) << 32) | eax;
+    }
 }// namespace CpuFeatures
 }// namespace System
 #else
@@ -42,12 +59,22 @@ namespace CpuFeatures {
 namespace System {
 namespace CpuFeatures {
     CpuId_t CpuId(int functionIndex)
+    {
+        return CpuId(functionIndex, 0);
+    }
+
+    CpuId_t CpuId(int functionIndex, int subFunctionIndex)
     {
         CpuId_t cpuId;
-        __cpuidex((int*)cpuId.RegisterArray, functionIndex, 0);
+        __cpuidex((int*)cpuId.RegisterArray, functionIndex, subFunctionIndex);
 
         return cpuId;
     }
+
+    unsigned long long GetXCR0()
+    {
+        return _xgetbv(0);
+    }
 }// namespace CpuFeatures
 }// namespace System
 #endif
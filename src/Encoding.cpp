@@ -24,6 +24,9 @@
 
 #include <string.h>
 #include <algorithm>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
 
 namespace System
 {
@@ -32,7 +35,1154 @@ namespace Encoding
 
 namespace details
 {
+
+///////////////////////////////////////////////////////////
+// UTF-8 validation
+//
+// The vector kernels check a block against the 1 to 3 bytes before it with nibble lookup tables (Keiser & Lemire,
+// "Validating UTF-8 In Less Than One Instruction Per Byte"). Each table flags the errors a byte can take part in,
+// a pair of bytes is wrong when the flags of the first byte's nibbles and the second byte's high nibble intersect.
+
+static uint8_t constexpr Utf8TooShort     = 1 << 0; // 11______ 0_______, 11______ 11______
+static uint8_t constexpr Utf8TooLong      = 1 << 1; // 0_______ 10______
+static uint8_t constexpr Utf8Overlong3    = 1 << 2; // 11100000 100_____
+static uint8_t constexpr Utf8TooLarge     = 1 << 3; // 11110100 1001____, 11110100 101_____, 11110101+ 10______
+static uint8_t constexpr Utf8Surrogate    = 1 << 4; // 11101101 101_____
+static uint8_t constexpr Utf8Overlong2    = 1 << 5; // 1100000_ 10______
+static uint8_t constexpr Utf8TooLarge1000 = 1 << 6; // 11110101+ 1000____
+static uint8_t constexpr Utf8Overlong4    = 1 << 6; // 11110000 1000____
+static uint8_t constexpr Utf8TwoConts     = 1 << 7; // 10______ 10______
+static uint8_t constexpr Utf8Carry        = Utf8TooShort | Utf8TooLong | Utf8TwoConts;
+
+alignas(16) static uint8_t constexpr Utf8Byte1High[16] = {
+    Utf8TooLong, Utf8TooLong, Utf8TooLong, Utf8TooLong, Utf8TooLong, Utf8TooLong, Utf8TooLong, Utf8TooLong,
+    Utf8TwoConts, Utf8TwoConts, Utf8TwoConts, Utf8TwoConts,
+    Utf8TooShort | Utf8Overlong2,
+    Utf8TooShort,
+    Utf8TooShort | Utf8Overlong3 | Utf8Surrogate,
+    Utf8TooShort | Utf8TooLarge | Utf8TooLarge1000 | Utf8Overlong4,
+};
+
+alignas(16) static uint8_t constexpr Utf8Byte1Low[16] = {
+    Utf8Carry | Utf8Overlong3 | Utf8Overlong2 | Utf8Overlong4,
+    Utf8Carry | Utf8Overlong2,
+    Utf8Carry,
+    Utf8Carry,
+    Utf8Carry | Utf8TooLarge,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000 | Utf8Surrogate,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000,
+    Utf8Carry | Utf8TooLarge | Utf8TooLarge1000,
+};
+
+alignas(16) static uint8_t constexpr Utf8Byte2High[16] = {
+    Utf8TooShort, Utf8TooShort, Utf8TooShort, Utf8TooShort, Utf8TooShort, Utf8TooShort, Utf8TooShort, Utf8TooShort,
+    Utf8TooLong | Utf8Overlong2 | Utf8TwoConts | Utf8Overlong3 | Utf8TooLarge1000 | Utf8Overlong4,
+    Utf8TooLong | Utf8Overlong2 | Utf8TwoConts | Utf8Overlong3 | Utf8TooLarge,
+    Utf8TooLong | Utf8Overlong2 | Utf8TwoConts | Utf8Surrogate | Utf8TooLarge,
+    Utf8TooLong | Utf8Overlong2 | Utf8TwoConts | Utf8Surrogate | Utf8TooLarge,
+    Utf8TooShort, Utf8TooShort, Utf8TooShort, Utf8TooShort,
+};
+
+static inline bool _IsAsciiWord(uint8_t const *s)
+{
+    uint64_t word;
+    memcpy(&word, s, sizeof(word));
+    return (word & 0x8080808080808080ull) == 0;
+}
+
+enum class Utf8Sequence
+{
+    Valid,
+    Invalid,
+    Incomplete,
+};
+
+// Check the sequence at s[0] against the well-formed byte ranges of the Unicode standard (table 3-7).
+// available is the count of bytes left in the input, length gets the length of the sequence, or the length of its
+// maximal invalid subpart when it is not valid.
+static inline Utf8Sequence _CheckUtf8Sequence(uint8_t const *s, size_t available, size_t &length)
+{
+    uint8_t const c = s[0];
+    uint8_t low     = 0x80;
+    uint8_t high    = 0xBF;
+    if (c < 0x80)
+    {
+        length = 1;
+        return Utf8Sequence::Valid;
+    }
+
+    if (c < 0xC2)
+    {
+        length = 1;
+        return Utf8Sequence::Invalid;
+    }
+    else if (c < 0xE0)
+    {
+        length = 2;
+    }
+    else if (c < 0xF0)
+    {
+        length = 3;
+        if (c == 0xE0)
+            low = 0xA0;
+        else if (c == 0xED)
+            high = 0x9F;
+    }
+    else if (c < 0xF5)
+    {
+        length = 4;
+        if (c == 0xF0)
+            low = 0x90;
+        else if (c == 0xF4)
+            high = 0x8F;
+    }
+    else
+    {
+        length = 1;
+        return Utf8Sequence::Invalid;
+    }
+
+    for (size_t j = 1; j < length; ++j)
+    {
+        if (j == available)
+            return Utf8Sequence::Incomplete;
+
+        if (s[j] < low || s[j] > high)
+        {
+            length = j;
+            return Utf8Sequence::Invalid;
+        }
+
+        low  = 0x80;
+        high = 0xBF;
+    }
+
+    return Utf8Sequence::Valid;
+}
+
+static bool _IsValidUtf8Scalar(uint8_t const *s, size_t len)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        if (i + 8 <= len && _IsAsciiWord(s + i))
+        {
+            i += 8;
+            continue;
+        }
+
+        size_t length;
+        if (_CheckUtf8Sequence(s + i, len - i, length) != Utf8Sequence::Valid)
+            return false;
+
+        i += length;
+    }
+
+    return true;
+}
+
+#if defined(SYSTEM_SIMD_X86)
+SYSTEM_TARGET("ssse3")
+static inline __m128i _Utf8ErrorsSSSE3(__m128i input, __m128i previous)
+{
+    __m128i const nibble = _mm_set1_epi8(0x0F);
+    __m128i const prev1  = _mm_alignr_epi8(input, previous, 15);
+    __m128i const byte_1_high = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<__m128i const *>(Utf8Byte1High)), _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i const byte_1_low  = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<__m128i const *>(Utf8Byte1Low)), _mm_and_si128(prev1, nibble));
+    __m128i const byte_2_high = _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<__m128i const *>(Utf8Byte2High)), _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i const special     = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    // The 2nd continuation of a 3 or 4 bytes sequence and the 3rd of a 4 bytes one.
+    __m128i const third  = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 14), _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    __m128i const fourth = _mm_subs_epu8(_mm_alignr_epi8(input, previous, 13), _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    __m128i const must_be_continuation = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(must_be_continuation, special);
+}
+
+SYSTEM_TARGET("ssse3")
+static bool _IsValidUtf8SSSE3(uint8_t const *s, size_t len)
+{
+    __m128i previous = _mm_setzero_si128();
+    __m128i errors   = _mm_setzero_si128();
+    size_t i         = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i const input = _mm_loadu_si128(reinterpret_cast<__m128i const *>(s + i));
+        errors   = _mm_or_si128(errors, _Utf8ErrorsSSSE3(input, previous));
+        previous = input;
+    }
+
+    // The zero padding after the tail catches a sequence cut by the end.
+    alignas(16) uint8_t tail[16] = {};
+    memcpy(tail, s + i, len - i);
+    errors = _mm_or_si128(errors, _Utf8ErrorsSSSE3(_mm_load_si128(reinterpret_cast<__m128i const *>(tail)), previous));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(errors, _mm_setzero_si128())) == 0xFFFF;
+}
+
+SYSTEM_TARGET("avx2")
+static inline __m256i _Utf8ErrorsAVX2(__m256i input, __m256i previous)
+{
+    __m256i const nibble = _mm256_set1_epi8(0x0F);
+    // The bytes before each lane: the high lane of previous then the low lane of input.
+    __m256i const shifted = _mm256_permute2x128_si256(previous, input, 0x21);
+    __m256i const prev1   = _mm256_alignr_epi8(input, shifted, 15);
+    __m256i const byte_1_high = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(Utf8Byte1High))), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i const byte_1_low  = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(Utf8Byte1Low))), _mm256_and_si256(prev1, nibble));
+    __m256i const byte_2_high = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<__m128i const *>(Utf8Byte2High))), _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i const special     = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    __m256i const third  = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 14), _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    __m256i const fourth = _mm256_subs_epu8(_mm256_alignr_epi8(input, shifted, 13), _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    __m256i const must_be_continuation = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must_be_continuation, special);
+}
+
+SYSTEM_TARGET("avx2")
+static bool _IsValidUtf8AVX2(uint8_t const *s, size_t len)
+{
+    __m256i previous = _mm256_setzero_si256();
+    __m256i errors   = _mm256_setzero_si256();
+    size_t i         = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i const input = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(s + i));
+        errors   = _mm256_or_si256(errors, _Utf8ErrorsAVX2(input, previous));
+        previous = input;
+    }
+
+    alignas(32) uint8_t tail[32] = {};
+    memcpy(tail, s + i, len - i);
+    errors = _mm256_or_si256(errors, _Utf8ErrorsAVX2(_mm256_load_si256(reinterpret_cast<__m256i const *>(tail)), previous));
+    return _mm256_testz_si256(errors, errors) != 0;
+}
+#elif defined(SYSTEM_SIMD_NEON) && defined(SYSTEM_ARCH_ARM64)
+static inline uint8x16_t _Utf8ErrorsNEON(uint8x16_t input, uint8x16_t previous)
+{
+    uint8x16_t const prev1       = vextq_u8(previous, input, 15);
+    uint8x16_t const byte_1_high = vqtbl1q_u8(vld1q_u8(Utf8Byte1High), vshrq_n_u8(prev1, 4));
+    uint8x16_t const byte_1_low  = vqtbl1q_u8(vld1q_u8(Utf8Byte1Low), vandq_u8(prev1, vdupq_n_u8(0x0F)));
+    uint8x16_t const byte_2_high = vqtbl1q_u8(vld1q_u8(Utf8Byte2High), vshrq_n_u8(input, 4));
+    uint8x16_t const special     = vandq_u8(vandq_u8(byte_1_high, byte_1_low), byte_2_high);
+
+    uint8x16_t const third  = vqsubq_u8(vextq_u8(previous, input, 14), vdupq_n_u8(0xE0 - 0x80));
+    uint8x16_t const fourth = vqsubq_u8(vextq_u8(previous, input, 13), vdupq_n_u8(0xF0 - 0x80));
+    uint8x16_t const must_be_continuation = vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+    return veorq_u8(must_be_continuation, special);
+}
+
+static bool _IsValidUtf8NEON(uint8_t const *s, size_t len)
+{
+    uint8x16_t previous = vdupq_n_u8(0);
+    uint8x16_t errors   = vdupq_n_u8(0);
+    size_t i            = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        uint8x16_t const input = vld1q_u8(s + i);
+        errors   = vorrq_u8(errors, _Utf8ErrorsNEON(input, previous));
+        previous = input;
+    }
+
+    uint8_t tail[16] = {};
+    memcpy(tail, s + i, len - i);
+    errors = vorrq_u8(errors, _Utf8ErrorsNEON(vld1q_u8(tail), previous));
+    return vmaxvq_u8(errors) == 0;
+}
+#endif
+
+using is_valid_utf8_t = bool (*)(uint8_t const *, size_t);
+
+static is_valid_utf8_t _SelectIsValidUtf8()
+{
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().AVX2)
+        return &_IsValidUtf8AVX2;
+
+    if (GetSimdSupport().SSSE3)
+        return &_IsValidUtf8SSSE3;
+#elif defined(SYSTEM_SIMD_NEON) && defined(SYSTEM_ARCH_ARM64)
+    return &_IsValidUtf8NEON;
+#endif
+    return &_IsValidUtf8Scalar;
+}
+
+static bool _IsValidUtf8(std::string_view str)
+{
+    auto const s = reinterpret_cast<uint8_t const *>(str.data());
+    // Short strings are mostly ASCII, don't pay for the padded tail block.
+    if (str.length() < 16)
+        return _IsValidUtf8Scalar(s, str.length());
+
+    static is_valid_utf8_t const is_valid = _SelectIsValidUtf8();
+    return is_valid(s, str.length());
+}
+
+///////////////////////////////////////////////////////////
+// Transcoding
+//
+// UTF-8 input is validated first, the decoders then trust it. Blocks of ASCII are widened or narrowed with vector
+// instructions, the other code points go through the scalar loops.
+
+// Decode the code point at s[i] of valid UTF-8 and move i past it.
+static inline uint32_t _DecodeUtf8(uint8_t const *s, size_t &i)
+{
+    uint32_t const c = s[i];
+    if (c < 0x80)
+    {
+        i += 1;
+        return c;
+    }
+
+    if (c < 0xE0)
+    {
+        uint32_t const code_point = ((c & 0x1F) << 6) | (s[i + 1] & 0x3F);
+        i += 2;
+        return code_point;
+    }
+
+    if (c < 0xF0)
+    {
+        uint32_t const code_point = ((c & 0x0F) << 12) | ((s[i + 1] & 0x3F) << 6) | (s[i + 2] & 0x3F);
+        i += 3;
+        return code_point;
+    }
+
+    uint32_t const code_point = ((c & 0x07) << 18) | ((s[i + 1] & 0x3F) << 12) | ((s[i + 2] & 0x3F) << 6) | (s[i + 3] & 0x3F);
+    i += 4;
+    return code_point;
+}
+
+// Units are 2 bytes for UTF-16, 4 for UTF-32. wchar_t is one or the other.
+template <typename Unit>
+static inline Unit *_PutCodePoint(Unit *out, uint32_t code_point)
+{
+    if (sizeof(Unit) == 2 && code_point >= 0x10000)
+    {
+        code_point -= 0x10000;
+        *out++ = static_cast<Unit>(0xD800 + (code_point >> 10));
+        *out++ = static_cast<Unit>(0xDC00 + (code_point & 0x3FF));
+        return out;
+    }
+
+    *out++ = static_cast<Unit>(code_point);
+    return out;
+}
+
+// Encode a code point, false when it is a surrogate or above U+10FFFF.
+static inline bool _PutUtf8(char *&out, uint32_t code_point)
+{
+    if (code_point < 0x80)
+    {
+        *out++ = static_cast<char>(code_point);
+    }
+    else if (code_point < 0x800)
+    {
+        *out++ = static_cast<char>(0xC0 | (code_point >> 6));
+        *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+    else if (code_point < 0x10000)
+    {
+        if (code_point >= 0xD800 && code_point <= 0xDFFF)
+            return false;
+
+        *out++ = static_cast<char>(0xE0 | (code_point >> 12));
+        *out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+    else if (code_point <= 0x10FFFF)
+    {
+        *out++ = static_cast<char>(0xF0 | (code_point >> 18));
+        *out++ = static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// The code point of the units at s[i], UTF-16 surrogate pairs included, 0xFFFFFFFF when they are not valid.
+template <typename Unit>
+static inline uint32_t _DecodeUnits(Unit const *s, size_t len, size_t &i)
+{
+    uint32_t const unit = static_cast<uint32_t>(s[i++]);
+    if (sizeof(Unit) != 2 || unit < 0xD800 || unit > 0xDFFF)
+        return unit;
+
+    if (unit > 0xDBFF || i == len)
+        return 0xFFFFFFFF;
+
+    uint32_t const trail = static_cast<uint32_t>(s[i]);
+    if (trail < 0xDC00 || trail > 0xDFFF)
+        return 0xFFFFFFFF;
+
+    ++i;
+    return 0x10000 + ((unit - 0xD800) << 10) + (trail - 0xDC00);
+}
+
+template <typename Unit>
+static size_t _Utf8ToUnitsScalar(uint8_t const *s, size_t len, Unit *out)
+{
+    Unit *const begin = out;
+    size_t i          = 0;
+    while (i < len)
+    {
+        if (i + 8 <= len && _IsAsciiWord(s + i))
+        {
+            for (size_t j = 0; j < 8; ++j)
+                out[j] = static_cast<Unit>(s[i + j]);
+
+            out += 8;
+            i += 8;
+            continue;
+        }
+
+        out = _PutCodePoint(out, _DecodeUtf8(s, i));
+    }
+
+    return out - begin;
+}
+
+// false when the units are not valid UTF-16 or UTF-32.
+template <typename Unit>
+static bool _UnitsToUtf8Scalar(Unit const *s, size_t len, char *out, size_t *written)
+{
+    char *const begin = out;
+    size_t i          = 0;
+    while (i < len)
+    {
+        if (!_PutUtf8(out, _DecodeUnits(s, len, i)))
+            return false;
+    }
+
+    *written = out - begin;
+    return true;
+}
+
+#if defined(SYSTEM_SIMD_X86)
+template <typename Unit>
+SYSTEM_TARGET("sse2")
+static size_t _Utf8ToUnitsSSE2(uint8_t const *s, size_t len, Unit *out)
+{
+    Unit *const begin  = out;
+    __m128i const zero = _mm_setzero_si128();
+    size_t i           = 0;
+    while (i + 16 <= len)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(s + i));
+        if (_mm_movemask_epi8(v) != 0)
+        {
+            // Decode up to the end of the block, the next one may be ASCII again.
+            for (size_t const end = i + 16; i < end;)
+                out = _PutCodePoint(out, _DecodeUtf8(s, i));
+
+            continue;
+        }
+
+        __m128i const low  = _mm_unpacklo_epi8(v, zero);
+        __m128i const high = _mm_unpackhi_epi8(v, zero);
+        if (sizeof(Unit) == 2)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), low);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), high);
+        }
+        else
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi16(low, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4), _mm_unpackhi_epi16(low, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpacklo_epi16(high, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 12), _mm_unpackhi_epi16(high, zero));
+        }
+
+        out += 16;
+        i += 16;
+    }
+
+    return (out - begin) + _Utf8ToUnitsScalar(s + i, len - i, out);
+}
+
+template <typename Unit>
+SYSTEM_TARGET("avx2")
+static size_t _Utf8ToUnitsAVX2(uint8_t const *s, size_t len, Unit *out)
+{
+    Unit *const begin = out;
+    size_t i          = 0;
+    while (i + 32 <= len)
+    {
+        __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(s + i));
+        if (_mm256_movemask_epi8(v) != 0)
+        {
+            for (size_t const end = i + 32; i < end;)
+                out = _PutCodePoint(out, _DecodeUtf8(s, i));
+
+            continue;
+        }
+
+        __m128i const low  = _mm256_castsi256_si128(v);
+        __m128i const high = _mm256_extracti128_si256(v, 1);
+        if (sizeof(Unit) == 2)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_cvtepu8_epi16(low));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 16), _mm256_cvtepu8_epi16(high));
+        }
+        else
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_cvtepu8_epi32(low));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 16), _mm256_cvtepu8_epi32(high));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)));
+        }
+
+        out += 32;
+        i += 32;
+    }
+
+    // The SSE2 kernel is not VEX encoded, it stalls on dirty upper halves.
+    _mm256_zeroupper();
+    return (out - begin) + _Utf8ToUnitsSSE2(s + i, len - i, out);
+}
+
+// 8 UTF-16 units or 4 UTF-32 units, narrowed to out when they are all ASCII.
+template <typename Unit>
+SYSTEM_TARGET("sse2")
+static inline bool _NarrowAsciiSSE2(Unit const *s, char *out)
+{
+    __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(s));
+    if (sizeof(Unit) == 2)
+    {
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xFF80))), _mm_setzero_si128())) != 0xFFFF)
+            return false;
+
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(v, v));
+        return true;
+    }
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, _mm_set1_epi32(static_cast<int>(0xFFFFFF80))), _mm_setzero_si128())) != 0xFFFF)
+        return false;
+
+    __m128i const bytes = _mm_packus_epi16(_mm_packs_epi32(v, v), v);
+    int const word      = _mm_cvtsi128_si32(bytes);
+    memcpy(out, &word, 4);
+    return true;
+}
+
+template <typename Unit>
+SYSTEM_TARGET("sse2")
+static bool _UnitsToUtf8SSE2(Unit const *s, size_t len, char *out, size_t *written)
+{
+    size_t constexpr block = 16 / sizeof(Unit);
+    char *const begin      = out;
+    size_t i               = 0;
+    while (i + block <= len)
+    {
+        if (_NarrowAsciiSSE2(s + i, out))
+        {
+            out += block;
+            i += block;
+            continue;
+        }
+
+        // A surrogate pair may end past the block.
+        for (size_t const end = i + block; i < end;)
+        {
+            if (!_PutUtf8(out, _DecodeUnits(s, len, i)))
+                return false;
+        }
+    }
+
+    size_t tail;
+    if (!_UnitsToUtf8Scalar(s + i, len - i, out, &tail))
+        return false;
+
+    *written = (out - begin) + tail;
+    return true;
+}
+#elif defined(SYSTEM_SIMD_NEON)
+template <typename Unit>
+static size_t _Utf8ToUnitsNEON(uint8_t const *s, size_t len, Unit *out)
+{
+    Unit *const begin = out;
+    size_t i          = 0;
+    while (i + 16 <= len)
+    {
+        uint8x16_t const v = vld1q_u8(s + i);
+        if (NeonNibbleMask(vcltq_u8(v, vdupq_n_u8(0x80))) != ~uint64_t(0))
+        {
+            for (size_t const end = i + 16; i < end;)
+                out = _PutCodePoint(out, _DecodeUtf8(s, i));
+
+            continue;
+        }
+
+        uint16x8_t const low  = vmovl_u8(vget_low_u8(v));
+        uint16x8_t const high = vmovl_u8(vget_high_u8(v));
+        if (sizeof(Unit) == 2)
+        {
+            vst1q_u16(reinterpret_cast<uint16_t *>(out), low);
+            vst1q_u16(reinterpret_cast<uint16_t *>(out + 8), high);
+        }
+        else
+        {
+            vst1q_u32(reinterpret_cast<uint32_t *>(out), vmovl_u16(vget_low_u16(low)));
+            vst1q_u32(reinterpret_cast<uint32_t *>(out + 4), vmovl_u16(vget_high_u16(low)));
+            vst1q_u32(reinterpret_cast<uint32_t *>(out + 8), vmovl_u16(vget_low_u16(high)));
+            vst1q_u32(reinterpret_cast<uint32_t *>(out + 12), vmovl_u16(vget_high_u16(high)));
+        }
+
+        out += 16;
+        i += 16;
+    }
+
+    return (out - begin) + _Utf8ToUnitsScalar(s + i, len - i, out);
+}
+
+template <typename Unit>
+static bool _UnitsToUtf8NEON(Unit const *s, size_t len, char *out, size_t *written)
+{
+    size_t constexpr block = 16 / sizeof(Unit);
+    char *const begin      = out;
+    size_t i               = 0;
+    while (i + block <= len)
+    {
+        bool ascii;
+        if (sizeof(Unit) == 2)
+        {
+            uint16x8_t const v = vld1q_u16(reinterpret_cast<uint16_t const *>(s + i));
+            ascii              = vmaxvq_u16(v) < 0x80;
+            if (ascii)
+                vst1_u8(reinterpret_cast<uint8_t *>(out), vmovn_u16(v));
+        }
+        else
+        {
+            uint32x4_t const v = vld1q_u32(reinterpret_cast<uint32_t const *>(s + i));
+            ascii              = vmaxvq_u32(v) < 0x80;
+            if (ascii)
+            {
+                uint8x8_t const bytes = vmovn_u16(vcombine_u16(vmovn_u32(v), vmovn_u32(v)));
+                vst1_lane_u32(reinterpret_cast<uint32_t *>(out), vreinterpret_u32_u8(bytes), 0);
+            }
+        }
+
+        if (ascii)
+        {
+            out += block;
+            i += block;
+            continue;
+        }
+
+        for (size_t const end = i + block; i < end;)
+        {
+            if (!_PutUtf8(out, _DecodeUnits(s, len, i)))
+                return false;
+        }
+    }
+
+    size_t tail;
+    if (!_UnitsToUtf8Scalar(s + i, len - i, out, &tail))
+        return false;
+
+    *written = (out - begin) + tail;
+    return true;
+}
+#endif
+
+template <typename Unit>
+using utf8_to_units_t = size_t (*)(uint8_t const *, size_t, Unit *);
+
+template <typename Unit>
+using units_to_utf8_t = bool (*)(Unit const *, size_t, char *, size_t *);
+
+template <typename Unit>
+static utf8_to_units_t<Unit> _SelectUtf8ToUnits()
+{
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().AVX2)
+        return &_Utf8ToUnitsAVX2<Unit>;
+
+    if (GetSimdSupport().SSE2)
+        return &_Utf8ToUnitsSSE2<Unit>;
+#elif defined(SYSTEM_SIMD_NEON)
+    return &_Utf8ToUnitsNEON<Unit>;
+#endif
+    return &_Utf8ToUnitsScalar<Unit>;
+}
+
+template <typename Unit>
+static units_to_utf8_t<Unit> _SelectUnitsToUtf8()
+{
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().SSE2)
+        return &_UnitsToUtf8SSE2<Unit>;
+#elif defined(SYSTEM_SIMD_NEON)
+    return &_UnitsToUtf8NEON<Unit>;
+#endif
+    return &_UnitsToUtf8Scalar<Unit>;
+}
+
+///////////////////////////////////////////////////////////
+// Output lengths
+//
+// The lengths are exact for valid input. They are counted from the unit values alone, a conversion of invalid input
+// stops at the first error before it can write more than that.
+
+// Code points of UTF-8 are the bytes that are not continuations, UTF-16 needs a pair for the 4 bytes sequences.
+template <typename Unit>
+static size_t _Utf8UnitsLengthScalar(uint8_t const *s, size_t len)
+{
+    size_t length = 0;
+    size_t i      = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, s + i, sizeof(word));
+        length += 8 - PopCount(word & ~(word << 1) & 0x8080808080808080ull);
+        if (sizeof(Unit) == 2)
+            length += PopCount(word & (word << 1) & (word << 2) & (word << 3) & 0x8080808080808080ull);
+    }
+
+    for (; i < len; ++i)
+        length += ((s[i] & 0xC0) != 0x80) + (sizeof(Unit) == 2 && s[i] >= 0xF0);
+
+    return length;
+}
+
+#if defined(SYSTEM_SIMD_X86)
+// The byte counters get at most 2 per block, they are summed up every 127 blocks.
+template <typename Unit>
+SYSTEM_TARGET("sse2")
+static size_t _Utf8UnitsLengthSSE2(uint8_t const *s, size_t len)
+{
+    __m128i const zero          = _mm_setzero_si128();
+    __m128i const continuations = _mm_set1_epi8(-65);
+    __m128i const four_bytes    = _mm_set1_epi8(static_cast<char>(0xF0));
+    size_t length               = 0;
+    size_t i                    = 0;
+    while (i + 16 <= len)
+    {
+        __m128i counters = zero;
+        for (size_t blocks = 0; blocks < 127 && i + 16 <= len; ++blocks, i += 16)
+        {
+            __m128i const input = _mm_loadu_si128(reinterpret_cast<__m128i const *>(s + i));
+            counters            = _mm_sub_epi8(counters, _mm_cmpgt_epi8(input, continuations));
+            if (sizeof(Unit) == 2)
+                counters = _mm_sub_epi8(counters, _mm_cmpeq_epi8(_mm_max_epu8(input, four_bytes), input));
+        }
+
+        __m128i const sums = _mm_sad_epu8(counters, zero);
+        length += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+    }
+
+    return length + _Utf8UnitsLengthScalar<Unit>(s + i, len - i);
+}
+
+template <typename Unit>
+SYSTEM_TARGET("avx2")
+static size_t _Utf8UnitsLengthAVX2(uint8_t const *s, size_t len)
+{
+    __m256i const zero          = _mm256_setzero_si256();
+    __m256i const continuations = _mm256_set1_epi8(-65);
+    __m256i const four_bytes    = _mm256_set1_epi8(static_cast<char>(0xF0));
+    size_t length               = 0;
+    size_t i                    = 0;
+    while (i + 32 <= len)
+    {
+        __m256i counters = zero;
+        for (size_t blocks = 0; blocks < 127 && i + 32 <= len; ++blocks, i += 32)
+        {
+            __m256i const input = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(s + i));
+            counters            = _mm256_sub_epi8(counters, _mm256_cmpgt_epi8(input, continuations));
+            if (sizeof(Unit) == 2)
+                counters = _mm256_sub_epi8(counters, _mm256_cmpeq_epi8(_mm256_max_epu8(input, four_bytes), input));
+        }
+
+        __m256i const sums256 = _mm256_sad_epu8(counters, zero);
+        __m128i const sums    = _mm_add_epi64(_mm256_castsi256_si128(sums256), _mm256_extracti128_si256(sums256, 1));
+        length += _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums, sums));
+    }
+
+    return length + _Utf8UnitsLengthScalar<Unit>(s + i, len - i);
+}
+#elif defined(SYSTEM_SIMD_NEON) && defined(SYSTEM_ARCH_ARM64)
+template <typename Unit>
+static size_t _Utf8UnitsLengthNEON(uint8_t const *s, size_t len)
+{
+    int8x16_t const continuations = vdupq_n_s8(-65);
+    uint8x16_t const four_bytes   = vdupq_n_u8(0xF0);
+    size_t length                 = 0;
+    size_t i                      = 0;
+    while (i + 16 <= len)
+    {
+        uint8x16_t counters = vdupq_n_u8(0);
+        for (size_t blocks = 0; blocks < 127 && i + 16 <= len; ++blocks, i += 16)
+        {
+            uint8x16_t const input = vld1q_u8(s + i);
+            counters               = vsubq_u8(counters, vcgtq_s8(vreinterpretq_s8_u8(input), continuations));
+            if (sizeof(Unit) == 2)
+                counters = vsubq_u8(counters, vcgeq_u8(input, four_bytes));
+        }
+
+        length += vaddlvq_u8(counters);
+    }
+
+    return length + _Utf8UnitsLengthScalar<Unit>(s + i, len - i);
+}
+#endif
+
+// 1 byte below U+0080, 2 below U+0800, 3 for the rest of the BMP, a surrogate unit is half of a 4 bytes sequence.
+template <typename Unit>
+static size_t _UnitsUtf8LengthScalar(Unit const *s, size_t len)
+{
+    size_t length = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        uint32_t const unit = static_cast<uint32_t>(s[i]);
+        length += 1 + (unit >= 0x80) + (unit >= 0x800);
+        if (sizeof(Unit) == 2)
+            length -= (unit & 0xF800) == 0xD800;
+        else
+            length += unit >= 0x10000;
+    }
+
+    return length;
+}
+
+#if defined(SYSTEM_SIMD_X86)
+// Every lane counts 3 bytes minus one per comparison that matches, the 16 bits counters are summed up before they
+// can overflow.
+SYSTEM_TARGET("sse2")
+static size_t _Utf16Utf8LengthSSE2(char16_t const *s, size_t len)
+{
+    __m128i const zero       = _mm_setzero_si128();
+    __m128i const ascii      = _mm_set1_epi16(0x7F);
+    __m128i const two_bytes  = _mm_set1_epi16(0x7FF);
+    __m128i const high_mask  = _mm_set1_epi16(static_cast<short>(0xF800));
+    __m128i const surrogates = _mm_set1_epi16(static_cast<short>(0xD800));
+    size_t length            = 0;
+    size_t i                 = 0;
+    while (i + 8 <= len)
+    {
+        size_t const start = i;
+        __m128i counters   = zero;
+        for (size_t blocks = 0; blocks < 8192 && i + 8 <= len; ++blocks, i += 8)
+        {
+            __m128i const input = _mm_loadu_si128(reinterpret_cast<__m128i const *>(s + i));
+            __m128i const below_ascii     = _mm_cmpeq_epi16(_mm_subs_epu16(input, ascii), zero);
+            __m128i const below_two_bytes = _mm_cmpeq_epi16(_mm_subs_epu16(input, two_bytes), zero);
+            __m128i const surrogate       = _mm_cmpeq_epi16(_mm_and_si128(input, high_mask), surrogates);
+            counters = _mm_add_epi16(counters, _mm_add_epi16(_mm_add_epi16(below_ascii, below_two_bytes), surrogate));
+        }
+
+        __m128i sums = _mm_madd_epi16(counters, _mm_set1_epi16(1));
+        sums         = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+        sums         = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+        length += (i - start) * 3 + _mm_cvtsi128_si32(sums);
+    }
+
+    return length + _UnitsUtf8LengthScalar(s + i, len - i);
+}
+#endif
+
+static size_t _Utf8ToUtf16Length(std::string_view str)
+{
+    using length_t = size_t (*)(uint8_t const *, size_t);
+    static length_t const length = []() -> length_t {
+#if defined(SYSTEM_SIMD_X86)
+        if (GetSimdSupport().AVX2)
+            return &_Utf8UnitsLengthAVX2<char16_t>;
+
+        if (GetSimdSupport().SSE2)
+            return &_Utf8UnitsLengthSSE2<char16_t>;
+#elif defined(SYSTEM_SIMD_NEON) && defined(SYSTEM_ARCH_ARM64)
+        return &_Utf8UnitsLengthNEON<char16_t>;
+#endif
+        return &_Utf8UnitsLengthScalar<char16_t>;
+    }();
+
+    return length(reinterpret_cast<uint8_t const *>(str.data()), str.length());
+}
+
+static size_t _Utf8ToUtf32Length(std::string_view str)
+{
+    using length_t = size_t (*)(uint8_t const *, size_t);
+    static length_t const length = []() -> length_t {
+#if defined(SYSTEM_SIMD_X86)
+        if (GetSimdSupport().AVX2)
+            return &_Utf8UnitsLengthAVX2<char32_t>;
+
+        if (GetSimdSupport().SSE2)
+            return &_Utf8UnitsLengthSSE2<char32_t>;
+#elif defined(SYSTEM_SIMD_NEON) && defined(SYSTEM_ARCH_ARM64)
+        return &_Utf8UnitsLengthNEON<char32_t>;
+#endif
+        return &_Utf8UnitsLengthScalar<char32_t>;
+    }();
+
+    return length(reinterpret_cast<uint8_t const *>(str.data()), str.length());
+}
+
+static size_t _Utf16ToUtf8Length(std::u16string_view str)
+{
+#if defined(SYSTEM_SIMD_X86)
+    static bool const sse2 = GetSimdSupport().SSE2;
+    if (sse2)
+        return _Utf16Utf8LengthSSE2(str.data(), str.length());
+#endif
+    return _UnitsUtf8LengthScalar(str.data(), str.length());
+}
+
+static size_t _Utf32ToUtf8Length(std::u32string_view str)
+{
+    return _UnitsUtf8LengthScalar(str.data(), str.length());
+}
+
+template <typename Unit>
+static size_t _Utf8ToUnitsLength(std::string_view str)
+{
+    return sizeof(Unit) == 2 ? _Utf8ToUtf16Length(str) : _Utf8ToUtf32Length(str);
+}
+
+template <typename Unit>
+static size_t _UnitsToUtf8Length(std::basic_string_view<Unit> str)
+{
+    if (sizeof(Unit) == 2)
+        return _Utf16ToUtf8Length(std::u16string_view(reinterpret_cast<char16_t const *>(str.data()), str.length()));
+
+    return _Utf32ToUtf8Length(std::u32string_view(reinterpret_cast<char32_t const *>(str.data()), str.length()));
+}
+
+///////////////////////////////////////////////////////////
+// Conversions to caller buffers
+//
+// Valid input that fits goes through the vector kernels. Otherwise the checked loops convert code point by code
+// point, up to the first error or the first code point that doesn't fit.
+
+template <typename Unit>
+static ConvertResult _Utf8ToUnitsChecked(uint8_t const *s, size_t len, Unit *out, size_t size)
+{
+    size_t i       = 0;
+    size_t written = 0;
+    while (i < len)
+    {
+        if (i + 8 <= len && written + 8 <= size && _IsAsciiWord(s + i))
+        {
+            for (size_t j = 0; j < 8; ++j)
+                out[written + j] = static_cast<Unit>(s[i + j]);
+
+            written += 8;
+            i += 8;
+            continue;
+        }
+
+        size_t length;
+        switch (_CheckUtf8Sequence(s + i, len - i, length))
+        {
+            case Utf8Sequence::Invalid   : return { written, i, ConvertError::InvalidSequence };
+            case Utf8Sequence::Incomplete: return { written, i, ConvertError::Incomplete };
+            case Utf8Sequence::Valid     : break;
+        }
+
+        size_t const units = (sizeof(Unit) == 2 && length == 4) ? 2 : 1;
+        if (written + units > size)
+            return { written, i, ConvertError::OutputTooSmall };
+
+        _PutCodePoint(out + written, _DecodeUtf8(s, i));
+        written += units;
+    }
+
+    return { written, i, ConvertError::None };
+}
+
+template <typename Unit>
+static ConvertResult _UnitsToUtf8Checked(Unit const *s, size_t len, char *out, size_t size)
+{
+    size_t i       = 0;
+    size_t written = 0;
+    while (i < len)
+    {
+        uint32_t const unit = static_cast<uint32_t>(s[i]);
+        if (sizeof(Unit) == 2 && unit >= 0xD800 && unit <= 0xDBFF && i + 1 == len)
+            return { written, i, ConvertError::Incomplete };
+
+        size_t next               = i;
+        uint32_t const code_point = _DecodeUnits(s, len, next);
+        size_t const bytes        = code_point < 0x80 ? 1 : code_point < 0x800 ? 2 : code_point < 0x10000 ? 3 : 4;
+        if (code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF))
+            return { written, i, ConvertError::InvalidSequence };
+
+        if (written + bytes > size)
+            return { written, i, ConvertError::OutputTooSmall };
+
+        char *p = out + written;
+        _PutUtf8(p, code_point);
+        written += bytes;
+        i = next;
+    }
+
+    return { written, i, ConvertError::None };
+}
+
+template <typename Unit>
+static ConvertResult _ConvertUtf8ToUnits(std::string_view src, Unit *dst, size_t dst_size)
+{
+    auto const s = reinterpret_cast<uint8_t const *>(src.data());
+    // Short strings take one pass in the checked loop rather than three.
+    if (src.length() >= 64 && _IsValidUtf8(src))
+    {
+        size_t const length = _Utf8ToUnitsLength<Unit>(src);
+        if (length <= dst_size)
+        {
+            static utf8_to_units_t<Unit> const convert = _SelectUtf8ToUnits<Unit>();
+            convert(s, src.length(), dst);
+            return { length, src.length(), ConvertError::None };
+        }
+    }
+
+    return _Utf8ToUnitsChecked(s, src.length(), dst, dst_size);
+}
+
+template <typename Unit>
+static ConvertResult _ConvertUnitsToUtf8(std::basic_string_view<Unit> src, char *dst, size_t dst_size)
+{
+    // The kernel stops at the first error, the checked loop then writes the same valid prefix again.
+    if (src.length() >= 64 && _UnitsToUtf8Length(src) <= dst_size)
+    {
+        size_t written;
+        static units_to_utf8_t<Unit> const convert = _SelectUnitsToUtf8<Unit>();
+        if (convert(src.data(), src.length(), dst, &written))
+            return { written, src.length(), ConvertError::None };
+    }
+
+    return _UnitsToUtf8Checked(src.data(), src.length(), dst, dst_size);
+}
+
+///////////////////////////////////////////////////////////
+// Streams
+
+// Longest sequence of the input encoding, the carry holds one less.
+template <typename Unit>
+static constexpr size_t _MaxSequence = sizeof(Unit) == 1 ? 4 : sizeof(Unit) == 2 ? 2 : 1;
+
+// Output units of an input unit, replacement characters included.
+template <typename InputUnit>
+static constexpr size_t _MaxOutput = sizeof(InputUnit) == 1 ? 1 : sizeof(InputUnit) == 2 ? 3 : 4;
+
+template <typename InputUnit, typename OutputUnit>
+static size_t _StreamLength(std::basic_string_view<InputUnit> src)
+{
+    if constexpr (sizeof(InputUnit) == 1)
+        return _Utf8ToUnitsLength<OutputUnit>(src);
+    else
+        return _UnitsToUtf8Length(src);
+}
+
+template <typename InputUnit, typename OutputUnit>
+static ConvertResult _StreamConvert(std::basic_string_view<InputUnit> src, OutputUnit *dst, size_t dst_size)
+{
+    if constexpr (sizeof(InputUnit) == 1)
+        return _ConvertUtf8ToUnits(src, dst, dst_size);
+    else
+        return _ConvertUnitsToUtf8(src, dst, dst_size);
+}
+
+// Units of the maximal invalid subpart at s[0], a UTF-16 or UTF-32 error is always one unit.
+template <typename Unit>
+static size_t _InvalidLength(Unit const *s, size_t len)
+{
+    size_t length = 1;
+    if constexpr (sizeof(Unit) == 1)
+        _CheckUtf8Sequence(reinterpret_cast<uint8_t const *>(s), len, length);
+
+    return length;
+}
+
+// Units of the sequence cut by the end of s, 0 when the last one is whole or invalid.
+template <typename Unit>
+static size_t _IncompleteTail(Unit const *s, size_t len)
+{
+    if constexpr (sizeof(Unit) == 1)
+    {
+        auto const bytes = reinterpret_cast<uint8_t const *>(s);
+        for (size_t tail = 1; tail < 4 && tail <= len; ++tail)
+        {
+            if ((bytes[len - tail] & 0xC0) != 0x80)
+            {
+                size_t length;
+                return _CheckUtf8Sequence(bytes + len - tail, tail, length) == Utf8Sequence::Incomplete ? tail : 0;
+            }
+        }
+
+        return 0;
+    }
+    else
+    {
+        return sizeof(Unit) == 2 && len != 0 && (static_cast<uint32_t>(s[len - 1]) & 0xFC00) == 0xD800 ? 1 : 0;
+    }
+}
+
+template <typename Unit>
+static void _AppendReplacement(std::basic_string<Unit> &out)
+{
+    if constexpr (sizeof(Unit) == 1)
+        out.append("\xEF\xBF\xBD");
+    else
+        out.push_back(static_cast<Unit>(0xFFFD));
+}
+
+// Invalid input goes through utfcpp, which throws the same exceptions as before.
+template <typename String>
+static String _Utf8ToUnits(std::string_view str)
+{
+    using Unit = typename String::value_type;
+    String r;
+    if (!_IsValidUtf8(str))
+    {
+        if (sizeof(Unit) == 2)
+            utf8::utf8to16(str.begin(), str.end(), std::back_inserter(r));
+        else
+            utf8::utf8to32(str.begin(), str.end(), std::back_inserter(r));
+
+        return r;
+    }
+
+    r.resize(_Utf8ToUnitsLength<Unit>(str));
+    static utf8_to_units_t<Unit> const convert = _SelectUtf8ToUnits<Unit>();
+    convert(reinterpret_cast<uint8_t const *>(str.data()), str.length(), &r[0]);
+    return r;
+}
+
+template <typename Unit>
+static std::string _UnitsToUtf8(std::basic_string_view<Unit> str)
+{
+    std::string r;
+    r.resize(_UnitsToUtf8Length(str));
+    size_t written;
+    static units_to_utf8_t<Unit> const convert = _SelectUnitsToUtf8<Unit>();
+    if (!convert(str.data(), str.length(), &r[0], &written))
+    {
+        r.clear();
+        if (sizeof(Unit) == 2)
+            utf8::utf16to8(str.begin(), str.end(), std::back_inserter(r));
+        else
+            utf8::utf32to8(str.begin(), str.end(), std::back_inserter(r));
+
+        return r;
+    }
+
+    return r;
+}
+
 template <typename T, size_t s = sizeof(typename T::value_type)> struct string_deducer
+
 {
     static std::string convert_string(T const &str)   = delete;
     static std::wstring convert_wstring(T const &str) = delete;
@@ -55,173 +1205,742 @@ template <typename T> struct string_deducer<T, 1>
     }
 };
 
-template <typename T> struct string_deducer<T, 2>
+template <typename T> struct string_deducer<T, 2>
+{
+    static std::string convert_string(T const &str) { return _UnitsToUtf8(std::basic_string_view<typename T::value_type>(str.data(), str.size())); }
+
+    static std::wstring convert_wstring(std::string const &str) { return _Utf8ToUnits<std::wstring>(str); }
+
+    static std::wstring convert_wstring(std::string_view str) { return _Utf8ToUnits<std::wstring>(str); }
+};
+
+template <typename T> struct string_deducer<T, 4>
+{
+    static std::string convert_string(T const &str) { return _UnitsToUtf8(std::basic_string_view<typename T::value_type>(str.data(), str.size())); }
+
+    static std::wstring convert_wstring(std::string const &str) { return _Utf8ToUnits<std::wstring>(str); }
+
+    static std::wstring convert_wstring(std::string_view str) { return _Utf8ToUnits<std::wstring>(str); }
+};
+} // namespace details
+
+std::wstring Utf8ToWChar(std::string const &str)
+{
+    return details::string_deducer<std::wstring>::convert_wstring(str);
+}
+
+std::wstring Utf8ToWChar(std::string_view str)
+{
+    return details::string_deducer<std::wstring>::convert_wstring(str);
+}
+
+std::u16string Utf8ToUtf16(std::string const &str)
+{
+    return details::_Utf8ToUnits<std::u16string>(str);
+}
+
+std::u32string Utf8ToUtf32(std::string const &str)
+{
+    return details::_Utf8ToUnits<std::u32string>(str);
+}
+
+std::u16string Utf8ToUtf16(std::string_view str)
+{
+    return details::_Utf8ToUnits<std::u16string>(str);
+}
+
+std::u32string Utf8ToUtf32(std::string_view str)
+{
+    return details::_Utf8ToUnits<std::u32string>(str);
+}
+
+std::string WCharToUtf8(std::wstring const &str)
+{
+    return details::string_deducer<std::wstring>::convert_string(str);
+}
+
+std::string WCharToUtf8(std::wstring_view str)
+{
+    return details::string_deducer<std::wstring_view>::convert_string(str);
+}
+
+std::string Utf16ToUtf8(std::u16string const &str)
+{
+    return details::_UnitsToUtf8(std::u16string_view(str));
+}
+
+std::string Utf32ToUtf8(std::u32string const &str)
+{
+    return details::_UnitsToUtf8(std::u32string_view(str));
+}
+
+std::string Utf16ToUtf8(std::u16string_view str)
+{
+    return details::_UnitsToUtf8(str);
+}
+
+std::string Utf32ToUtf8(std::u32string_view str)
+{
+    return details::_UnitsToUtf8(str);
+}
+
+bool IsValidUtf8(std::string_view str)
+{
+    return details::_IsValidUtf8(str);
+}
+
+size_t EncodedLength(std::string_view str)
+{
+    if (!details::_IsValidUtf8(str))
+        return utf8::distance(str.begin(), str.end());
+
+    // Every byte but the continuations starts a code point.
+    auto const s        = reinterpret_cast<uint8_t const *>(str.data());
+    size_t continuations = 0;
+    size_t i            = 0;
+    for (; i + 8 <= str.length(); i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, s + i, sizeof(word));
+        continuations += PopCount(word & ~(word << 1) & 0x8080808080808080ull);
+    }
+
+    for (; i < str.length(); ++i)
+        continuations += (s[i] & 0xC0) == 0x80;
+
+    return str.length() - continuations;
+}
+
+size_t Utf8ToWCharLength(std::string_view str)
+{
+    return details::_Utf8ToUnitsLength<wchar_t>(str);
+}
+
+size_t Utf8ToUtf16Length(std::string_view str)
+{
+    return details::_Utf8ToUtf16Length(str);
+}
+
+size_t Utf8ToUtf32Length(std::string_view str)
+{
+    return details::_Utf8ToUtf32Length(str);
+}
+
+size_t WCharToUtf8Length(std::wstring_view str)
+{
+    return details::_UnitsToUtf8Length(str);
+}
+
+size_t Utf16ToUtf8Length(std::u16string_view str)
+{
+    return details::_Utf16ToUtf8Length(str);
+}
+
+size_t Utf32ToUtf8Length(std::u32string_view str)
+{
+    return details::_Utf32ToUtf8Length(str);
+}
+
+ConvertResult Convert(std::string_view src, wchar_t *dst, size_t dst_size)
+{
+    return details::_ConvertUtf8ToUnits(src, dst, dst_size);
+}
+
+ConvertResult Convert(std::string_view src, char16_t *dst, size_t dst_size)
+{
+    return details::_ConvertUtf8ToUnits(src, dst, dst_size);
+}
+
+ConvertResult Convert(std::string_view src, char32_t *dst, size_t dst_size)
+{
+    return details::_ConvertUtf8ToUnits(src, dst, dst_size);
+}
+
+ConvertResult Convert(std::wstring_view src, char *dst, size_t dst_size)
+{
+    return details::_ConvertUnitsToUtf8(src, dst, dst_size);
+}
+
+ConvertResult Convert(std::u16string_view src, char *dst, size_t dst_size)
+{
+    return details::_ConvertUnitsToUtf8(src, dst, dst_size);
+}
+
+ConvertResult Convert(std::u32string_view src, char *dst, size_t dst_size)
+{
+    return details::_ConvertUnitsToUtf8(src, dst, dst_size);
+}
+
+template <typename InputUnit, typename OutputUnit>
+StreamTranscoder<InputUnit, OutputUnit>::StreamTranscoder(ErrorPolicy policy) :
+    _Policy(policy),
+    _Carry{},
+    _CarryLength(0),
+    _Failed(false),
+    _Position(0)
+{
+}
+
+template <typename InputUnit, typename OutputUnit>
+bool StreamTranscoder<InputUnit, OutputUnit>::_Invalid(size_t length, std::basic_string<OutputUnit> &out)
+{
+    if (_Policy == ErrorPolicy::Strict)
+    {
+        _Failed = true;
+        return false;
+    }
+
+    details::_AppendReplacement(out);
+    _Position += length;
+    return true;
+}
+
+template <typename InputUnit, typename OutputUnit>
+bool StreamTranscoder<InputUnit, OutputUnit>::Write(std::basic_string_view<InputUnit> chunk, std::basic_string<OutputUnit> &out)
+{
+    if (_Failed)
+        return false;
+
+    // Complete the carried sequence with the first units of the chunk, the carry is a valid prefix of a sequence.
+    if (_CarryLength != 0)
+    {
+        InputUnit input[details::_MaxSequence<InputUnit> * 2];
+        size_t const carried = _CarryLength;
+        size_t const taken   = std::min(chunk.length(), details::_MaxSequence<InputUnit> - 1);
+        std::copy(_Carry, _Carry + carried, input);
+        std::copy(chunk.data(), chunk.data() + taken, input + carried);
+
+        OutputUnit output[details::_MaxSequence<InputUnit> * 2 * details::_MaxOutput<InputUnit>];
+        ConvertResult const result = details::_StreamConvert(std::basic_string_view<InputUnit>(input, carried + taken), output, sizeof(output) / sizeof(*output));
+        size_t consumed = result.Consumed;
+        if (consumed == 0 && result.Error == ConvertError::Incomplete)
+        {
+            // The chunk is too short to end the sequence.
+            std::copy(chunk.data(), chunk.data() + taken, _Carry + carried);
+            _CarryLength = static_cast<uint8_t>(carried + taken);
+            return true;
+        }
+
+        _CarryLength = 0;
+        if (consumed == 0)
+        {
+            consumed = details::_InvalidLength(input, carried + taken);
+            // Position is where the sequence started, in a previous chunk.
+            if (!_Invalid(consumed, out))
+                return false;
+        }
+        else
+        {
+            out.append(output, result.Written);
+            _Position += consumed;
+        }
+
+        chunk.remove_prefix(consumed - carried);
+    }
+
+    // Carry the cut sequence now, the conversion of a chunk that doesn't end on one is not vectorised.
+    size_t const tail = details::_IncompleteTail(chunk.data(), chunk.length());
+    std::copy(chunk.end() - tail, chunk.end(), _Carry);
+    _CarryLength = static_cast<uint8_t>(tail);
+    chunk.remove_suffix(tail);
+
+    // Sized for valid input, a replacement can need more.
+    size_t written = out.size();
+    out.resize(written + details::_StreamLength<InputUnit, OutputUnit>(chunk));
+    while (!chunk.empty())
+    {
+        ConvertResult const result = details::_StreamConvert(chunk, &out[0] + written, out.size() - written);
+        written += result.Written;
+        _Position += result.Consumed;
+        chunk.remove_prefix(result.Consumed);
+        if (result.Error == ConvertError::Incomplete && tail == 0)
+        {
+            std::copy(chunk.begin(), chunk.end(), _Carry);
+            _CarryLength = static_cast<uint8_t>(chunk.length());
+            break;
+        }
+
+        // A sequence cut by the carried one is invalid, all of what is left is its maximal subpart.
+        if (result.Error == ConvertError::InvalidSequence || result.Error == ConvertError::Incomplete)
+        {
+            size_t const length = result.Error == ConvertError::Incomplete ? chunk.length() : details::_InvalidLength(chunk.data(), chunk.length());
+            out.resize(written);
+            if (!_Invalid(length, out))
+                return false;
+
+            chunk.remove_prefix(length);
+            written = out.size();
+            out.resize(written + chunk.length() * details::_MaxOutput<InputUnit>);
+        }
+        else if (result.Error == ConvertError::OutputTooSmall)
+        {
+            out.resize(written + chunk.length() * details::_MaxOutput<InputUnit>);
+        }
+    }
+
+    out.resize(written);
+    return true;
+}
+
+template <typename InputUnit, typename OutputUnit>
+bool StreamTranscoder<InputUnit, OutputUnit>::Finish(std::basic_string<OutputUnit> &out)
+{
+    if (_Failed)
+        return false;
+
+    if (_CarryLength == 0)
+        return true;
+
+    size_t const length = _CarryLength;
+    _CarryLength        = 0;
+    return _Invalid(length, out);
+}
+
+template <typename InputUnit, typename OutputUnit>
+void StreamTranscoder<InputUnit, OutputUnit>::Reset()
+{
+    _CarryLength = 0;
+    _Failed      = false;
+    _Position    = 0;
+}
+
+template class StreamTranscoder<char, wchar_t>;
+template class StreamTranscoder<char, char16_t>;
+template class StreamTranscoder<char, char32_t>;
+template class StreamTranscoder<wchar_t, char>;
+template class StreamTranscoder<char16_t, char>;
+template class StreamTranscoder<char32_t, char>;
+
+namespace Base64
+{
+
+static char constexpr Base64Alphabet[]       = {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"};
+static signed char constexpr Base64Inverse[] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //   0-15
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //  16-31
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63, //  32-47
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1, //  48-63
+    -1, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, //  64-79
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1, //  80-95
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, //  96-111
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1, // 112-127
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 128-143
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 144-159
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 160-175
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 176-191
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 192-207
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 208-223
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 224-239
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1  // 240-255
+};
+
+static char constexpr Base64UrlAlphabet[]       = {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"};
+static signed char constexpr Base64UrlInverse[] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //   0-15
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //  16-31
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, //  32-47
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1, //  48-63
+    -1, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, //  64-79
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63, //  80-95
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, //  96-111
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1, // 112-127
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 128-143
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 144-159
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 160-175
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 176-191
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 192-207
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 208-223
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 224-239
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1  // 240-255
+};
+
+// Vector kernels, after Muła and Lemire: "Faster Base64 Encoding and Decoding Using AVX2 Instructions" and
+// "Base64 encoding and decoding at almost the speed of a memory copy". They convert whole blocks, the scalar loops
+// do the rest. A decoding block stops at the first character that is not in the alphabet, padding included.
+struct Base64Tables
+{
+    char const *Alphabet;
+    signed char const *Inverse;
+    // Added to the 6 bits values, by range: A-Z, a-z, 0-9 and the two last characters.
+    int8_t EncodeOffsets[16];
+    // A character is invalid when the bits of its low and high nibbles intersect.
+    uint8_t DecodeLow[16];
+    uint8_t DecodeHigh[16];
+    // Added to the characters by high nibble, the last character of the alphabet is moved to nibble 1.
+    int8_t DecodeRoll[16];
+    char Special;
+    int8_t SpecialShift;
+    // The values of the ASCII characters, 0x80 when invalid.
+    uint8_t DecodeAscii[128];
+};
+
+static Base64Tables _MakeTables(char const *alphabet, signed char const *inverse)
 {
-    static std::string convert_string(T const &str)
+    Base64Tables tables{};
+    tables.Alphabet = alphabet;
+    tables.Inverse  = inverse;
+
+    int8_t const offsets[16] = {
+        'A', 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        static_cast<int8_t>(alphabet[62] - 62), static_cast<int8_t>(alphabet[63] - 63), 0, 0,
+    };
+    memcpy(tables.EncodeOffsets, offsets, sizeof(offsets));
+
+    // One bit per distinct set of valid low nibbles, there are 8 at most for the alphabets we have.
+    uint16_t columns[16] = {};
+    for (int c = 0; c < 128; ++c)
     {
-        std::string r;
-        utf8::utf16to8(std::begin(str), std::end(str), std::back_inserter(r));
-        return r;
+        if (inverse[c] >= 0)
+            columns[c >> 4] |= 1 << (c & 0x0F);
     }
 
-    static std::wstring convert_wstring(std::string const &str)
+    uint16_t classes[8];
+    int class_count = 0;
+    for (int high = 0; high < 16; ++high)
     {
-        std::wstring r;
-        utf8::utf8to16(std::begin(str), std::end(str), std::back_inserter(r));
-        return r;
+        int i = 0;
+        while (i < class_count && classes[i] != columns[high])
+            ++i;
+
+        if (i == class_count)
+            classes[class_count++] = columns[high];
+
+        tables.DecodeHigh[high] = static_cast<uint8_t>(1 << i);
+        for (int low = 0; low < 16; ++low)
+        {
+            if (!(columns[high] & (1 << low)))
+                tables.DecodeLow[low] |= static_cast<uint8_t>(1 << i);
+        }
     }
 
-    static std::wstring convert_wstring(std::string_view str)
+    tables.Special      = alphabet[63];
+    tables.SpecialShift = static_cast<int8_t>(1 - (static_cast<uint8_t>(alphabet[63]) >> 4));
+    for (int c = 0; c < 128; ++c)
     {
-        std::wstring r;
-        utf8::utf8to16(std::begin(str), std::end(str), std::back_inserter(r));
-        return r;
+        if (inverse[c] >= 0 && c != tables.Special)
+            tables.DecodeRoll[c >> 4] = static_cast<int8_t>(inverse[c] - c);
+
+        tables.DecodeAscii[c] = inverse[c] < 0 ? 0x80 : static_cast<uint8_t>(inverse[c]);
     }
-};
+    tables.DecodeRoll[1] = static_cast<int8_t>(63 - tables.Special);
 
-template <typename T> struct string_deducer<T, 4>
+    return tables;
+}
+
+static Base64Tables const &_StandardTables()
 {
-    static std::string convert_string(T const &str)
-    {
-        std::string r;
-        utf8::utf32to8(std::begin(str), std::end(str), std::back_inserter(r));
-        return r;
-    }
+    static Base64Tables const tables = _MakeTables(Base64Alphabet, Base64Inverse);
+    return tables;
+}
 
-    static std::wstring convert_wstring(std::string const &str)
-    {
-        std::wstring r;
-        utf8::utf8to32(std::begin(str), std::end(str), std::back_inserter(r));
-        return r;
-    }
+static Base64Tables const &_UrlTables()
+{
+    static Base64Tables const tables = _MakeTables(Base64UrlAlphabet, Base64UrlInverse);
+    return tables;
+}
 
-    static std::wstring convert_wstring(std::string_view str)
-    {
-        std::wstring r;
-        utf8::utf8to32(std::begin(str), std::end(str), std::back_inserter(r));
-        return r;
-    }
-};
-} // namespace details
+// The kernels return the count of input bytes they converted: whole groups of 3 bytes, or of 4 characters. The wider
+// ones hand their tail to the narrower ones.
+using encode_blocks_t = size_t (*)(uint8_t const *, size_t, char *, Base64Tables const &);
+using decode_blocks_t = size_t (*)(uint8_t const *, size_t, uint8_t *, Base64Tables const &);
 
-std::wstring Utf8ToWChar(std::string const &str)
+static size_t _EncodeBlocksScalar(uint8_t const *, size_t, char *, Base64Tables const &)
 {
-    return details::string_deducer<std::wstring>::convert_wstring(str);
+    return 0;
 }
 
-std::wstring Utf8ToWChar(std::string_view str)
+static size_t _DecodeBlocksScalar(uint8_t const *, size_t, uint8_t *, Base64Tables const &)
 {
-    return details::string_deducer<std::wstring>::convert_wstring(str);
+    return 0;
 }
 
-std::u16string Utf8ToUtf16(std::string const &str)
+#if defined(SYSTEM_SIMD_X86)
+// 12 bytes in the low lanes of input to 16 values of 6 bits.
+SYSTEM_TARGET("ssse3")
+static inline __m128i _SplitSSSE3(__m128i input)
 {
-    return utf8::utf8to16(str);
+    input            = _mm_shuffle_epi8(input, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i const t0 = _mm_mulhi_epu16(_mm_and_si128(input, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    __m128i const t1 = _mm_mullo_epi16(_mm_and_si128(input, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
 }
 
-std::u32string Utf8ToUtf32(std::string const &str)
+SYSTEM_TARGET("ssse3")
+static inline __m128i _TranslateSSSE3(__m128i values, __m128i offsets)
 {
-    return utf8::utf8to32(str);
+    __m128i const ranges = _mm_sub_epi8(_mm_subs_epu8(values, _mm_set1_epi8(51)), _mm_cmpgt_epi8(values, _mm_set1_epi8(25)));
+    return _mm_add_epi8(values, _mm_shuffle_epi8(offsets, ranges));
 }
 
-std::u16string Utf8ToUtf16(std::string_view str)
+SYSTEM_TARGET("ssse3")
+static size_t _EncodeBlocksSSSE3(uint8_t const *in, size_t len, char *out, Base64Tables const &tables)
 {
-    return utf8::utf8to16(str);
+    __m128i const offsets = _mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.EncodeOffsets));
+    size_t i              = 0;
+    for (; i + 16 <= len; i += 12, out += 16)
+    {
+        __m128i const values = _SplitSSSE3(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _TranslateSSSE3(values, offsets));
+    }
+
+    return i;
 }
 
-std::u32string Utf8ToUtf32(std::string_view str)
+// 16 characters to their values, false when one of them is not in the alphabet.
+SYSTEM_TARGET("ssse3")
+static inline bool _ValuesSSSE3(__m128i input, Base64Tables const &tables, __m128i &values)
 {
-    return utf8::utf8to32(str);
+    __m128i const high = _mm_and_si128(_mm_srli_epi32(input, 4), _mm_set1_epi8(0x0F));
+    __m128i const low  = _mm_and_si128(input, _mm_set1_epi8(0x0F));
+    __m128i const bits = _mm_and_si128(_mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.DecodeLow)), low),
+                                       _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.DecodeHigh)), high));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128())) != 0xFFFF)
+        return false;
+
+    __m128i const special = _mm_and_si128(_mm_cmpeq_epi8(input, _mm_set1_epi8(tables.Special)), _mm_set1_epi8(tables.SpecialShift));
+    __m128i const roll    = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.DecodeRoll)), _mm_add_epi8(high, special));
+    values                = _mm_add_epi8(input, roll);
+    return true;
 }
 
-std::string WCharToUtf8(std::wstring const &str)
+// 16 values of 6 bits to 12 bytes, in the low lanes.
+SYSTEM_TARGET("ssse3")
+static inline __m128i _PackSSSE3(__m128i values)
 {
-    return details::string_deducer<std::wstring>::convert_string(str);
+    __m128i const merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i const packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
 }
 
-std::string WCharToUtf8(std::wstring_view str)
+SYSTEM_TARGET("ssse3")
+static size_t _DecodeBlocksSSSE3(uint8_t const *in, size_t len, uint8_t *out, Base64Tables const &tables)
 {
-    return details::string_deducer<std::wstring_view>::convert_string(str);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16, out += 12)
+    {
+        __m128i values;
+        if (!_ValuesSSSE3(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i)), tables, values))
+            break;
+
+        // Exactly 12 bytes, the caller buffer may end there.
+        __m128i const bytes = _PackSSSE3(values);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out), bytes);
+        uint32_t const last = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(bytes, 8)));
+        memcpy(out + 8, &last, sizeof(last));
+    }
+
+    return i;
 }
 
-std::string Utf16ToUtf8(std::u16string const &str)
+SYSTEM_TARGET("avx2")
+static size_t _EncodeBlocksAVX2(uint8_t const *in, size_t len, char *out, Base64Tables const &tables)
 {
-    return utf8::utf16to8(str);
+    __m256i const shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    __m256i const offsets = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.EncodeOffsets)));
+    size_t i              = 0;
+    for (; i + 28 <= len; i += 24, out += 32)
+    {
+        __m256i input = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i))),
+                                                _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i + 12)), 1);
+        input            = _mm256_shuffle_epi8(input, shuffle);
+        __m256i const t0 = _mm256_mulhi_epu16(_mm256_and_si256(input, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+        __m256i const t1 = _mm256_mullo_epi16(_mm256_and_si256(input, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+        __m256i const values = _mm256_or_si256(t0, t1);
+        __m256i const ranges = _mm256_sub_epi8(_mm256_subs_epu8(values, _mm256_set1_epi8(51)), _mm256_cmpgt_epi8(values, _mm256_set1_epi8(25)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_add_epi8(values, _mm256_shuffle_epi8(offsets, ranges)));
+    }
+
+    // The SSSE3 kernel is not VEX encoded, it stalls on dirty upper halves.
+    _mm256_zeroupper();
+    return i + _EncodeBlocksSSSE3(in + i, len - i, out, tables);
 }
 
-std::string Utf32ToUtf8(std::u32string const &str)
+SYSTEM_TARGET("avx2")
+static size_t _DecodeBlocksAVX2(uint8_t const *in, size_t len, uint8_t *out, Base64Tables const &tables)
 {
-    return utf8::utf32to8(str);
+    __m256i const decode_low  = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.DecodeLow)));
+    __m256i const decode_high = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.DecodeHigh)));
+    __m256i const decode_roll = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const *>(tables.DecodeRoll)));
+    __m256i const special     = _mm256_set1_epi8(tables.Special);
+    __m256i const shift       = _mm256_set1_epi8(tables.SpecialShift);
+    __m256i const nibble      = _mm256_set1_epi8(0x0F);
+    __m256i const pack        = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i                  = 0;
+    for (; i + 32 <= len; i += 32, out += 24)
+    {
+        __m256i const input = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(in + i));
+        __m256i const high  = _mm256_and_si256(_mm256_srli_epi32(input, 4), nibble);
+        __m256i const bits  = _mm256_and_si256(_mm256_shuffle_epi8(decode_low, _mm256_and_si256(input, nibble)), _mm256_shuffle_epi8(decode_high, high));
+        if (!_mm256_testz_si256(bits, bits))
+            break;
+
+        __m256i const roll   = _mm256_shuffle_epi8(decode_roll, _mm256_add_epi8(high, _mm256_and_si256(_mm256_cmpeq_epi8(input, special), shift)));
+        __m256i const values = _mm256_add_epi8(input, roll);
+        __m256i const merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        __m256i const packed = _mm256_shuffle_epi8(_mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000)), pack);
+        __m256i const bytes  = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm256_castsi256_si128(bytes));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 16), _mm256_extracti128_si256(bytes, 1));
+    }
+
+    // The SSSE3 kernel is not VEX encoded, it stalls on dirty upper halves.
+    _mm256_zeroupper();
+    return i + _DecodeBlocksSSSE3(in + i, len - i, out, tables);
 }
 
-std::string Utf16ToUtf8(std::u16string_view str)
+// 48 bytes to 64 characters: a byte permutation, a multishift to gather the 6 bits values and a permutation through
+// the alphabet. The AVX2 kernel takes the tail. The maskz forms with every lane set compile to the plain instructions,
+// the unmasked intrinsics pass an uninitialized vector GCC warns about.
+SYSTEM_TARGET("avx512f,avx512bw,avx512vbmi,avx2")
+static size_t _EncodeBlocksAVX512VBMI(uint8_t const *in, size_t len, char *out, Base64Tables const &tables)
 {
-    return utf8::utf16to8(str);
+    __m512i const shuffle = _mm512_setr_epi32(0x01020001, 0x04050304, 0x07080607, 0x0A0B090A, 0x0D0E0C0D, 0x10110F10, 0x13141213, 0x16171516,
+                                              0x191A1819, 0x1C1D1B1C, 0x1F201E1F, 0x22232122, 0x25262425, 0x28292728, 0x2B2C2A2B, 0x2E2F2D2E);
+    __m512i const shifts   = _mm512_set1_epi64(0x3036242A1016040A);
+    __m512i const alphabet = _mm512_loadu_si512(tables.Alphabet);
+    __mmask64 const lanes  = ~__mmask64(0);
+    size_t i               = 0;
+    for (; i + 64 <= len; i += 48, out += 64)
+    {
+        __m512i const input  = _mm512_maskz_permutexvar_epi8(lanes, shuffle, _mm512_loadu_si512(in + i));
+        __m512i const values = _mm512_maskz_multishift_epi64_epi8(lanes, shifts, input);
+        _mm512_storeu_si512(out, _mm512_maskz_permutexvar_epi8(lanes, values, alphabet));
+    }
+
+    return i + _EncodeBlocksAVX2(in + i, len - i, out, tables);
 }
 
-std::string Utf32ToUtf8(std::u32string_view str)
+// 64 characters to their values through a 128 entries table, then merged like the AVX2 kernel and compacted to 48
+// bytes.
+SYSTEM_TARGET("avx512f,avx512bw,avx512vbmi,avx2")
+static size_t _DecodeBlocksAVX512VBMI(uint8_t const *in, size_t len, uint8_t *out, Base64Tables const &tables)
+{
+    __m512i const ascii_low  = _mm512_loadu_si512(tables.DecodeAscii);
+    __m512i const ascii_high = _mm512_loadu_si512(tables.DecodeAscii + 64);
+    __m512i const pack       = _mm512_setr_epi32(0x06000102, 0x090A0405, 0x0C0D0E08, 0x16101112, 0x191A1415, 0x1C1D1E18, 0x26202122, 0x292A2425,
+                                                 0x2C2D2E28, 0x36303132, 0x393A3435, 0x3C3D3E38, 0, 0, 0, 0);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64, out += 48)
+    {
+        __m512i const input  = _mm512_loadu_si512(in + i);
+        __m512i const values = _mm512_permutex2var_epi8(ascii_low, input, ascii_high);
+        if (_mm512_movepi8_mask(_mm512_or_si512(values, input)) != 0)
+            break;
+
+        __m512i const merged = _mm512_maddubs_epi16(values, _mm512_set1_epi32(0x01400140));
+        __m512i const packed = _mm512_madd_epi16(merged, _mm512_set1_epi32(0x00011000));
+        _mm512_mask_storeu_epi8(out, (uint64_t(1) << 48) - 1, _mm512_maskz_permutexvar_epi8(~__mmask64(0), pack, packed));
+    }
+
+    return i + _DecodeBlocksAVX2(in + i, len - i, out, tables);
+}
+#elif defined(SYSTEM_SIMD_NEON) && defined(SYSTEM_ARCH_ARM64)
+// vld3 and vld4 deinterleave the groups, a 64 bytes table lookup translates the values.
+static size_t _EncodeBlocksNEON(uint8_t const *in, size_t len, char *out, Base64Tables const &tables)
 {
-    return utf8::utf32to8(str);
+    auto const alphabet = reinterpret_cast<uint8_t const *>(tables.Alphabet);
+    uint8x16x4_t const table = { { vld1q_u8(alphabet), vld1q_u8(alphabet + 16), vld1q_u8(alphabet + 32), vld1q_u8(alphabet + 48) } };
+    uint8x16_t const mask    = vdupq_n_u8(0x3F);
+    size_t i                 = 0;
+    for (; i + 48 <= len; i += 48, out += 64)
+    {
+        uint8x16x3_t const input = vld3q_u8(in + i);
+        uint8x16x4_t characters;
+        characters.val[0] = vqtbl4q_u8(table, vshrq_n_u8(input.val[0], 2));
+        characters.val[1] = vqtbl4q_u8(table, vandq_u8(vorrq_u8(vshlq_n_u8(input.val[0], 4), vshrq_n_u8(input.val[1], 4)), mask));
+        characters.val[2] = vqtbl4q_u8(table, vandq_u8(vorrq_u8(vshlq_n_u8(input.val[1], 2), vshrq_n_u8(input.val[2], 6)), mask));
+        characters.val[3] = vqtbl4q_u8(table, vandq_u8(input.val[2], mask));
+        vst4q_u8(reinterpret_cast<uint8_t *>(out), characters);
+    }
+
+    return i;
 }
 
-size_t EncodedLength(std::string_view str)
+static size_t _DecodeBlocksNEON(uint8_t const *in, size_t len, uint8_t *out, Base64Tables const &tables)
 {
-    return utf8::distance(str.begin(), str.end());
+    uint8x16x4_t const ascii_low  = { { vld1q_u8(tables.DecodeAscii), vld1q_u8(tables.DecodeAscii + 16), vld1q_u8(tables.DecodeAscii + 32), vld1q_u8(tables.DecodeAscii + 48) } };
+    uint8x16x4_t const ascii_high = { { vld1q_u8(tables.DecodeAscii + 64), vld1q_u8(tables.DecodeAscii + 80), vld1q_u8(tables.DecodeAscii + 96), vld1q_u8(tables.DecodeAscii + 112) } };
+    uint8x16_t const high_bit     = vdupq_n_u8(0x40);
+    size_t i                      = 0;
+    for (; i + 64 <= len; i += 64, out += 48)
+    {
+        uint8x16x4_t const input = vld4q_u8(in + i);
+        uint8x16x4_t values;
+        uint8x16_t errors = vdupq_n_u8(0);
+        for (int j = 0; j < 4; ++j)
+        {
+            // Characters 64-127 are out of the range of the first table, the second one takes them. Bytes above 127
+            // are out of both and keep their high bit in errors.
+            values.val[j] = vqtbx4q_u8(vqtbl4q_u8(ascii_low, input.val[j]), ascii_high, veorq_u8(input.val[j], high_bit));
+            errors        = vorrq_u8(errors, vorrq_u8(values.val[j], input.val[j]));
+        }
+
+        if (vmaxvq_u8(errors) & 0x80)
+            break;
+
+        uint8x16x3_t bytes;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(values.val[0], 2), vshrq_n_u8(values.val[1], 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(values.val[1], 4), vshrq_n_u8(values.val[2], 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(values.val[2], 6), values.val[3]);
+        vst3q_u8(out, bytes);
+    }
+
+    return i;
 }
+#endif
 
-namespace Base64
+static encode_blocks_t _SelectEncodeBlocks()
 {
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().AVX512VBMI)
+        return &_EncodeBlocksAVX512VBMI;
 
-static char constexpr Base64Alphabet[]       = {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"};
-static signed char constexpr Base64Inverse[] = {
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //   0-15
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //  16-31
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63, //  32-47
-    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1, //  48-63
-    -1, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, //  64-79
-    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1, //  80-95
-    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, //  96-111
-    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1, // 112-127
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 128-143
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 144-159
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 160-175
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 176-191
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 192-207
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 208-223
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 224-239
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1  // 240-255
-};
+    if (GetSimdSupport().AVX2)
+        return &_EncodeBlocksAVX2;
 
-static char constexpr Base64UrlAlphabet[]       = {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"};
-static signed char constexpr Base64UrlInverse[] = {
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //   0-15
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, //  16-31
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, //  32-47
-    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1, //  48-63
-    -1, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, //  64-79
-    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63, //  80-95
-    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, //  96-111
-    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1, // 112-127
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 128-143
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 144-159
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 160-175
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 176-191
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 192-207
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 208-223
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, // 224-239
-    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1  // 240-255
-};
+    if (GetSimdSupport().SSSE3)
+        return &_EncodeBlocksSSSE3;
+#elif defined(SYSTEM_SIMD_NEON) && defined(SYSTEM_ARCH_ARM64)
+    return &_EncodeBlocksNEON;
+#endif
+    return &_EncodeBlocksScalar;
+}
+
+static decode_blocks_t _SelectDecodeBlocks()
+{
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().AVX512VBMI)
+        return &_DecodeBlocksAVX512VBMI;
+
+    if (GetSimdSupport().AVX2)
+        return &_DecodeBlocksAVX2;
+
+    if (GetSimdSupport().SSSE3)
+        return &_DecodeBlocksSSSE3;
+#elif defined(SYSTEM_SIMD_NEON) && defined(SYSTEM_ARCH_ARM64)
+    return &_DecodeBlocksNEON;
+#endif
+    return &_DecodeBlocksScalar;
+}
 
-std::size_t EncodeWithAlphabet(void *dest, void const *src, std::size_t len, bool padding, const char *alphabet)
+static std::size_t EncodeWithAlphabet(void *dest, void const *src, std::size_t len, bool padding, Base64Tables const &tables)
 {
-    char *out      = static_cast<char *>(dest);
-    char const *in = static_cast<char const *>(src);
+    static encode_blocks_t const encode_blocks = _SelectEncodeBlocks();
+
+    char *out          = static_cast<char *>(dest);
+    auto in            = static_cast<uint8_t const *>(src);
+    char const *alphabet = tables.Alphabet;
+
+    size_t const blocks = encode_blocks(in, len, out, tables);
+    in += blocks;
+    out += blocks / 3 * 4;
+    len -= blocks;
 
     for (auto n = len / 3; n--;)
     {
-        *out++ = alphabet[(in[0] & 0xfc) >> 2];
-        *out++ = alphabet[((in[0] & 0x03) << 4) + ((in[1] & 0xf0) >> 4)];
-        *out++ = alphabet[((in[2] & 0xc0) >> 6) + ((in[1] & 0x0f) << 2)];
+        *out++ = alphabet[in[0] >> 2];
+        *out++ = alphabet[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+        *out++ = alphabet[((in[1] & 0x0f) << 2) | (in[2] >> 6)];
         *out++ = alphabet[in[2] & 0x3f];
         in += 3;
     }
@@ -229,16 +1948,16 @@ std::size_t EncodeWithAlphabet(void *dest, void const *src, std::size_t len, boo
     switch (len % 3)
     {
         case 2:
-            *out++ = alphabet[(in[0] & 0xfc) >> 2];
-            *out++ = alphabet[((in[0] & 0x03) << 4) + ((in[1] & 0xf0) >> 4)];
+            *out++ = alphabet[in[0] >> 2];
+            *out++ = alphabet[((in[0] & 0x03) << 4) | (in[1] >> 4)];
             *out++ = alphabet[(in[1] & 0x0f) << 2];
             if (padding)
                 *out++ = '=';
             break;
 
         case 1:
-            *out++ = alphabet[(in[0] & 0xfc) >> 2];
-            *out++ = alphabet[((in[0] & 0x03) << 4)];
+            *out++ = alphabet[in[0] >> 2];
+            *out++ = alphabet[(in[0] & 0x03) << 4];
             if (padding)
             {
                 *out++ = '=';
@@ -252,64 +1971,362 @@ std::size_t EncodeWithAlphabet(void *dest, void const *src, std::size_t len, boo
     return out - static_cast<char *>(dest);
 }
 
-std::pair<std::size_t, std::size_t> DecodeWithAlphabet(void *dest, char const *src, std::size_t len, const signed char *alphabet)
+// Decodes up to the end, the padding or the first character out of the alphabet. A last incomplete group of n
+// characters gives n - 1 bytes.
+static std::pair<std::size_t, std::size_t> DecodeWithAlphabet(void *dest, char const *src, std::size_t len, Base64Tables const &tables)
 {
-    char *out = static_cast<char *>(dest);
-    auto in   = reinterpret_cast<unsigned char const *>(src);
-    unsigned char c3[3]{}, c4[4]{};
-    int i = 0;
-    int j = 0;
+    static decode_blocks_t const decode_blocks = _SelectDecodeBlocks();
+
+    auto out                  = static_cast<uint8_t *>(dest);
+    auto const in             = reinterpret_cast<uint8_t const *>(src);
+    signed char const *values = tables.Inverse;
 
-    while (len-- && *in != '=')
+    size_t i = decode_blocks(in, len, out, tables);
+    out += i / 4 * 3;
+
+    for (; i + 4 <= len; i += 4)
     {
-        auto const v = alphabet[*in];
-        if (v == -1)
+        int const a = values[in[i]];
+        int const b = values[in[i + 1]];
+        int const c = values[in[i + 2]];
+        int const d = values[in[i + 3]];
+        if ((a | b | c | d) < 0)
             break;
-        ++in;
-        c4[i] = v;
-        if (++i == 4)
-        {
-            c3[0] = (c4[0] << 2) + ((c4[1] & 0x30) >> 4);
-            c3[1] = ((c4[1] & 0xf) << 4) + ((c4[2] & 0x3c) >> 2);
-            c3[2] = ((c4[2] & 0x3) << 6) + c4[3];
 
-            for (i = 0; i < 3; i++)
-                *out++ = c3[i];
-            i = 0;
-        }
+        *out++ = static_cast<uint8_t>((a << 2) | (b >> 4));
+        *out++ = static_cast<uint8_t>((b << 4) | (c >> 2));
+        *out++ = static_cast<uint8_t>((c << 6) | d);
     }
 
-    if (i)
+    int group[3] = {};
+    size_t count = 0;
+    while (i + count < len && count < 3 && values[in[i + count]] >= 0)
     {
-        c3[0] = (c4[0] << 2) + ((c4[1] & 0x30) >> 4);
-        c3[1] = ((c4[1] & 0xf) << 4) + ((c4[2] & 0x3c) >> 2);
-        c3[2] = ((c4[2] & 0x3) << 6) + c4[3];
-
-        for (j = 0; j < i - 1; j++)
-            *out++ = c3[j];
+        group[count] = values[in[i + count]];
+        ++count;
     }
 
-    return {out - static_cast<char *>(dest), in - reinterpret_cast<unsigned char const *>(src)};
+    if (count >= 2)
+        *out++ = static_cast<uint8_t>((group[0] << 2) | (group[1] >> 4));
+    if (count == 3)
+        *out++ = static_cast<uint8_t>((group[1] << 4) | (group[2] >> 2));
+
+    return {out - static_cast<uint8_t *>(dest), i + count};
 }
 
 std::size_t Encode(void *dest, void const *src, std::size_t len, bool padding)
 {
-    return EncodeWithAlphabet(dest, src, len, padding, Base64Alphabet);
+    return EncodeWithAlphabet(dest, src, len, padding, _StandardTables());
 }
 
 std::pair<std::size_t, std::size_t> Decode(void *dest, char const *src, std::size_t len)
 {
-    return DecodeWithAlphabet(dest, src, len, Base64Inverse);
+    return DecodeWithAlphabet(dest, src, len, _StandardTables());
 }
 
 std::size_t UrlEncode(void *dest, void const *src, std::size_t len, bool padding)
 {
-    return EncodeWithAlphabet(dest, src, len, padding, Base64UrlAlphabet);
+    return EncodeWithAlphabet(dest, src, len, padding, _UrlTables());
 }
 
 std::pair<std::size_t, std::size_t> UrlDecode(void *dest, char const *src, std::size_t len)
 {
-    return DecodeWithAlphabet(dest, src, len, Base64UrlInverse);
+    return DecodeWithAlphabet(dest, src, len, _UrlTables());
+}
+
+static Base64Tables const &_Tables(Alphabet alphabet)
+{
+    return alphabet == Alphabet::Url ? _UrlTables() : _StandardTables();
+}
+
+Encoder::Encoder(Alphabet alphabet, bool padding, std::size_t line_length) :
+    _Alphabet(alphabet),
+    _Padding(padding),
+    _LineLength(line_length),
+    _Column(0),
+    _Carry{},
+    _CarryLength(0)
+{
+    if (line_length % 4 != 0)
+        throw std::invalid_argument("Base64::Encoder line length must be a multiple of 4.");
+}
+
+// Whole groups, a line at a time. The line break goes before the next characters, never at the end.
+void Encoder::_Write(std::uint8_t const *in, std::size_t groups, std::string &out)
+{
+    if (groups == 0)
+        return;
+
+    Base64Tables const &tables = _Tables(_Alphabet);
+    if (_LineLength == 0)
+    {
+        std::size_t const position = out.size();
+        out.resize(position + groups * 4);
+        EncodeWithAlphabet(&out[position], in, groups * 3, false, tables);
+        return;
+    }
+
+    // Every line that starts gets its break first.
+    std::size_t const breaks = (_Column + groups * 4 - 1) / _LineLength;
+    std::size_t const position = out.size();
+    out.resize(position + groups * 4 + breaks * 2);
+    char *p = &out[position];
+    while (groups != 0)
+    {
+        if (_Column == _LineLength)
+        {
+            *p++    = '\r';
+            *p++    = '\n';
+            _Column = 0;
+        }
+
+        std::size_t const count = std::min(groups, (_LineLength - _Column) / 4);
+        p += EncodeWithAlphabet(p, in, count * 3, false, tables);
+        in += count * 3;
+        groups -= count;
+        _Column += count * 4;
+    }
+}
+
+void Encoder::Update(void const *data, std::size_t len, std::string &out)
+{
+    auto in = static_cast<std::uint8_t const *>(data);
+    if (_CarryLength != 0)
+    {
+        std::size_t const taken = std::min<std::size_t>(len, 3 - _CarryLength);
+        memcpy(_Carry + _CarryLength, in, taken);
+        _CarryLength += static_cast<std::uint8_t>(taken);
+        in += taken;
+        len -= taken;
+        if (_CarryLength < 3)
+            return;
+
+        _Write(_Carry, 1, out);
+        _CarryLength = 0;
+    }
+
+    _Write(in, len / 3, out);
+    _CarryLength = static_cast<std::uint8_t>(len % 3);
+    memcpy(_Carry, in + len / 3 * 3, _CarryLength);
+}
+
+void Encoder::Finish(std::string &out)
+{
+    if (_CarryLength != 0)
+    {
+        // A multiple of 4 line length always has room for the last group.
+        if (_LineLength != 0 && _Column == _LineLength)
+            out.append("\r\n");
+
+        char group[4];
+        out.append(group, EncodeWithAlphabet(group, _Carry, _CarryLength, _Padding, _Tables(_Alphabet)));
+    }
+
+    Reset();
+}
+
+void Encoder::Reset()
+{
+    _Column      = 0;
+    _CarryLength = 0;
+}
+
+static inline bool _IsBase64Space(std::uint8_t c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+}
+
+Decoder::Decoder(Alphabet alphabet, bool strict_padding) :
+    _Alphabet(alphabet),
+    _StrictPadding(strict_padding),
+    _Failed(false),
+    _Ended(false),
+    _GroupLength(0),
+    _PaddingLength(0),
+    _Group{},
+    _Position(0)
+{
+}
+
+bool Decoder::_Fail()
+{
+    _Failed = true;
+    return false;
+}
+
+// The last group, of 2 or 3 characters. Its unused bits are 0 in the canonical form.
+bool Decoder::_EndGroup(std::string &out, std::size_t &written)
+{
+    if (_GroupLength == 2 && (!_StrictPadding || (_Group[1] & 0x0F) == 0))
+    {
+        out[written++] = static_cast<char>((_Group[0] << 2) | (_Group[1] >> 4));
+    }
+    else if (_GroupLength == 3 && (!_StrictPadding || (_Group[2] & 0x03) == 0))
+    {
+        out[written++] = static_cast<char>((_Group[0] << 2) | (_Group[1] >> 4));
+        out[written++] = static_cast<char>((_Group[1] << 4) | (_Group[2] >> 2));
+    }
+    else
+    {
+        return false;
+    }
+
+    _Ended = true;
+    return true;
+}
+
+bool Decoder::Update(std::string_view chunk, std::string &out)
+{
+    if (_Failed)
+        return false;
+
+    Base64Tables const &tables = _Tables(_Alphabet);
+    auto const in              = reinterpret_cast<std::uint8_t const *>(chunk.data());
+    std::size_t const len      = chunk.size();
+
+    // Every 4 characters give 3 bytes at most, the carried group included.
+    std::size_t written = out.size();
+    out.resize(written + (len / 4 + 1) * 3);
+
+    std::size_t i = 0;
+    while (i < len)
+    {
+        while (i < len && _IsBase64Space(in[i]))
+        {
+            ++i;
+            ++_Position;
+        }
+
+        // Between groups, the vector kernels take everything up to the next character out of the alphabet: a line
+        // break, the padding or an error.
+        if (_GroupLength == 0 && !_Ended && len - i >= 4)
+        {
+            std::size_t const groups = DecodeWithAlphabet(&out[written], chunk.data() + i, (len - i) / 4 * 4, tables).second / 4;
+            written += groups * 3;
+            i += groups * 4;
+            _Position += groups * 4;
+        }
+
+        if (i == len)
+            break;
+
+        std::uint8_t const c = in[i];
+        if (_IsBase64Space(c))
+        {
+        }
+        else if (_Ended)
+        {
+            // After the padding, or the end of a padded group.
+            if (c != '=' || _GroupLength + _PaddingLength == 4)
+                break;
+
+            ++_PaddingLength;
+        }
+        else if (c == '=')
+        {
+            ++_PaddingLength;
+            if (!_EndGroup(out, written))
+                break;
+        }
+        else
+        {
+            signed char const value = tables.Inverse[c];
+            if (value < 0)
+                break;
+
+            _Group[_GroupLength++] = static_cast<std::uint8_t>(value);
+            if (_GroupLength == 4)
+            {
+                out[written++] = static_cast<char>((_Group[0] << 2) | (_Group[1] >> 4));
+                out[written++] = static_cast<char>((_Group[1] << 4) | (_Group[2] >> 2));
+                out[written++] = static_cast<char>((_Group[2] << 6) | _Group[3]);
+                _GroupLength = 0;
+            }
+        }
+
+        ++i;
+        ++_Position;
+    }
+
+    out.resize(written);
+    return i == len || _Fail();
+}
+
+bool Decoder::Finish(std::string &out)
+{
+    if (_Failed)
+        return false;
+
+    bool valid = true;
+    if (_Ended)
+    {
+        valid = !_StrictPadding || _GroupLength + _PaddingLength == 4;
+    }
+    else if (_GroupLength != 0)
+    {
+        std::size_t written = out.size();
+        out.resize(written + 2);
+        valid = !_StrictPadding && _EndGroup(out, written);
+        out.resize(written);
+    }
+
+    if (!valid)
+        return _Fail();
+
+    Reset();
+    return true;
+}
+
+void Decoder::Reset()
+{
+    _Failed        = false;
+    _Ended         = false;
+    _GroupLength   = 0;
+    _PaddingLength = 0;
+    _Position      = 0;
+}
+
+bool Encode(std::istream &in, std::ostream &out, Encoder &encoder)
+{
+    // 48KB of input, whole groups and whole MIME lines.
+    std::string buffer(3 * 16 * 1024, '\0');
+    std::string encoded;
+    while (in)
+    {
+        in.read(&buffer[0], buffer.size());
+        encoded.clear();
+        encoder.Update(buffer.data(), static_cast<std::size_t>(in.gcount()), encoded);
+        if (!out.write(encoded.data(), encoded.size()))
+            return false;
+    }
+
+    if (in.bad())
+        return false;
+
+    encoded.clear();
+    encoder.Finish(encoded);
+    return static_cast<bool>(out.write(encoded.data(), encoded.size()));
+}
+
+bool Decode(std::istream &in, std::ostream &out, Decoder &decoder)
+{
+    std::string buffer(64 * 1024, '\0');
+    std::string decoded;
+    while (in)
+    {
+        in.read(&buffer[0], buffer.size());
+        decoded.clear();
+        bool const valid = decoder.Update(std::string_view(buffer.data(), static_cast<std::size_t>(in.gcount())), decoded);
+        if (!out.write(decoded.data(), decoded.size()) || !valid)
+            return false;
+    }
+
+    if (in.bad())
+        return false;
+
+    decoded.clear();
+    bool const valid = decoder.Finish(decoded);
+    return static_cast<bool>(out.write(decoded.data(), decoded.size())) && valid;
 }
 
 } // namespace Base64
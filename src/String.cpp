@@ -28,38 +28,587 @@ namespace System {
 namespace String {
 namespace details {
 
-void LeftTrim(std::string& str)
+// std::isspace of the "C" locale: space, \t, \n, \v, \f and \r.
+static inline bool _IsSpace(char c)
+{
+    return c == ' ' || static_cast<unsigned char>(c - '\t') < 5;
+}
+
+static size_t _CountLeadingSpacesScalar(const char* str, size_t len)
+{
+    size_t i = 0;
+    while (i < len && _IsSpace(str[i]))
+        ++i;
+
+    return i;
+}
+
+static size_t _CountTrailingSpacesScalar(const char* str, size_t len)
+{
+    size_t i = len;
+    while (i > 0 && _IsSpace(str[i - 1]))
+        --i;
+
+    return len - i;
+}
+
+// The vector scans build a bit mask of the non space bytes of a block, [\t, \r] is biased down to [-128, -124] for a
+// signed compare.
+#if defined(SYSTEM_SIMD_X86)
+SYSTEM_TARGET("sse2")
+static inline uint32_t _NotSpaceMaskSSE2(const char* p)
+{
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i controls = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(-128 - '\t'))), _mm_set1_epi8(-128 + 5));
+    const __m128i spaces = _mm_or_si128(controls, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    return ~static_cast<uint32_t>(_mm_movemask_epi8(spaces)) & 0xFFFF;
+}
+
+SYSTEM_TARGET("avx2")
+static inline uint32_t _NotSpaceMaskAVX2(const char* p)
+{
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    const __m256i controls = _mm256_cmpgt_epi8(_mm256_set1_epi8(-128 + 5), _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(-128 - '\t'))));
+    const __m256i spaces = _mm256_or_si256(controls, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(spaces));
+}
+
+SYSTEM_TARGET("sse2")
+static size_t _CountLeadingSpacesSSE2(const char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        const uint32_t mask = _NotSpaceMaskSSE2(str + i);
+        if (mask != 0)
+            return i + CountTrailingZeros(mask);
+    }
+
+    return i + _CountLeadingSpacesScalar(str + i, len - i);
+}
+
+SYSTEM_TARGET("sse2")
+static size_t _CountTrailingSpacesSSE2(const char* str, size_t len)
+{
+    size_t end = len;
+    for (; end >= 16; end -= 16)
+    {
+        const uint32_t mask = _NotSpaceMaskSSE2(str + end - 16);
+        if (mask != 0)
+            return len - (end - 16 + 64 - CountLeadingZeros(mask));
+    }
+
+    return len - end + _CountTrailingSpacesScalar(str, end);
+}
+
+SYSTEM_TARGET("avx2")
+static size_t _CountLeadingSpacesAVX2(const char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        const uint32_t mask = _NotSpaceMaskAVX2(str + i);
+        if (mask != 0)
+            return i + CountTrailingZeros(mask);
+    }
+
+    return i + _CountLeadingSpacesSSE2(str + i, len - i);
+}
+
+SYSTEM_TARGET("avx2")
+static size_t _CountTrailingSpacesAVX2(const char* str, size_t len)
+{
+    size_t end = len;
+    for (; end >= 32; end -= 32)
+    {
+        const uint32_t mask = _NotSpaceMaskAVX2(str + end - 32);
+        if (mask != 0)
+            return len - (end - 32 + 64 - CountLeadingZeros(mask));
+    }
+
+    return len - end + _CountTrailingSpacesSSE2(str, end);
+}
+#elif defined(SYSTEM_SIMD_NEON)
+// 4 bits per byte, see NeonNibbleMask.
+static inline uint64_t _NotSpaceMaskNEON(const char* p)
+{
+    const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+    const uint8x16_t controls = vcltq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(5));
+    const uint8x16_t spaces = vorrq_u8(controls, vceqq_u8(v, vdupq_n_u8(' ')));
+    return NeonNibbleMask(vmvnq_u8(spaces));
+}
+
+static size_t _CountLeadingSpacesNEON(const char* str, size_t len)
 {
-    str.erase(str.begin(), std::find_if(str.begin(), str.end(), [](const char c)
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
     {
-        return !std::isspace((unsigned char)c);
-    }));
+        const uint64_t mask = _NotSpaceMaskNEON(str + i);
+        if (mask != 0)
+            return i + CountTrailingZeros(mask) / 4;
+    }
+
+    return i + _CountLeadingSpacesScalar(str + i, len - i);
+}
+
+static size_t _CountTrailingSpacesNEON(const char* str, size_t len)
+{
+    size_t end = len;
+    for (; end >= 16; end -= 16)
+    {
+        const uint64_t mask = _NotSpaceMaskNEON(str + end - 16);
+        if (mask != 0)
+            return len - (end - 16 + (63 - CountLeadingZeros(mask)) / 4 + 1);
+    }
+
+    return len - end + _CountTrailingSpacesScalar(str, end);
+}
+#endif
+
+using count_spaces_t = size_t(*)(const char*, size_t);
+
+static count_spaces_t _SelectCountLeadingSpaces()
+{
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().AVX2)
+        return &_CountLeadingSpacesAVX2;
+
+    if (GetSimdSupport().SSE2)
+        return &_CountLeadingSpacesSSE2;
+#elif defined(SYSTEM_SIMD_NEON)
+    return &_CountLeadingSpacesNEON;
+#endif
+    return &_CountLeadingSpacesScalar;
+}
+
+static count_spaces_t _SelectCountTrailingSpaces()
+{
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().AVX2)
+        return &_CountTrailingSpacesAVX2;
+
+    if (GetSimdSupport().SSE2)
+        return &_CountTrailingSpacesSSE2;
+#elif defined(SYSTEM_SIMD_NEON)
+    return &_CountTrailingSpacesNEON;
+#endif
+    return &_CountTrailingSpacesScalar;
+}
+
+size_t CountLeadingSpaces(const char* str, size_t len)
+{
+    // Most strings don't start with a space, or with a few ones.
+    if (len < 16 || !_IsSpace(str[0]) || !_IsSpace(str[1]))
+        return _CountLeadingSpacesScalar(str, len);
+
+    static const count_spaces_t count = _SelectCountLeadingSpaces();
+    return count(str, len);
+}
+
+size_t CountTrailingSpaces(const char* str, size_t len)
+{
+    if (len < 16 || !_IsSpace(str[len - 1]) || !_IsSpace(str[len - 2]))
+        return _CountTrailingSpacesScalar(str, len);
+
+    static const count_spaces_t count = _SelectCountTrailingSpaces();
+    return count(str, len);
+}
+
+void LeftTrim(std::string& str)
+{
+    str.erase(0, CountLeadingSpaces(str.data(), str.length()));
 }
 
 void RightTrim(std::string& str)
 {
-    str.erase(std::find_if(str.rbegin(), str.rend(), [](const char c)
+    str.resize(str.length() - CountTrailingSpaces(str.data(), str.length()));
+}
+
+// ASCII only and locale-free: bytes outside [a-z]/[A-Z] are kept as they are.
+static inline char _ToUpperAscii(char c)
+{
+    return static_cast<unsigned char>(c - 'a') < 26 ? static_cast<char>(c ^ 0x20) : c;
+}
+
+static inline char _ToLowerAscii(char c)
+{
+    return static_cast<unsigned char>(c - 'A') < 26 ? static_cast<char>(c ^ 0x20) : c;
+}
+
+template<char(*Convert)(char)>
+static void _ConvertCaseScalar(char* str, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+        str[i] = Convert(str[i]);
+}
+
+// The vector kernels flip bit 5 of the bytes in [first, first + 25]: bias the range down to [-128, -103] so a single
+// signed compare finds them. Conversion is idempotent, the tail is handled by a last, overlapping, block.
+#if defined(SYSTEM_SIMD_X86)
+template<char First>
+SYSTEM_TARGET("sse2")
+static inline void _ConvertCaseBlockSSE2(char* p)
+{
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i in_range = _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(-128 - First))), _mm_set1_epi8(-128 + 26));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_xor_si128(v, _mm_and_si128(in_range, _mm_set1_epi8(0x20))));
+}
+
+template<char First>
+SYSTEM_TARGET("sse2")
+static void _ConvertCaseSSE2(char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+        _ConvertCaseBlockSSE2<First>(str + i);
+
+    if (i != len)
+        _ConvertCaseBlockSSE2<First>(str + len - 16);
+}
+
+template<char First>
+SYSTEM_TARGET("avx2")
+static void _ConvertCaseAVX2(char* str, size_t len)
+{
+    const __m256i bias = _mm256_set1_epi8(static_cast<char>(-128 - First));
+    const __m256i limit = _mm256_set1_epi8(-128 + 26);
+    const __m256i flip = _mm256_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
     {
-        return !std::isspace((unsigned char)c);
-    }).base(), str.end());
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+        const __m256i in_range = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(v, bias));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(str + i), _mm256_xor_si256(v, _mm256_and_si256(in_range, flip)));
+    }
+
+    if (i != len)
+    {
+        // 16 to 31 bytes left, or fewer after a full block: finish with 16 bytes blocks.
+        const size_t start = len - i >= 16 ? i : len - 16;
+        _ConvertCaseSSE2<First>(str + start, len - start);
+    }
+}
+#elif defined(SYSTEM_SIMD_NEON)
+// NEON has unsigned compares, no bias needed.
+template<char First>
+static inline void _ConvertCaseBlockNEON(char* p)
+{
+    const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+    const uint8x16_t in_range = vcltq_u8(vsubq_u8(v, vdupq_n_u8(static_cast<uint8_t>(First))), vdupq_n_u8(26));
+    vst1q_u8(reinterpret_cast<uint8_t*>(p), veorq_u8(v, vandq_u8(in_range, vdupq_n_u8(0x20))));
+}
+
+template<char First>
+static void _ConvertCaseNEON(char* str, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+        _ConvertCaseBlockNEON<First>(str + i);
+
+    if (i != len)
+        _ConvertCaseBlockNEON<First>(str + len - 16);
+}
+#endif
+
+using convert_case_t = void(*)(char*, size_t);
+
+template<char First, char(*Convert)(char)>
+static convert_case_t _SelectConvertCase()
+{
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().AVX2)
+        return &_ConvertCaseAVX2<First>;
+
+    if (GetSimdSupport().SSE2)
+        return &_ConvertCaseSSE2<First>;
+#elif defined(SYSTEM_SIMD_NEON)
+    return &_ConvertCaseNEON<First>;
+#endif
+    return &_ConvertCaseScalar<Convert>;
 }
 
 void ToUpper(char* str, size_t len)
 {
-    while(len--)
+    // The vector kernels need a full block.
+    if (len < 16)
+        return _ConvertCaseScalar<&_ToUpperAscii>(str, len);
+
+    static const convert_case_t convert = _SelectConvertCase<'a', &_ToUpperAscii>();
+    convert(str, len);
+}
+
+void ToLower(char* str, size_t len)
+{
+    if (len < 16)
+        return _ConvertCaseScalar<&_ToLowerAscii>(str, len);
+
+    static const convert_case_t convert = _SelectConvertCase<'A', &_ToLowerAscii>();
+    convert(str, len);
+}
+
+// Sets this small are compared byte by byte in the vector kernels, larger ones go through a lookup table.
+constexpr size_t _MaxVectorSetSize = 8;
+
+static size_t _FindAnyOfTable(const char* str, size_t len, const char* set, size_t set_len)
+{
+    bool table[256] = {};
+    for (size_t i = 0; i < set_len; ++i)
+        table[static_cast<unsigned char>(set[i])] = true;
+
+    for (size_t i = 0; i < len; ++i)
     {
-        unsigned char c = (unsigned char)*str;
-        *str++ = std::toupper(c);
+        if (table[static_cast<unsigned char>(str[i])])
+            return i;
     }
+
+    return len;
 }
 
-void ToLower(char* str, size_t len)
+static size_t _FindAnyOfScalar(const char* str, size_t len, const char* set, size_t set_len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        for (size_t j = 0; j < set_len; ++j)
+        {
+            if (str[i] == set[j])
+                return i;
+        }
+    }
+
+    return len;
+}
+
+#if defined(SYSTEM_SIMD_X86)
+SYSTEM_TARGET("sse2")
+static size_t _FindAnyOfSSE2(const char* str, size_t len, const char* set, size_t set_len)
+{
+    __m128i needles[_MaxVectorSetSize];
+    for (size_t j = 0; j < set_len; ++j)
+        needles[j] = _mm_set1_epi8(set[j]);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+        __m128i found = _mm_cmpeq_epi8(v, needles[0]);
+        for (size_t j = 1; j < set_len; ++j)
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(v, needles[j]));
+
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(found));
+        if (mask != 0)
+            return i + CountTrailingZeros(mask);
+    }
+
+    return i + _FindAnyOfScalar(str + i, len - i, set, set_len);
+}
+
+SYSTEM_TARGET("avx2")
+static size_t _FindAnyOfAVX2(const char* str, size_t len, const char* set, size_t set_len)
+{
+    __m256i needles[_MaxVectorSetSize];
+    for (size_t j = 0; j < set_len; ++j)
+        needles[j] = _mm256_set1_epi8(set[j]);
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+        __m256i found = _mm256_cmpeq_epi8(v, needles[0]);
+        for (size_t j = 1; j < set_len; ++j)
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(v, needles[j]));
+
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(found));
+        if (mask != 0)
+            return i + CountTrailingZeros(mask);
+    }
+
+    // The SSE2 kernel is not VEX encoded, it stalls on dirty upper halves.
+    _mm256_zeroupper();
+    return i + _FindAnyOfSSE2(str + i, len - i, set, set_len);
+}
+#elif defined(SYSTEM_SIMD_NEON)
+static size_t _FindAnyOfNEON(const char* str, size_t len, const char* set, size_t set_len)
+{
+    uint8x16_t needles[_MaxVectorSetSize];
+    for (size_t j = 0; j < set_len; ++j)
+        needles[j] = vdupq_n_u8(static_cast<uint8_t>(set[j]));
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(str + i));
+        uint8x16_t found = vceqq_u8(v, needles[0]);
+        for (size_t j = 1; j < set_len; ++j)
+            found = vorrq_u8(found, vceqq_u8(v, needles[j]));
+
+        const uint64_t mask = NeonNibbleMask(found);
+        if (mask != 0)
+            return i + CountTrailingZeros(mask) / 4;
+    }
+
+    return i + _FindAnyOfScalar(str + i, len - i, set, set_len);
+}
+#endif
+
+using find_any_of_t = size_t(*)(const char*, size_t, const char*, size_t);
+
+static find_any_of_t _SelectFindAnyOf()
+{
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().AVX2)
+        return &_FindAnyOfAVX2;
+
+    if (GetSimdSupport().SSE2)
+        return &_FindAnyOfSSE2;
+#elif defined(SYSTEM_SIMD_NEON)
+    return &_FindAnyOfNEON;
+#endif
+    return &_FindAnyOfScalar;
+}
+
+size_t FindAnyOf(const char* str, size_t len, const char* set, size_t set_len)
+{
+    if (set_len == 0)
+        return len;
+
+    if (set_len == 1)
+    {
+        const void* found = len == 0 ? nullptr : memchr(str, set[0], len);
+        return found == nullptr ? len : static_cast<const char*>(found) - str;
+    }
+
+    if (set_len > _MaxVectorSetSize)
+        return _FindAnyOfTable(str, len, set, set_len);
+
+    if (len < 16)
+        return _FindAnyOfScalar(str, len, set, set_len);
+
+    static const find_any_of_t find = _SelectFindAnyOf();
+    return find(str, len, set, set_len);
+}
+
+// Single pattern search: compare the first and last bytes of the pattern on a whole block of positions, only the
+// positions where both match are checked with memcmp.
+#if defined(SYSTEM_SIMD_X86)
+SYSTEM_TARGET("sse2")
+static size_t _FindSSE2(const char* str, size_t len, const char* pattern, size_t pattern_len)
+{
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[pattern_len - 1]);
+
+    size_t i = 0;
+    for (; i + pattern_len - 1 + 16 <= len; i += 16)
+    {
+        const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+        const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i + pattern_len - 1));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last))));
+        while (mask != 0)
+        {
+            const size_t position = i + CountTrailingZeros(mask);
+            if (memcmp(str + position + 1, pattern + 1, pattern_len - 2) == 0)
+                return position;
+
+            mask &= mask - 1;
+        }
+    }
+
+    const size_t found = std::string_view(str + i, len - i).find(std::string_view(pattern, pattern_len));
+    return found == std::string_view::npos ? found : i + found;
+}
+
+SYSTEM_TARGET("avx2")
+static size_t _FindAVX2(const char* str, size_t len, const char* pattern, size_t pattern_len)
+{
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[pattern_len - 1]);
+
+    size_t i = 0;
+    for (; i + pattern_len - 1 + 32 <= len; i += 32)
+    {
+        const __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+        const __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i + pattern_len - 1));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last))));
+        while (mask != 0)
+        {
+            const size_t position = i + CountTrailingZeros(mask);
+            if (memcmp(str + position + 1, pattern + 1, pattern_len - 2) == 0)
+                return position;
+
+            mask &= mask - 1;
+        }
+    }
+
+    const size_t found = _FindSSE2(str + i, len - i, pattern, pattern_len);
+    return found == std::string_view::npos ? found : i + found;
+}
+#elif defined(SYSTEM_SIMD_NEON)
+static size_t _FindNEON(const char* str, size_t len, const char* pattern, size_t pattern_len)
+{
+    const uint8x16_t first = vdupq_n_u8(static_cast<uint8_t>(pattern[0]));
+    const uint8x16_t last = vdupq_n_u8(static_cast<uint8_t>(pattern[pattern_len - 1]));
+
+    size_t i = 0;
+    for (; i + pattern_len - 1 + 16 <= len; i += 16)
+    {
+        const uint8x16_t block_first = vld1q_u8(reinterpret_cast<const uint8_t*>(str + i));
+        const uint8x16_t block_last = vld1q_u8(reinterpret_cast<const uint8_t*>(str + i + pattern_len - 1));
+        uint64_t mask = NeonNibbleMask(vandq_u8(vceqq_u8(block_first, first), vceqq_u8(block_last, last)));
+        while (mask != 0)
+        {
+            const size_t position = i + CountTrailingZeros(mask) / 4;
+            if (memcmp(str + position + 1, pattern + 1, pattern_len - 2) == 0)
+                return position;
+
+            mask &= ~(uint64_t(0xF) << (position - i) * 4);
+        }
+    }
+
+    const size_t found = std::string_view(str + i, len - i).find(std::string_view(pattern, pattern_len));
+    return found == std::string_view::npos ? found : i + found;
+}
+#endif
+
+static size_t _FindScalar(const char* str, size_t len, const char* pattern, size_t pattern_len)
+{
+    return std::string_view(str, len).find(std::string_view(pattern, pattern_len));
+}
+
+using find_t = size_t(*)(const char*, size_t, const char*, size_t);
+
+static find_t _SelectFind()
+{
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().AVX2)
+        return &_FindAVX2;
+
+    if (GetSimdSupport().SSE2)
+        return &_FindSSE2;
+#elif defined(SYSTEM_SIMD_NEON)
+    return &_FindNEON;
+#endif
+    return &_FindScalar;
+}
+
+size_t Find(const char* str, size_t len, const char* pattern, size_t pattern_len)
 {
-    while (len--)
+    if (pattern_len == 0)
+        return 0;
+
+    if (pattern_len > len)
+        return std::string_view::npos;
+
+    if (pattern_len == 1)
     {
-        unsigned char c = (unsigned char)*str;
-        *str++ = std::tolower(c);
+        const void* found = memchr(str, pattern[0], len);
+        return found == nullptr ? std::string_view::npos : static_cast<const char*>(found) - str;
     }
+
+    if (len < 32)
+        return _FindScalar(str, len, pattern, pattern_len);
+
+    static const find_t find = _SelectFind();
+    return find(str, len, pattern, pattern_len);
 }
 
 char* CloneString(std::string_view src)
@@ -84,5 +633,473 @@ size_t CopyString(std::string_view src, char* dst, size_t dst_size)
 
 }// namespace details
 
+///////////////////////////////////////////////////////////
+// MultiSearcher
+
+// Patterns in a Teddy searcher, more would flag most positions of the text.
+constexpr size_t _MaxTeddyPatterns = 64;
+constexpr uint32_t _NoState = 0xFFFFFFFF;
+
+// A Teddy scan looks for the next block holding a position where the pattern prefixes may start. It returns the
+// block position, mask has a bit per candidate position and buckets the buckets flagged at each position. When there
+// is none, mask is 0 and the returned position is where the blocks stopped: the tail is left to the caller.
+// The scans are instantiated per prefix length so the tables stay in registers.
+using teddy_scan_t = size_t(*)(const uint8_t (*low)[16], const uint8_t (*high)[16], const char* str, size_t len, size_t from, uint8_t* buckets, uint32_t* mask);
+
+struct TeddyKernel_t
+{
+    // Indexed by the prefix length - 1.
+    teddy_scan_t Scan[3];
+    size_t BlockSize;
+};
+
+#if defined(SYSTEM_SIMD_X86)
+template<size_t PrefixLength>
+SYSTEM_TARGET("ssse3")
+static size_t _TeddyScanSSSE3(const uint8_t (*low)[16], const uint8_t (*high)[16], const char* str, size_t len, size_t from, uint8_t* buckets, uint32_t* mask)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i low_masks[3];
+    __m128i high_masks[3];
+    for (size_t j = 0; j < PrefixLength; ++j)
+    {
+        low_masks[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(low[j]));
+        high_masks[j] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(high[j]));
+    }
+
+    size_t i = from;
+    for (; i + 16 + PrefixLength - 1 <= len; i += 16)
+    {
+        __m128i result = _mm_set1_epi8(-1);
+        for (size_t j = 0; j < PrefixLength; ++j)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i + j));
+            const __m128i low_buckets = _mm_shuffle_epi8(low_masks[j], _mm_and_si128(v, nibble));
+            const __m128i high_buckets = _mm_shuffle_epi8(high_masks[j], _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+            result = _mm_and_si128(result, _mm_and_si128(low_buckets, high_buckets));
+        }
+
+        const uint32_t candidates = ~static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(result, _mm_setzero_si128()))) & 0xFFFF;
+        if (candidates != 0)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(buckets), result);
+            *mask = candidates;
+            return i;
+        }
+    }
+
+    *mask = 0;
+    return i;
+}
+
+template<size_t PrefixLength>
+SYSTEM_TARGET("avx2")
+static size_t _TeddyScanAVX2(const uint8_t (*low)[16], const uint8_t (*high)[16], const char* str, size_t len, size_t from, uint8_t* buckets, uint32_t* mask)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i low_masks[3];
+    __m256i high_masks[3];
+    for (size_t j = 0; j < PrefixLength; ++j)
+    {
+        // vpshufb looks up each 128 bits lane on its own, both lanes get the table.
+        low_masks[j] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(low[j])));
+        high_masks[j] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(high[j])));
+    }
+
+    size_t i = from;
+    for (; i + 32 + PrefixLength - 1 <= len; i += 32)
+    {
+        __m256i result = _mm256_set1_epi8(-1);
+        for (size_t j = 0; j < PrefixLength; ++j)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i + j));
+            const __m256i low_buckets = _mm256_shuffle_epi8(low_masks[j], _mm256_and_si256(v, nibble));
+            const __m256i high_buckets = _mm256_shuffle_epi8(high_masks[j], _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+            result = _mm256_and_si256(result, _mm256_and_si256(low_buckets, high_buckets));
+        }
+
+        const uint32_t candidates = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(result, _mm256_setzero_si256())));
+        if (candidates != 0)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(buckets), result);
+            *mask = candidates;
+            return i;
+        }
+    }
+
+    *mask = 0;
+    return i;
+}
+#elif defined(SYSTEM_SIMD_NEON) && defined(SYSTEM_ARCH_ARM64)
+template<size_t PrefixLength>
+static size_t _TeddyScanNEON(const uint8_t (*low)[16], const uint8_t (*high)[16], const char* str, size_t len, size_t from, uint8_t* buckets, uint32_t* mask)
+{
+    const uint8x16_t nibble = vdupq_n_u8(0x0F);
+    uint8x16_t low_masks[3];
+    uint8x16_t high_masks[3];
+    for (size_t j = 0; j < PrefixLength; ++j)
+    {
+        low_masks[j] = vld1q_u8(low[j]);
+        high_masks[j] = vld1q_u8(high[j]);
+    }
+
+    size_t i = from;
+    for (; i + 16 + PrefixLength - 1 <= len; i += 16)
+    {
+        uint8x16_t result = vdupq_n_u8(0xFF);
+        for (size_t j = 0; j < PrefixLength; ++j)
+        {
+            const uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(str + i + j));
+            const uint8x16_t low_buckets = vqtbl1q_u8(low_masks[j], vandq_u8(v, nibble));
+            const uint8x16_t high_buckets = vqtbl1q_u8(high_masks[j], vshrq_n_u8(v, 4));
+            result = vandq_u8(result, vandq_u8(low_buckets, high_buckets));
+        }
+
+        uint64_t nibbles = NeonNibbleMask(vtstq_u8(result, result));
+        if (nibbles != 0)
+        {
+            vst1q_u8(buckets, result);
+            uint32_t candidates = 0;
+            for (; nibbles != 0; nibbles &= nibbles - 1)
+                candidates |= 1u << (CountTrailingZeros(nibbles) / 4);
+
+            *mask = candidates;
+            return i;
+        }
+    }
+
+    *mask = 0;
+    return i;
+}
+#endif
+
+static TeddyKernel_t _SelectTeddyKernel()
+{
+#if defined(SYSTEM_SIMD_X86)
+    if (GetSimdSupport().AVX2)
+        return TeddyKernel_t{ { &_TeddyScanAVX2<1>, &_TeddyScanAVX2<2>, &_TeddyScanAVX2<3> }, 32 };
+
+    if (GetSimdSupport().SSSE3)
+        return TeddyKernel_t{ { &_TeddyScanSSSE3<1>, &_TeddyScanSSSE3<2>, &_TeddyScanSSSE3<3> }, 16 };
+#elif defined(SYSTEM_SIMD_NEON) && defined(SYSTEM_ARCH_ARM64)
+    return TeddyKernel_t{ { &_TeddyScanNEON<1>, &_TeddyScanNEON<2>, &_TeddyScanNEON<3> }, 16 };
+#endif
+    return TeddyKernel_t{ { nullptr, nullptr, nullptr }, 0 };
+}
+
+static TeddyKernel_t const& _GetTeddyKernel()
+{
+    static const TeddyKernel_t kernel = _SelectTeddyKernel();
+    return kernel;
+}
+
+MultiSearcher::MultiSearcher():
+    _Engine(Engine::None),
+    _MaxLength(0),
+    _PrefixLength(0),
+    _LowNibbleMasks{},
+    _HighNibbleMasks{},
+    _Buckets{},
+    _ByteClasses{},
+    _ClassCount(0)
+{}
+
+MultiSearcher::MultiSearcher(std::vector<std::string> patterns):
+    MultiSearcher()
+{
+    _Patterns = std::move(patterns);
+
+    size_t min_length = size_t(-1);
+    for (auto const& pattern : _Patterns)
+    {
+        if (pattern.empty())
+            continue;
+
+        min_length = std::min(min_length, pattern.length());
+        _MaxLength = std::max(_MaxLength, pattern.length());
+    }
+
+    if (_MaxLength == 0)
+        return;
+
+    if (_Patterns.size() <= _MaxTeddyPatterns && _GetTeddyKernel().Scan[0] != nullptr)
+    {
+        _PrefixLength = static_cast<uint8_t>(std::min<size_t>(min_length, 3));
+        _BuildTeddy();
+    }
+    else
+    {
+        _BuildAhoCorasick();
+    }
+}
+
+void MultiSearcher::_BuildTeddy()
+{
+    _Engine = Engine::Teddy;
+
+    const size_t count = _Patterns.size();
+    for (size_t bucket = 0; bucket <= 8; ++bucket)
+        _Buckets[bucket] = static_cast<uint32_t>(bucket * count / 8);
+
+    for (size_t bucket = 0; bucket < 8; ++bucket)
+    {
+        for (size_t index = _Buckets[bucket]; index < _Buckets[bucket + 1]; ++index)
+        {
+            std::string const& pattern = _Patterns[index];
+            if (pattern.empty())
+                continue;
+
+            for (size_t j = 0; j < _PrefixLength; ++j)
+            {
+                const uint8_t c = static_cast<uint8_t>(pattern[j]);
+                _LowNibbleMasks[j][c & 0x0F] |= static_cast<uint8_t>(1 << bucket);
+                _HighNibbleMasks[j][c >> 4] |= static_cast<uint8_t>(1 << bucket);
+            }
+        }
+    }
+}
+
+void MultiSearcher::_BuildAhoCorasick()
+{
+    _Engine = Engine::AhoCorasick;
+
+    // Bytes that no pattern uses share class 0.
+    _ClassCount = 1;
+    for (auto const& pattern : _Patterns)
+    {
+        for (char c : pattern)
+        {
+            uint8_t& byte_class = _ByteClasses[static_cast<uint8_t>(c)];
+            if (byte_class == 0)
+                byte_class = static_cast<uint8_t>(_ClassCount++);
+        }
+    }
+
+    // 256 used bytes would overflow the uint8_t classes: give up on classes then.
+    if (_ClassCount > 256)
+    {
+        for (size_t c = 0; c < 256; ++c)
+            _ByteClasses[c] = static_cast<uint8_t>(c);
+
+        _ClassCount = 256;
+    }
+
+    // The trie, missing edges are _NoState.
+    _Transitions.assign(_ClassCount, _NoState);
+    std::vector<std::vector<uint32_t>> outputs(1);
+    for (size_t index = 0; index < _Patterns.size(); ++index)
+    {
+        if (_Patterns[index].empty())
+            continue;
+
+        if (_StartBytes.find(_Patterns[index][0]) == std::string::npos)
+            _StartBytes += _Patterns[index][0];
+
+        uint32_t state = 0;
+        for (char c : _Patterns[index])
+        {
+            uint32_t& next = _Transitions[state * _ClassCount + _ByteClasses[static_cast<uint8_t>(c)]];
+            if (next == _NoState)
+            {
+                next = static_cast<uint32_t>(outputs.size());
+                outputs.emplace_back();
+                _Transitions.resize(_Transitions.size() + _ClassCount, _NoState);
+            }
+
+            state = _Transitions[state * _ClassCount + _ByteClasses[static_cast<uint8_t>(c)]];
+        }
+
+        outputs[state].push_back(static_cast<uint32_t>(index));
+    }
+
+    // Breadth first, fill the missing edges from the failure state, whose outputs are complete by then.
+    std::vector<uint32_t> failures(outputs.size(), 0);
+    std::vector<uint32_t> queue;
+    queue.reserve(outputs.size());
+    for (uint32_t c = 0; c < _ClassCount; ++c)
+    {
+        uint32_t& next = _Transitions[c];
+        if (next == _NoState)
+            next = 0;
+        else
+            queue.push_back(next);
+    }
+
+    for (size_t head = 0; head < queue.size(); ++head)
+    {
+        const uint32_t state = queue[head];
+        const uint32_t failure = failures[state];
+        outputs[state].insert(outputs[state].end(), outputs[failure].begin(), outputs[failure].end());
+
+        for (uint32_t c = 0; c < _ClassCount; ++c)
+        {
+            uint32_t& next = _Transitions[state * _ClassCount + c];
+            if (next == _NoState)
+            {
+                next = _Transitions[failure * _ClassCount + c];
+            }
+            else
+            {
+                failures[next] = _Transitions[failure * _ClassCount + c];
+                queue.push_back(next);
+            }
+        }
+    }
+
+    _OutputOffsets.reserve(outputs.size() + 1);
+    _OutputOffsets.push_back(0);
+    for (auto const& state_outputs : outputs)
+    {
+        _OutputPatterns.insert(_OutputPatterns.end(), state_outputs.begin(), state_outputs.end());
+        _OutputOffsets.push_back(static_cast<uint32_t>(_OutputPatterns.size()));
+    }
+}
+
+std::vector<MultiSearcher::Match> MultiSearcher::FindAll(std::string_view text) const
+{
+    std::vector<Match> matches;
+    _Search(text, [](void* user, Match const& match)
+    {
+        static_cast<std::vector<Match>*>(user)->push_back(match);
+        return true;
+    }, &matches);
+
+    return matches;
+}
+
+MultiSearcher::Match MultiSearcher::FindFirst(std::string_view text) const
+{
+    Match first{ std::string_view::npos, std::string_view::npos, 0 };
+    _Search(text, [](void* user, Match const& match)
+    {
+        *static_cast<Match*>(user) = match;
+        return false;
+    }, &first);
+
+    return first;
+}
+
+void MultiSearcher::_Search(std::string_view text, match_callback_t callback, void* user) const
+{
+    switch (_Engine)
+    {
+        case Engine::None       : break;
+        case Engine::Teddy      : _SearchTeddy(text, callback, user); break;
+        case Engine::AhoCorasick: _SearchAhoCorasick(text, callback, user); break;
+    }
+}
+
+bool MultiSearcher::_VerifyTeddy(std::string_view text, size_t position, uint32_t buckets, match_callback_t callback, void* user) const
+{
+    // The buckets hold consecutive indexes, walking them in order reports the patterns in order.
+    for (; buckets != 0; buckets &= buckets - 1)
+    {
+        const size_t bucket = CountTrailingZeros(buckets);
+        for (size_t index = _Buckets[bucket]; index < _Buckets[bucket + 1]; ++index)
+        {
+            std::string const& pattern = _Patterns[index];
+            if (pattern.empty() || pattern.length() > text.length() - position || memcmp(text.data() + position, pattern.data(), pattern.length()) != 0)
+                continue;
+
+            if (!callback(user, Match{ index, position, pattern.length() }))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void MultiSearcher::_SearchTeddy(std::string_view text, match_callback_t callback, void* user) const
+{
+    TeddyKernel_t const& kernel = _GetTeddyKernel();
+    const teddy_scan_t scan = kernel.Scan[_PrefixLength - 1];
+
+    size_t i = 0;
+    for (;;)
+    {
+        uint8_t buckets[32];
+        uint32_t mask;
+        i = scan(_LowNibbleMasks, _HighNibbleMasks, text.data(), text.length(), i, buckets, &mask);
+        if (mask == 0)
+            break;
+
+        for (; mask != 0; mask &= mask - 1)
+        {
+            const size_t offset = CountTrailingZeros(mask);
+            if (!_VerifyTeddy(text, i + offset, buckets[offset], callback, user))
+                return;
+        }
+
+        i += kernel.BlockSize;
+    }
+
+    // The tail is too short for a block.
+    for (; i + _PrefixLength <= text.length(); ++i)
+    {
+        uint32_t buckets = 0xFF;
+        for (size_t j = 0; j < _PrefixLength; ++j)
+        {
+            const uint8_t c = static_cast<uint8_t>(text[i + j]);
+            buckets &= _LowNibbleMasks[j][c & 0x0F] & _HighNibbleMasks[j][c >> 4];
+        }
+
+        if (buckets != 0 && !_VerifyTeddy(text, i, buckets, callback, user))
+            return;
+    }
+}
+
+void MultiSearcher::_SearchAhoCorasick(std::string_view text, match_callback_t callback, void* user) const
+{
+    // Matches are found by end position, they wait in pending, sorted, until no match can start before them: a match
+    // starting at s is found by s + _MaxLength - 1.
+    std::vector<Match> pending;
+    size_t head = 0;
+    uint32_t state = 0;
+    for (size_t i = 0; i < text.length(); ++i)
+    {
+        if (state == 0)
+        {
+            // No match can start before the next start byte.
+            i += details::FindAnyOf(text.data() + i, text.length() - i, _StartBytes.data(), _StartBytes.length());
+            if (i == text.length())
+                break;
+        }
+
+        state = _Transitions[state * _ClassCount + _ByteClasses[static_cast<uint8_t>(text[i])]];
+        for (uint32_t output = _OutputOffsets[state]; output < _OutputOffsets[state + 1]; ++output)
+        {
+            const size_t index = _OutputPatterns[output];
+            const size_t length = _Patterns[index].length();
+            pending.push_back(Match{ index, i + 1 - length, length });
+            for (size_t j = pending.size() - 1; j > head; --j)
+            {
+                Match& previous = pending[j - 1];
+                if (previous.Position < pending[j].Position || (previous.Position == pending[j].Position && previous.Pattern < pending[j].Pattern))
+                    break;
+
+                std::swap(previous, pending[j]);
+            }
+        }
+
+        for (; head < pending.size() && pending[head].Position + _MaxLength <= i + 1; ++head)
+        {
+            if (!callback(user, pending[head]))
+                return;
+        }
+
+        if (head == pending.size())
+        {
+            pending.clear();
+            head = 0;
+        }
+    }
+
+    for (; head < pending.size(); ++head)
+    {
+        if (!callback(user, pending[head]))
+            return;
+    }
+}
+
 }// namespace String
 }// namespace System
\ No newline at end of file
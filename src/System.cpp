@@ -188,6 +188,7 @@
         #include <sys/sysinfo.h> // Get uptime (second resolution)
         #include <dirent.h>
         #include <sys/prctl.h>
+        #include <sched.h>
     #else
         #include <sys/sysctl.h>
         #include <mach-o/dyld.h>
@@ -204,6 +205,12 @@
 #endif
 
 #include <fstream>
+#include <algorithm>
+#include <thread>
+
+#if defined(SYSTEM_ARCH_X86) || defined(SYSTEM_ARCH_X64)
+    #include <System/SystemCPUExtensions.h>
+#endif
 
 namespace System {
 
@@ -212,6 +219,31 @@ std::chrono::microseconds GetUpTime()
     return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now() - GetBootTime());
 }
 
+// Number the hardware threads of each core, in logical processor id order.
+static void _FillSmtIndexes(std::vector<CpuLogicalProcessor_t>& topology)
+{
+    std::sort(topology.begin(), topology.end(), [](CpuLogicalProcessor_t const& l, CpuLogicalProcessor_t const& r)
+    {
+        if (l.PackageId != r.PackageId)
+            return l.PackageId < r.PackageId;
+        if (l.CoreId != r.CoreId)
+            return l.CoreId < r.CoreId;
+        return l.Id < r.Id;
+    });
+
+    for (std::size_t i = 0; i < topology.size(); ++i)
+    {
+        topology[i].SmtIndex = (i != 0 && topology[i - 1].PackageId == topology[i].PackageId && topology[i - 1].CoreId == topology[i].CoreId)
+            ? topology[i - 1].SmtIndex + 1
+            : 0;
+    }
+
+    std::sort(topology.begin(), topology.end(), [](CpuLogicalProcessor_t const& l, CpuLogicalProcessor_t const& r)
+    {
+        return l.Id < r.Id;
+    });
+}
+
 }
 
 namespace System {
@@ -370,6 +402,163 @@ bool SetCurrentThreadName(std::string const& thread_name)
     return success;
 }
 
+static constexpr uint32_t _ProcessorsPerGroup = sizeof(KAFFINITY) * 8;
+
+static bool _IsInGroupAffinity(uint32_t cpu, GROUP_AFFINITY const& affinity)
+{
+    return cpu / _ProcessorsPerGroup == affinity.Group && (affinity.Mask & (KAFFINITY(1) << (cpu % _ProcessorsPerGroup))) != 0;
+}
+
+std::vector<CpuLogicalProcessor_t> GetCpuTopology()
+{
+    std::vector<CpuLogicalProcessor_t> topology;
+    std::vector<BYTE> efficiency_classes;
+
+    DWORD length = 0;
+    if (GetLogicalProcessorInformationEx(RelationAll, nullptr, &length) || GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+        return topology;
+
+    std::vector<uint8_t> buffer(length);
+    if (!GetLogicalProcessorInformationEx(RelationAll, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data()), &length))
+        return topology;
+
+    uint32_t core_id = 0;
+    for (DWORD offset = 0; offset < length;)
+    {
+        auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data() + offset);
+        if (info->Relationship == RelationProcessorCore)
+        {
+            for (WORD group = 0; group < info->Processor.GroupCount; ++group)
+            {
+                auto const& affinity = info->Processor.GroupMask[group];
+                for (uint32_t bit = 0; bit < _ProcessorsPerGroup; ++bit)
+                {
+                    if ((affinity.Mask & (KAFFINITY(1) << bit)) == 0)
+                        continue;
+
+                    topology.emplace_back(CpuLogicalProcessor_t{ affinity.Group * _ProcessorsPerGroup + bit, core_id, 0, 0, 0, CpuCoreType::Unknown });
+                    efficiency_classes.emplace_back(info->Processor.EfficiencyClass);
+                }
+            }
+            ++core_id;
+        }
+        offset += info->Size;
+    }
+
+    uint32_t package_id = 0;
+    for (DWORD offset = 0; offset < length;)
+    {
+        auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer.data() + offset);
+        if (info->Relationship == RelationProcessorPackage)
+        {
+            for (WORD group = 0; group < info->Processor.GroupCount; ++group)
+            {
+                for (auto& processor : topology)
+                {
+                    if (_IsInGroupAffinity(processor.Id, info->Processor.GroupMask[group]))
+                        processor.PackageId = package_id;
+                }
+            }
+            ++package_id;
+        }
+        else if (info->Relationship == RelationNumaNode)
+        {
+            for (auto& processor : topology)
+            {
+                if (_IsInGroupAffinity(processor.Id, info->NumaNode.GroupMask))
+                    processor.NumaNode = info->NumaNode.NodeNumber;
+            }
+        }
+        offset += info->Size;
+    }
+
+    // Windows reports a higher efficiency class for the more performant cores of hybrid CPUs.
+    if (!efficiency_classes.empty())
+    {
+        auto minmax = std::minmax_element(efficiency_classes.begin(), efficiency_classes.end());
+        if (*minmax.first != *minmax.second)
+        {
+            for (std::size_t i = 0; i < topology.size(); ++i)
+                topology[i].CoreType = efficiency_classes[i] == *minmax.second ? CpuCoreType::Performance : CpuCoreType::Efficiency;
+        }
+    }
+
+    // The process affinity mask is only meaningful on single group systems.
+    DWORD_PTR process_mask, system_mask;
+    if (GetActiveProcessorGroupCount() == 1 && GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+    {
+        topology.erase(std::remove_if(topology.begin(), topology.end(), [process_mask](CpuLogicalProcessor_t const& processor)
+        {
+            return (process_mask & (DWORD_PTR(1) << processor.Id)) == 0;
+        }), topology.end());
+    }
+
+    _FillSmtIndexes(topology);
+    return topology;
+}
+
+std::vector<uint32_t> GetCurrentThreadAffinity()
+{
+    std::vector<uint32_t> cpus;
+    GROUP_AFFINITY affinity;
+    if (!GetThreadGroupAffinity(GetCurrentThread(), &affinity))
+        return cpus;
+
+    for (uint32_t bit = 0; bit < _ProcessorsPerGroup; ++bit)
+    {
+        if ((affinity.Mask & (KAFFINITY(1) << bit)) != 0)
+            cpus.emplace_back(affinity.Group * _ProcessorsPerGroup + bit);
+    }
+
+    return cpus;
+}
+
+bool SetCurrentThreadAffinity(std::vector<uint32_t> const& cpus)
+{
+    if (cpus.empty())
+        return false;
+
+    // A thread belongs to a single processor group.
+    GROUP_AFFINITY affinity{};
+    affinity.Group = static_cast<WORD>(cpus[0] / _ProcessorsPerGroup);
+    for (auto cpu : cpus)
+    {
+        if (cpu / _ProcessorsPerGroup != affinity.Group)
+            return false;
+
+        affinity.Mask |= KAFFINITY(1) << (cpu % _ProcessorsPerGroup);
+    }
+
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != FALSE;
+}
+
+uint32_t GetEffectiveParallelism()
+{
+    uint32_t parallelism = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+
+    DWORD_PTR process_mask, system_mask;
+    if (GetActiveProcessorGroupCount() == 1 && GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+    {
+        uint32_t affinity_count = 0;
+        for (; process_mask != 0; process_mask &= process_mask - 1)
+            ++affinity_count;
+
+        parallelism = std::min(parallelism, affinity_count);
+    }
+
+    // A hard capped job object gets a share of every processor, in 1/10000.
+    JOBOBJECT_CPU_RATE_CONTROL_INFORMATION rate_control{};
+    if (QueryInformationJobObject(nullptr, JobObjectCpuRateControlInformation, &rate_control, sizeof(rate_control), nullptr) &&
+        (rate_control.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_ENABLE) != 0 &&
+        (rate_control.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP) != 0)
+    {
+        const uint32_t processor_count = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+        parallelism = std::min(parallelism, static_cast<uint32_t>((uint64_t(rate_control.CpuRate) * processor_count + 9999) / 10000));
+    }
+
+    return std::max<uint32_t>(parallelism, 1);
+}
+
 TranslatedMode GetTranslatedMode()
 {
     return TranslatedMode::Unavailable;
@@ -522,6 +711,352 @@ bool SetCurrentThreadName(std::string const& thread_name)
     return prctl(PR_SET_NAME, thread_name.c_str()) == 0;
 }
 
+// Parse a kernel cpu list like "0-3,8,10-11".
+static std::vector<uint32_t> _ParseCpuList(std::string const& cpu_list)
+{
+    std::vector<uint32_t> cpus;
+    const char* it = cpu_list.c_str();
+    while (*it != '\0')
+    {
+        char* end;
+        const unsigned long first = strtoul(it, &end, 10);
+        if (end == it)
+            break;
+
+        unsigned long last = first;
+        it = end;
+        if (*it == '-')
+        {
+            last = strtoul(it + 1, &end, 10);
+            if (end == it + 1)
+                break;
+
+            it = end;
+        }
+
+        for (unsigned long cpu = first; cpu <= last; ++cpu)
+            cpus.emplace_back(static_cast<uint32_t>(cpu));
+
+        while (*it == ',' || *it == ' ' || *it == '\n')
+            ++it;
+    }
+
+    return cpus;
+}
+
+#if defined(SYSTEM_ARCH_X86) || defined(SYSTEM_ARCH_X64)
+static bool _IsHybridCpu()
+{
+    return CpuFeatures::CpuId(0).Registers.eax >= 0x1A && CpuFeatures::HasFeature(CpuFeatures::CpuId(7), CpuFeatures::HYBRID);
+}
+
+// Core type of the logical processor running the calling thread, cpuid leaf 0x1A.
+static CpuCoreType _GetCurrentCoreType()
+{
+    switch (CpuFeatures::CpuId(0x1A).Registers.eax >> 24)
+    {
+        case 0x40: return CpuCoreType::Performance;
+        case 0x20: return CpuCoreType::Efficiency;
+        default  : return CpuCoreType::Unknown;
+    }
+}
+#endif
+
+static bool _ReadUInt32(std::string const& path, uint32_t& value)
+{
+    std::ifstream file(path, std::ios::in);
+    return static_cast<bool>(file >> value);
+}
+
+static std::vector<uint32_t> _GetAffinity(pid_t pid)
+{
+    std::vector<uint32_t> cpus;
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(pid, sizeof(cpu_set), &cpu_set) != 0)
+        return cpus;
+
+    for (uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &cpu_set))
+            cpus.emplace_back(cpu);
+    }
+
+    return cpus;
+}
+
+static bool _ReadCpuList(std::string const& path, std::vector<uint32_t>& cpus)
+{
+    std::ifstream file(path, std::ios::in);
+    std::string cpu_list;
+    if (!std::getline(file, cpu_list))
+        return false;
+
+    cpus = _ParseCpuList(cpu_list);
+    return true;
+}
+
+// Core type of every logical processor, indexed by id, read once. The kernel lists the cpus of each hybrid PMU. Older
+// kernels don't, then cpuid is run on each processor of the process affinity.
+static std::vector<CpuCoreType> _LoadCoreTypes()
+{
+    std::vector<CpuCoreType> core_types;
+    const auto set_core_type = [&core_types](std::vector<uint32_t> const& cpus, CpuCoreType core_type)
+    {
+        for (auto cpu : cpus)
+        {
+            if (cpu >= core_types.size())
+                core_types.resize(cpu + 1, CpuCoreType::Unknown);
+
+            core_types[cpu] = core_type;
+        }
+    };
+
+    std::vector<uint32_t> cpus;
+    if (_ReadCpuList("/sys/devices/cpu_core/cpus", cpus))
+        set_core_type(cpus, CpuCoreType::Performance);
+
+    if (_ReadCpuList("/sys/devices/cpu_atom/cpus", cpus))
+        set_core_type(cpus, CpuCoreType::Efficiency);
+
+#if defined(SYSTEM_ARCH_X86) || defined(SYSTEM_ARCH_X64)
+    // cpuid only describes the core it runs on, visit each one and restore the thread affinity.
+    if (core_types.empty() && _IsHybridCpu())
+    {
+        const auto thread_affinity = GetCurrentThreadAffinity();
+        for (auto cpu : _GetAffinity(getpid()))
+        {
+            if (SetCurrentThreadAffinity({ cpu }))
+                set_core_type({ cpu }, _GetCurrentCoreType());
+        }
+        SetCurrentThreadAffinity(thread_affinity);
+    }
+#endif
+
+    return core_types;
+}
+
+std::vector<CpuLogicalProcessor_t> GetCpuTopology()
+{
+    std::vector<CpuLogicalProcessor_t> topology;
+    // The main thread id is the process id.
+    for (auto cpu : _GetAffinity(getpid()))
+    {
+        CpuLogicalProcessor_t processor{ cpu, cpu, 0, 0, 0, CpuCoreType::Unknown };
+        const std::string topology_path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        _ReadUInt32(topology_path + "core_id", processor.CoreId);
+        _ReadUInt32(topology_path + "physical_package_id", processor.PackageId);
+        topology.emplace_back(processor);
+    }
+
+    DIR* node_dir = opendir("/sys/devices/system/node");
+    if (node_dir != nullptr)
+    {
+        for (dirent* entry = readdir(node_dir); entry != nullptr; entry = readdir(node_dir))
+        {
+            unsigned int node;
+            if (sscanf(entry->d_name, "node%u", &node) != 1)
+                continue;
+
+            std::ifstream cpu_list_file(std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist", std::ios::in);
+            std::string cpu_list;
+            std::getline(cpu_list_file, cpu_list);
+            for (auto cpu : _ParseCpuList(cpu_list))
+            {
+                for (auto& processor : topology)
+                {
+                    if (processor.Id == cpu)
+                        processor.NumaNode = node;
+                }
+            }
+        }
+        closedir(node_dir);
+    }
+
+    static const std::vector<CpuCoreType> core_types = _LoadCoreTypes();
+    for (auto& processor : topology)
+    {
+        if (processor.Id < core_types.size())
+            processor.CoreType = core_types[processor.Id];
+    }
+
+    _FillSmtIndexes(topology);
+    return topology;
+}
+
+std::vector<uint32_t> GetCurrentThreadAffinity()
+{
+    return _GetAffinity(0);
+}
+
+bool SetCurrentThreadAffinity(std::vector<uint32_t> const& cpus)
+{
+    if (cpus.empty())
+        return false;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (auto cpu : cpus)
+    {
+        if (cpu >= CPU_SETSIZE)
+            return false;
+
+        CPU_SET(cpu, &cpu_set);
+    }
+
+    return sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+}
+
+static std::vector<std::string> _SplitFields(std::string const& line, char separator)
+{
+    std::vector<std::string> fields;
+    std::size_t begin = 0;
+    for (std::size_t end; (end = line.find(separator, begin)) != std::string::npos; begin = end + 1)
+        fields.emplace_back(line.substr(begin, end - begin));
+
+    fields.emplace_back(line.substr(begin));
+    return fields;
+}
+
+// Directory of the calling process in the cgroup hierarchy holding controller, or in the v2 unified hierarchy when
+// controller is empty. mount_point receives the hierarchy mount point.
+static bool _FindCgroupDirectory(std::string const& controller, std::string& directory, std::string& mount_point)
+{
+    std::string cgroup_path;
+    std::ifstream cgroup_file("/proc/self/cgroup", std::ios::in);
+    for (std::string line; std::getline(cgroup_file, line);)
+    {
+        // hierarchy-ID:controller-list:cgroup-path
+        const auto first = line.find(':');
+        const auto second = line.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos)
+            continue;
+
+        const auto controllers = _SplitFields(line.substr(first + 1, second - first - 1), ',');
+        if (controller.empty() ? line.compare(0, second + 1, "0::") == 0 : std::find(controllers.begin(), controllers.end(), controller) != controllers.end())
+        {
+            cgroup_path = line.substr(second + 1);
+            break;
+        }
+    }
+
+    if (cgroup_path.empty())
+        return false;
+
+    std::ifstream mountinfo_file("/proc/self/mountinfo", std::ios::in);
+    for (std::string line; std::getline(mountinfo_file, line);)
+    {
+        // id parent major:minor root mount-point options [optional...] - fstype source super-options
+        const auto fields = _SplitFields(line, ' ');
+        const auto separator = std::find(fields.begin(), fields.end(), "-");
+        if (fields.size() < 5 || std::distance(separator, fields.end()) < 4)
+            continue;
+
+        const auto& fs_type = *(separator + 1);
+        if (controller.empty() ? fs_type != "cgroup2" : fs_type != "cgroup")
+            continue;
+
+        if (!controller.empty())
+        {
+            const auto options = _SplitFields(*(separator + 3), ',');
+            if (std::find(options.begin(), options.end(), controller) == options.end())
+                continue;
+        }
+
+        // The mount may expose a sub tree of the hierarchy, like in containers.
+        const auto& root = fields[3];
+        mount_point = fields[4];
+        std::string relative_path;
+        if (root == "/")
+            relative_path = cgroup_path;
+        else if (cgroup_path.compare(0, root.size(), root) == 0)
+            relative_path = cgroup_path.substr(root.size());
+
+        directory = mount_point + (relative_path == "/" ? std::string() : relative_path);
+        return true;
+    }
+
+    return false;
+}
+
+// Smallest cpu quota from the cgroup directory up to the hierarchy mount point, limits of parent groups apply too.
+static uint32_t _ReadCgroupCpuQuota(std::string directory, std::string const& mount_point, bool unified)
+{
+    uint32_t limit = UINT32_MAX;
+    while (true)
+    {
+        long long quota = -1;
+        long long period = 0;
+        if (unified)
+        {
+            // "max 100000" or "<quota> <period>"
+            std::ifstream cpu_max_file(directory + "/cpu.max", std::ios::in);
+            std::string quota_string;
+            if (cpu_max_file >> quota_string >> period && quota_string != "max")
+                quota = strtoll(quota_string.c_str(), nullptr, 10);
+        }
+        else
+        {
+            std::ifstream quota_file(directory + "/cpu.cfs_quota_us", std::ios::in);
+            std::ifstream period_file(directory + "/cpu.cfs_period_us", std::ios::in);
+            if (!(quota_file >> quota) || !(period_file >> period))
+                quota = -1;
+        }
+
+        if (quota > 0 && period > 0)
+            limit = std::min(limit, static_cast<uint32_t>((quota + period - 1) / period));
+
+        const auto parent = directory.rfind('/');
+        if (directory.size() <= mount_point.size() || parent == std::string::npos)
+            break;
+
+        directory.erase(parent);
+    }
+
+    return limit;
+}
+
+static uint32_t _ReadCgroupCpusetCount(std::string const& directory, bool unified)
+{
+    for (auto file_name : unified ? std::vector<const char*>{ "/cpuset.cpus.effective" } : std::vector<const char*>{ "/cpuset.effective_cpus", "/cpuset.cpus" })
+    {
+        std::ifstream cpuset_file(directory + file_name, std::ios::in);
+        std::string cpu_list;
+        if (std::getline(cpuset_file, cpu_list))
+        {
+            const auto cpus = _ParseCpuList(cpu_list);
+            if (!cpus.empty())
+                return static_cast<uint32_t>(cpus.size());
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+uint32_t GetEffectiveParallelism()
+{
+    uint32_t parallelism = static_cast<uint32_t>(_GetAffinity(getpid()).size());
+    if (parallelism == 0)
+        parallelism = std::max(1u, std::thread::hardware_concurrency());
+
+    // Hybrid systems can have both hierarchies, the most restrictive limit wins.
+    std::string directory;
+    std::string mount_point;
+    if (_FindCgroupDirectory(std::string(), directory, mount_point))
+    {
+        parallelism = std::min(parallelism, _ReadCgroupCpuQuota(directory, mount_point, true));
+        parallelism = std::min(parallelism, _ReadCgroupCpusetCount(directory, true));
+    }
+
+    if (_FindCgroupDirectory("cpu", directory, mount_point))
+        parallelism = std::min(parallelism, _ReadCgroupCpuQuota(directory, mount_point, false));
+
+    if (_FindCgroupDirectory("cpuset", directory, mount_point))
+        parallelism = std::min(parallelism, _ReadCgroupCpusetCount(directory, false));
+
+    return std::max<uint32_t>(parallelism, 1);
+}
+
 TranslatedMode GetTranslatedMode()
 {
     return TranslatedMode::Unavailable;
@@ -708,6 +1243,46 @@ bool SetCurrentThreadName(std::string const& thread_name)
     return pthread_setname_np(thread_name.c_str()) == 0;
 }
 
+// macOS doesn't expose the processors layout nor thread pinning.
+std::vector<CpuLogicalProcessor_t> GetCpuTopology()
+{
+    std::vector<CpuLogicalProcessor_t> topology;
+    int cpu_count = 0;
+    size_t size = sizeof(cpu_count);
+    if (sysctlbyname("hw.logicalcpu", &cpu_count, &size, NULL, 0) != 0)
+        cpu_count = 1;
+
+    for (int cpu = 0; cpu < cpu_count; ++cpu)
+        topology.emplace_back(CpuLogicalProcessor_t{ static_cast<uint32_t>(cpu), static_cast<uint32_t>(cpu), 0, 0, 0, CpuCoreType::Unknown });
+
+    _FillSmtIndexes(topology);
+    return topology;
+}
+
+std::vector<uint32_t> GetCurrentThreadAffinity()
+{
+    std::vector<uint32_t> cpus;
+    for (auto const& processor : GetCpuTopology())
+        cpus.emplace_back(processor.Id);
+
+    return cpus;
+}
+
+bool SetCurrentThreadAffinity(std::vector<uint32_t> const&)
+{
+    return false;
+}
+
+uint32_t GetEffectiveParallelism()
+{
+    int cpu_count = 0;
+    size_t size = sizeof(cpu_count);
+    if (sysctlbyname("hw.activecpu", &cpu_count, &size, NULL, 0) != 0 || cpu_count < 1)
+        cpu_count = 1;
+
+    return static_cast<uint32_t>(cpu_count);
+}
+
 TranslatedMode GetTranslatedMode()
 {
     int ret = 0;
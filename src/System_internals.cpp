@@ -79,3 +79,40 @@ SYSTEM_HIDE_API(std::string, SYSTEM_CALL_DEFAULT) ExpandSymlink(std::string file
 }
 
 #endif
+
+#if defined(SYSTEM_SIMD_X86)
+#include <System/SystemCPUExtensions.h>
+#endif
+
+namespace System {
+
+static SimdSupport_t _DetectSimdSupport()
+{
+    SimdSupport_t support{};
+#if defined(SYSTEM_SIMD_X86)
+    const auto leaf1 = CpuFeatures::CpuId(1);
+    const auto max_leaf = CpuFeatures::CpuId(0).Registers.eax;
+    const auto leaf7 = max_leaf >= 7 ? CpuFeatures::CpuId(7, 0) : CpuFeatures::CpuId_t{};
+    const unsigned long long xcr0 = CpuFeatures::HasFeature(leaf1, CpuFeatures::OSXSAVE) ? CpuFeatures::GetXCR0() : 0;
+    const bool avx_state = (xcr0 & (CpuFeatures::XCR0_SSE | CpuFeatures::XCR0_AVX)) == (CpuFeatures::XCR0_SSE | CpuFeatures::XCR0_AVX);
+    const bool avx512_state = avx_state && (xcr0 & CpuFeatures::XCR0_AVX512) == CpuFeatures::XCR0_AVX512;
+
+    support.SSE2 = CpuFeatures::HasFeature(leaf1, CpuFeatures::SSE2);
+    support.SSSE3 = CpuFeatures::HasFeature(leaf1, CpuFeatures::SSSE3);
+    support.SSE41 = CpuFeatures::HasFeature(leaf1, CpuFeatures::SSE4_1);
+    support.AVX2 = avx_state && CpuFeatures::HasFeature(leaf1, CpuFeatures::AVX) && CpuFeatures::HasFeature(leaf7, CpuFeatures::AVX2);
+    support.AVX512BW = avx512_state && CpuFeatures::HasFeature(leaf7, CpuFeatures::AVX512F) && CpuFeatures::HasFeature(leaf7, CpuFeatures::AVX512BW);
+    support.AVX512VBMI = support.AVX512BW && CpuFeatures::HasFeature(leaf7, CpuFeatures::AVX512_VBMI);
+#elif defined(SYSTEM_SIMD_NEON)
+    support.NEON = true;
+#endif
+    return support;
+}
+
+SYSTEM_HIDE_API(SimdSupport_t const&, SYSTEM_CALL_DEFAULT) GetSimdSupport()
+{
+    static const SimdSupport_t support = _DetectSimdSupport();
+    return support;
+}
+
+}
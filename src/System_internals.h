@@ -17,6 +17,8 @@
  * <http://www.gnu.org/licenses/>.
  */
 
+#pragma once
+
 #include <System/SystemExports.h>
 
 #if defined(SYSTEM_OS_WINDOWS)
@@ -36,3 +38,101 @@ SYSTEM_HIDE_API(std::string , SYSTEM_CALL_DEFAULT) ExpandSymlink(std::string fil
 }
 
 #endif
+
+#include <System/SystemCompiler.h>
+
+#include <cstdint>
+
+#if defined(SYSTEM_COMPILER_MSVC)
+    #include <intrin.h>
+#endif
+
+#if defined(SYSTEM_ARCH_X86) || defined(SYSTEM_ARCH_X64)
+    #define SYSTEM_SIMD_X86
+    #include <immintrin.h>
+#elif defined(SYSTEM_ARCH_ARM64) || defined(__ARM_NEON)
+    #define SYSTEM_SIMD_NEON
+    #include <arm_neon.h>
+#endif
+
+// Compile a function for an instruction set the translation unit is not built for, callers check GetSimdSupport.
+// MSVC accepts every intrinsic without it.
+#if defined(SYSTEM_COMPILER_GCC) || defined(SYSTEM_COMPILER_CLANG)
+    #define SYSTEM_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define SYSTEM_TARGET(isa)
+#endif
+
+namespace System {
+// Vector instruction sets usable at runtime: the cpu has them and the OS saves their registers.
+struct SimdSupport_t
+{
+    bool SSE2;
+    bool SSSE3;
+    bool SSE41;
+    bool AVX2;
+    bool AVX512BW;
+    bool AVX512VBMI;
+    bool NEON;
+};
+
+SYSTEM_HIDE_API(SimdSupport_t const&, SYSTEM_CALL_DEFAULT) GetSimdSupport();
+
+// Bit scans of the vector compare masks, mask must not be 0.
+inline unsigned int CountTrailingZeros(uint64_t mask)
+{
+#if defined(SYSTEM_COMPILER_MSVC) && defined(SYSTEM_ARCH_X64)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return index;
+#elif defined(SYSTEM_COMPILER_MSVC)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(mask)))
+        return index;
+
+    _BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+    return index + 32;
+#else
+    return static_cast<unsigned int>(__builtin_ctzll(mask));
+#endif
+}
+
+inline unsigned int CountLeadingZeros(uint64_t mask)
+{
+#if defined(SYSTEM_COMPILER_MSVC) && defined(SYSTEM_ARCH_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, mask);
+    return 63 - index;
+#elif defined(SYSTEM_COMPILER_MSVC)
+    unsigned long index;
+    if (_BitScanReverse(&index, static_cast<unsigned long>(mask >> 32)))
+        return 31 - index;
+
+    _BitScanReverse(&index, static_cast<unsigned long>(mask));
+    return 63 - index;
+#else
+    return static_cast<unsigned int>(__builtin_clzll(mask));
+#endif
+}
+
+inline unsigned int PopCount(uint64_t mask)
+{
+#if defined(SYSTEM_COMPILER_MSVC)
+    // __popcnt64 needs the POPCNT instruction.
+    mask = mask - ((mask >> 1) & 0x5555555555555555ull);
+    mask = (mask & 0x3333333333333333ull) + ((mask >> 2) & 0x3333333333333333ull);
+    mask = (mask + (mask >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return static_cast<unsigned int>((mask * 0x0101010101010101ull) >> 56);
+#else
+    return static_cast<unsigned int>(__builtin_popcountll(mask));
+#endif
+}
+
+#if defined(SYSTEM_SIMD_NEON)
+// NEON has no movemask: narrow a byte compare result to 4 bits per byte, lane i is bits [4i, 4i + 3].
+inline uint64_t NeonNibbleMask(uint8x16_t compare)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(compare), 4)), 0);
+}
+#endif
+}
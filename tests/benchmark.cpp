@@ -0,0 +1,1001 @@
+#include <System/ThreadPool.hpp>
+#include <System/MPMCQueue.hpp>
+#include <System/String.hpp>
+#include <System/InternPool.hpp>
+#include <System/Encoding.hpp>
+#include <utfcpp/utf8.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Every allocation done through the global operator new is counted, so benchmarks can report allocations per operation.
+// The replacements below are a matched malloc/free pair: every operator new form ends in std::malloc and every operator
+// delete form ends in std::free, through the two functions right below.
+static std::atomic<std::size_t> g_AllocationCount{ 0 };
+
+static void* CountedAllocate(std::size_t size)
+{
+    g_AllocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+static void CountedFree(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void* operator new(std::size_t size) { return CountedAllocate(size); }
+void* operator new[](std::size_t size) { return CountedAllocate(size); }
+void operator delete(void* ptr) noexcept { CountedFree(ptr); }
+void operator delete[](void* ptr) noexcept { CountedFree(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { CountedFree(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { CountedFree(ptr); }
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct Benchmark_t
+{
+    const char* Name;
+    void(*Run)();
+};
+
+std::vector<Benchmark_t>& Benchmarks()
+{
+    static std::vector<Benchmark_t> benchmarks;
+    return benchmarks;
+}
+
+struct BenchmarkRegistrar
+{
+    BenchmarkRegistrar(const char* name, void(*run)())
+    {
+        Benchmarks().push_back(Benchmark_t{ name, run });
+    }
+};
+
+#define SYSTEM_BENCHMARK(function, name) static BenchmarkRegistrar function##_registrar(name, &function)
+
+void PrintResult(const char* label, std::size_t operations, clock_type::duration elapsed, std::size_t allocations)
+{
+    const double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    std::printf("  %-48s %10.1f ns/op %8.3f allocs/op\n", label, ns / operations, static_cast<double>(allocations) / operations);
+}
+
+///////////////////////////////////////////////////////////
+// ThreadPool
+
+// What ThreadPool::Push used to do: make_shared<packaged_task> + bind, wrapped in a std::function.
+class LegacyPool
+{
+    std::mutex _Mutex;
+    std::condition_variable _Notifier;
+    std::vector<std::function<void()>> _Tasks;
+    bool _Stop = false;
+    std::thread _Worker;
+
+public:
+    LegacyPool():
+        _Worker([this]()
+        {
+            std::vector<std::function<void()>> tasks;
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(_Mutex);
+                    _Notifier.wait(lock, [this]() { return _Stop || !_Tasks.empty(); });
+                    if (_Tasks.empty())
+                        return;
+                    tasks.swap(_Tasks);
+                }
+                for (auto& task : tasks)
+                    task();
+                tasks.clear();
+            }
+        })
+    {
+    }
+
+    ~LegacyPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_Mutex);
+            _Stop = true;
+        }
+        _Notifier.notify_one();
+        _Worker.join();
+    }
+
+    template <class Func, class... Args>
+    auto Push(Func&& fn, Args &&...args)
+    {
+        using return_type = decltype(fn(args...));
+
+        auto task{ std::make_shared<std::packaged_task<return_type()>>(
+            std::bind(std::forward<Func>(fn), std::forward<Args>(args)...)
+        ) };
+
+        auto future{ task->get_future() };
+        {
+            std::lock_guard<std::mutex> lock(_Mutex);
+            _Tasks.emplace_back([task]() { (*task)(); });
+        }
+        _Notifier.notify_one();
+        return future;
+    }
+};
+
+void BenchmarkThreadPoolSubmit()
+{
+    constexpr std::size_t task_count = 200000;
+    std::atomic<std::size_t> counter{ 0 };
+    auto work = [&counter](std::size_t value) { counter.fetch_add(value, std::memory_order_relaxed); };
+
+    {
+        LegacyPool pool;
+        std::vector<std::future<void>> futures;
+        futures.reserve(task_count);
+
+        const auto allocations = g_AllocationCount.load();
+        const auto start = clock_type::now();
+        for (std::size_t i = 0; i < task_count; ++i)
+            futures.emplace_back(pool.Push(work, i));
+        futures.back().wait();
+        const auto elapsed = clock_type::now() - start;
+        PrintResult("legacy Push (shared_ptr + bind + function)", task_count, elapsed, g_AllocationCount.load() - allocations);
+    }
+
+    for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+    {
+        const char* mode_name = mode == System::ThreadPoolMode::SharedQueue ? "SharedQueue" : "WorkStealing";
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 1;
+        options.Mode = mode;
+
+        System::ThreadPool pool;
+        pool.Start(options);
+        // Warm up the queue storage.
+        for (std::size_t i = 0; i < task_count; ++i)
+            pool.Post(work, i);
+        pool.Push([]() {}).wait();
+
+        {
+            std::vector<std::future<void>> futures;
+            futures.reserve(task_count);
+
+            const auto allocations = g_AllocationCount.load();
+            const auto start = clock_type::now();
+            for (std::size_t i = 0; i < task_count; ++i)
+                futures.emplace_back(pool.Push(work, i));
+            futures.back().wait();
+            const auto elapsed = clock_type::now() - start;
+            PrintResult((std::string("Push ") + mode_name).c_str(), task_count, elapsed, g_AllocationCount.load() - allocations);
+        }
+        {
+            std::promise<void> done;
+            auto done_future = done.get_future();
+
+            const auto allocations = g_AllocationCount.load();
+            const auto start = clock_type::now();
+            for (std::size_t i = 0; i < task_count; ++i)
+                pool.Post(work, i);
+            pool.Post([&done]() { done.set_value(); });
+            done_future.wait();
+            const auto elapsed = clock_type::now() - start;
+            // The promise shared state is the single allocation left, and it is paid once for the whole run.
+            PrintResult((std::string("Post ") + mode_name).c_str(), task_count, elapsed, g_AllocationCount.load() - allocations);
+        }
+    }
+}
+SYSTEM_BENCHMARK(BenchmarkThreadPoolSubmit, "thread_pool_submit");
+
+// Time between Post and the task starting on an idle worker, after the pool has been idle for a given gap.
+void BenchmarkThreadPoolWakeLatency()
+{
+    constexpr std::size_t sample_count = 2000;
+
+    struct Strategy_t
+    {
+        const char* Name;
+        System::ThreadPoolIdleStrategy Idle;
+    };
+
+    Strategy_t strategies[2];
+    strategies[0].Name = "park";
+    strategies[0].Idle.SpinCount = 0;
+    strategies[0].Idle.YieldCount = 0;
+    strategies[1].Name = "spin/yield/park";
+
+    for (auto const& strategy : strategies)
+    {
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 2;
+        options.Idle = strategy.Idle;
+
+        System::ThreadPool pool;
+        pool.Start(options);
+
+        for (auto gap : { std::chrono::microseconds(0), std::chrono::microseconds(5), std::chrono::microseconds(20), std::chrono::microseconds(200) })
+        {
+            std::vector<std::chrono::nanoseconds> samples;
+            samples.reserve(sample_count);
+
+            for (std::size_t i = 0; i < sample_count; ++i)
+            {
+                // Busy wait so the gap is not rounded up by the OS timer slack.
+                const auto gap_end = clock_type::now() + gap;
+                while (clock_type::now() < gap_end)
+                {
+                }
+
+                std::atomic<bool> done{ false };
+                clock_type::time_point started;
+                const auto posted = clock_type::now();
+                pool.Post([&done, &started]()
+                {
+                    started = clock_type::now();
+                    done.store(true, std::memory_order_release);
+                });
+
+                while (!done.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+
+                samples.emplace_back(started - posted);
+            }
+
+            std::sort(samples.begin(), samples.end());
+            std::printf("  %-16s gap %4lld us: p50 %8.2f us p99 %8.2f us\n",
+                strategy.Name,
+                static_cast<long long>(gap.count()),
+                samples[samples.size() / 2].count() / 1000.0,
+                samples[samples.size() * 99 / 100].count() / 1000.0);
+        }
+    }
+}
+SYSTEM_BENCHMARK(BenchmarkThreadPoolWakeLatency, "thread_pool_wake_latency");
+
+///////////////////////////////////////////////////////////
+// MPMCQueue
+
+// The ThreadPool shared queue before MPMCQueue: a ring under a mutex, bounded like MPMCQueue for the comparison.
+class MutexQueue
+{
+    std::mutex _Mutex;
+    System::details::RingQueue<std::size_t> _Items;
+    std::size_t _Capacity;
+
+public:
+    explicit MutexQueue(std::size_t capacity):
+        _Capacity(capacity)
+    {}
+
+    bool TryPush(std::size_t value)
+    {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        if (_Items.Size() >= _Capacity)
+            return false;
+
+        _Items.PushBack(std::move(value));
+        return true;
+    }
+
+    bool TryPop(std::size_t& value)
+    {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        if (_Items.Empty())
+            return false;
+
+        _Items.PopFront(value);
+        return true;
+    }
+};
+
+// thread_count producers and as many consumers move operation_count items through the queue.
+template <typename Queue>
+clock_type::duration RunQueueContention(Queue& queue, std::size_t thread_count, std::size_t operation_count)
+{
+    std::atomic<bool> go{ false };
+    std::atomic<std::size_t> popped{ 0 };
+    std::vector<std::thread> threads;
+
+    for (std::size_t producer = 0; producer < thread_count; ++producer)
+    {
+        threads.emplace_back([&queue, &go, producer, thread_count, operation_count]()
+        {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+
+            for (std::size_t i = producer; i < operation_count; i += thread_count)
+            {
+                while (!queue.TryPush(i))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    for (std::size_t consumer = 0; consumer < thread_count; ++consumer)
+    {
+        threads.emplace_back([&queue, &go, &popped, operation_count]()
+        {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+
+            std::size_t value;
+            while (popped.load(std::memory_order_relaxed) < operation_count)
+            {
+                if (queue.TryPop(value))
+                    popped.fetch_add(1, std::memory_order_relaxed);
+                else
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    const auto start = clock_type::now();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : threads)
+        thread.join();
+
+    return clock_type::now() - start;
+}
+
+void BenchmarkMPMCQueueContention()
+{
+    constexpr std::size_t operation_count = 400000;
+    constexpr std::size_t capacity = 1024;
+    const std::size_t max_threads = std::max<std::size_t>(4, std::thread::hardware_concurrency());
+
+    for (std::size_t thread_count = 1; thread_count <= max_threads; thread_count *= 2)
+    {
+        char label[64];
+        {
+            MutexQueue queue(capacity);
+            const auto elapsed = RunQueueContention(queue, thread_count, operation_count);
+            std::snprintf(label, sizeof(label), "mutex queue %zu producers/%zu consumers", thread_count, thread_count);
+            PrintResult(label, operation_count, elapsed, 0);
+        }
+        {
+            System::MPMCQueue<std::size_t> queue(capacity);
+            const auto elapsed = RunQueueContention(queue, thread_count, operation_count);
+            std::snprintf(label, sizeof(label), "MPMCQueue %zu producers/%zu consumers", thread_count, thread_count);
+            PrintResult(label, operation_count, elapsed, 0);
+        }
+    }
+}
+SYSTEM_BENCHMARK(BenchmarkMPMCQueueContention, "mpmc_queue_contention");
+
+///////////////////////////////////////////////////////////
+// String
+
+// Sizes from a header key to a large buffer, every size processes about the same number of bytes.
+constexpr std::size_t StringBenchmarkSizes[] = { 8, 16, 64, 256, 4096, 65536, 1 << 20 };
+constexpr std::size_t StringBenchmarkBytes = 256 << 20;
+
+std::string MakeMixedCaseText(std::size_t size)
+{
+    static const char text[] = "Content-Type: Text/HTML; Charset=UTF-8\r\nX-Request-Id: 0123456789ABCDEF\r\n";
+    std::string result;
+    result.reserve(size);
+    while (result.size() < size)
+        result += text[result.size() % (sizeof(text) - 1)];
+
+    return result;
+}
+
+template <typename Convert>
+void RunStringBenchmark(const char* name, std::size_t size, Convert&& convert)
+{
+    std::string buffer = MakeMixedCaseText(size);
+    const std::size_t iterations = std::max<std::size_t>(1, StringBenchmarkBytes / size);
+
+    const auto start = clock_type::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        convert(&buffer[0], buffer.size());
+        // Alternate the case so every pass has work to do.
+        buffer[0] ^= 0x20;
+    }
+    const auto elapsed = clock_type::now() - start;
+
+    char label[64];
+    std::snprintf(label, sizeof(label), "%s %zu B", name, size);
+    PrintResult(label, iterations, elapsed, 0);
+}
+
+void BenchmarkStringCase()
+{
+    for (auto size : StringBenchmarkSizes)
+    {
+        // What ToUpper used to do: a locale aware std::toupper call per byte.
+        RunStringBenchmark("std::toupper", size, [](char* str, std::size_t len)
+        {
+            for (std::size_t i = 0; i < len; ++i)
+                str[i] = static_cast<char>(std::toupper(static_cast<unsigned char>(str[i])));
+        });
+        RunStringBenchmark("String::ToUpper", size, [](char* str, std::size_t len) { System::String::ToUpper(str, len); });
+        RunStringBenchmark("String::ToLower", size, [](char* str, std::size_t len) { System::String::ToLower(str, len); });
+    }
+}
+SYSTEM_BENCHMARK(BenchmarkStringCase, "string_case");
+
+void BenchmarkStringTrim()
+{
+    constexpr std::size_t iterations = 1000000;
+    const std::string payload = MakeMixedCaseText(64);
+
+    for (std::size_t padding : { 2, 32, 1024 })
+    {
+        const std::string text = std::string(padding, ' ') + payload + std::string(padding, '\t');
+        std::size_t checksum = 0;
+        char label[64];
+
+        // What CopyTrim used to do: copy everything, then erase with a std::isspace call per byte.
+        auto start = clock_type::now();
+        auto allocations = g_AllocationCount.load();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            std::string copy(text);
+            copy.erase(std::find_if(copy.rbegin(), copy.rend(), [](char c) { return !std::isspace(static_cast<unsigned char>(c)); }).base(), copy.end());
+            copy.erase(copy.begin(), std::find_if(copy.begin(), copy.end(), [](char c) { return !std::isspace(static_cast<unsigned char>(c)); }));
+            checksum += copy.size();
+        }
+        std::snprintf(label, sizeof(label), "copy + erase, %zu spaces each side", padding);
+        PrintResult(label, iterations, clock_type::now() - start, g_AllocationCount.load() - allocations);
+
+        start = clock_type::now();
+        allocations = g_AllocationCount.load();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::String::CopyTrim(text).size();
+        std::snprintf(label, sizeof(label), "String::CopyTrim, %zu spaces each side", padding);
+        PrintResult(label, iterations, clock_type::now() - start, g_AllocationCount.load() - allocations);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            std::string_view view(text.data(), text.size() - (i & 1));
+            checksum += System::String::TrimView(view).size();
+        }
+        std::snprintf(label, sizeof(label), "String::TrimView, %zu spaces each side", padding);
+        PrintResult(label, iterations, clock_type::now() - start, 0);
+
+        if (checksum == 0)
+            std::printf("unexpected checksum\n");
+    }
+}
+SYSTEM_BENCHMARK(BenchmarkStringTrim, "string_trim");
+
+void BenchmarkStringSplit()
+{
+    // A CSV like line: short fields, and a header block for the multi byte delimiters.
+    std::string line;
+    for (std::size_t i = 0; line.size() < 4096; ++i)
+        line += "field" + std::to_string(i) + (i % 7 == 0 ? ";" : ",");
+
+    const std::string headers = MakeMixedCaseText(4096);
+    constexpr std::size_t iterations = 20000;
+    std::size_t checksum = 0;
+    char label[64];
+
+    auto start = clock_type::now();
+    auto allocations = g_AllocationCount.load();
+    for (std::size_t i = 0; i < iterations; ++i)
+        checksum += System::String::SplitString(line, ',').size();
+    std::snprintf(label, sizeof(label), "SplitString, vector<string>");
+    PrintResult(label, iterations, clock_type::now() - start, g_AllocationCount.load() - allocations);
+
+    start = clock_type::now();
+    allocations = g_AllocationCount.load();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        for (auto token : System::String::Split(line, ','))
+            checksum += token.size();
+    }
+    std::snprintf(label, sizeof(label), "Split, char");
+    PrintResult(label, iterations, clock_type::now() - start, g_AllocationCount.load() - allocations);
+
+    // What an any-of split costs with std::string_view::find_first_of.
+    start = clock_type::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        const std::string_view view(line);
+        std::size_t position = 0;
+        std::size_t next;
+        while ((next = view.find_first_of(",;", position)) != std::string_view::npos)
+        {
+            checksum += next - position;
+            position = next + 1;
+        }
+    }
+    std::snprintf(label, sizeof(label), "string_view::find_first_of");
+    PrintResult(label, iterations, clock_type::now() - start, 0);
+
+    start = clock_type::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        for (auto token : System::String::SplitAnyOf(line, ",;"))
+            checksum += token.size();
+    }
+    std::snprintf(label, sizeof(label), "SplitAnyOf");
+    PrintResult(label, iterations, clock_type::now() - start, 0);
+
+    start = clock_type::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        for (auto token : System::String::Split(headers, "\r\n"))
+            checksum += token.size();
+    }
+    std::snprintf(label, sizeof(label), "Split, \"\\r\\n\"");
+    PrintResult(label, iterations, clock_type::now() - start, 0);
+
+    if (checksum == 0)
+        std::printf("unexpected checksum\n");
+}
+SYSTEM_BENCHMARK(BenchmarkStringSplit, "string_split");
+
+void BenchmarkStringJoin()
+{
+    for (std::size_t count : { 8, 1024, 65536 })
+    {
+        std::vector<std::string> strings;
+        for (std::size_t i = 0; i < count; ++i)
+            strings.emplace_back(MakeMixedCaseText(8 + i % 32));
+
+        const std::size_t iterations = std::max<std::size_t>(1, (1 << 22) / count);
+        std::size_t checksum = 0;
+        char label[64];
+
+        // What Join used to do: grow the result piece by piece.
+        auto start = clock_type::now();
+        auto allocations = g_AllocationCount.load();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            std::string result = strings[0];
+            for (std::size_t j = 1; j < strings.size(); ++j)
+            {
+                result += ", ";
+                result += strings[j];
+            }
+            checksum += result.size();
+        }
+        std::snprintf(label, sizeof(label), "operator+=, %zu strings", count);
+        PrintResult(label, iterations, clock_type::now() - start, g_AllocationCount.load() - allocations);
+
+        start = clock_type::now();
+        allocations = g_AllocationCount.load();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::String::Join(strings, ", ").size();
+        std::snprintf(label, sizeof(label), "String::Join, %zu strings", count);
+        PrintResult(label, iterations, clock_type::now() - start, g_AllocationCount.load() - allocations);
+
+        std::string buffer;
+        start = clock_type::now();
+        allocations = g_AllocationCount.load();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            buffer.clear();
+            System::String::AppendJoin(buffer, strings, ", ");
+            checksum += buffer.size();
+        }
+        std::snprintf(label, sizeof(label), "String::AppendJoin, %zu strings", count);
+        PrintResult(label, iterations, clock_type::now() - start, g_AllocationCount.load() - allocations);
+
+        if (checksum == 0)
+            std::printf("unexpected checksum\n");
+    }
+}
+SYSTEM_BENCHMARK(BenchmarkStringJoin, "string_join");
+
+void BenchmarkStringSearch()
+{
+    // A log like buffer, searched for tokens that are rare in it.
+    std::string text;
+    for (std::size_t i = 0; text.size() < (4 << 20); ++i)
+        text += "2024-01-01T00:00:00 INFO worker " + std::to_string(i % 977) + " processed request id=" + std::to_string(i * 7919 % 100003) + "\n";
+
+    constexpr std::size_t iterations = 20;
+    const std::size_t bytes = text.size() * iterations;
+    std::size_t checksum = 0;
+    char label[64];
+
+    auto report = [&](const char* name, clock_type::duration elapsed)
+    {
+        char rate_label[96];
+        const double seconds = std::chrono::duration<double>(elapsed).count();
+        std::snprintf(rate_label, sizeof(rate_label), "%s (%.2f GB/s)", name, bytes / seconds / 1e9);
+        PrintResult(rate_label, iterations, elapsed, 0);
+    };
+
+    auto start = clock_type::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        checksum += std::string_view(text).find("FATAL ERROR");
+    report("string_view::find", clock_type::now() - start);
+
+    start = clock_type::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        checksum += System::String::Find(text, "FATAL ERROR");
+    report("String::Find", clock_type::now() - start);
+
+    for (std::size_t pattern_count : { 8, 32, 200 })
+    {
+        std::vector<std::string> patterns;
+        for (std::size_t i = 0; i < pattern_count; ++i)
+            patterns.push_back("token_" + std::to_string(i * 31));
+        patterns.push_back("request id=4242\n");
+
+        // What a grep for many tokens used to cost: one find per token.
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            for (auto const& pattern : patterns)
+            {
+                for (std::size_t position = text.find(pattern); position != std::string::npos; position = text.find(pattern, position + 1))
+                    ++checksum;
+            }
+        }
+        std::snprintf(label, sizeof(label), "find x %zu", patterns.size());
+        report(label, clock_type::now() - start);
+
+        const System::String::MultiSearcher searcher(patterns);
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            searcher.ForEachMatch(text, [&](System::String::MultiSearcher::Match const&) { ++checksum; });
+        std::snprintf(label, sizeof(label), "MultiSearcher x %zu", patterns.size());
+        report(label, clock_type::now() - start);
+    }
+
+    if (checksum == 0)
+        std::printf("unexpected checksum\n");
+}
+SYSTEM_BENCHMARK(BenchmarkStringSearch, "string_search");
+
+void BenchmarkStringIntern()
+{
+    std::vector<std::string> names;
+    for (std::size_t i = 0; i < 4096; ++i)
+        names.push_back("service.http.requests." + std::to_string(i * 2654435761u % 100000));
+
+    constexpr std::size_t iterations = 1000000;
+    std::size_t checksum = 0;
+
+    // What keying a map by std::string costs: a key built and hashed per lookup.
+    std::unordered_map<std::string, std::size_t> map;
+    for (std::size_t i = 0; i < names.size(); ++i)
+        map.emplace(names[i], i);
+
+    auto start = clock_type::now();
+    auto allocations = g_AllocationCount.load();
+    for (std::size_t i = 0; i < iterations; ++i)
+        checksum += map.find(std::string(names[i % names.size()]))->second;
+    PrintResult("unordered_map<std::string> find", iterations, clock_type::now() - start, g_AllocationCount.load() - allocations);
+
+    System::String::InternPool pool;
+    for (auto const& name : names)
+        pool.Intern(name);
+
+    start = clock_type::now();
+    allocations = g_AllocationCount.load();
+    for (std::size_t i = 0; i < iterations; ++i)
+        checksum += pool.Intern(names[i % names.size()]).Id();
+    PrintResult("InternPool::Intern, existing string", iterations, clock_type::now() - start, g_AllocationCount.load() - allocations);
+
+    // Comparing interned handles against comparing the strings.
+    const auto first = pool.Intern(names[0]);
+    start = clock_type::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        checksum += names[i % names.size()] == names[(i * 7) % names.size()];
+    PrintResult("std::string ==", iterations, clock_type::now() - start, 0);
+
+    std::vector<System::String::InternPool::Handle> handles;
+    for (auto const& name : names)
+        handles.push_back(pool.Find(name));
+
+    start = clock_type::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+        checksum += handles[i % handles.size()] == handles[(i * 7) % handles.size()] || handles[i % handles.size()] == first;
+    PrintResult("InternPool::Handle ==", iterations, clock_type::now() - start, 0);
+
+    if (checksum == 0)
+        std::printf("unexpected checksum\n");
+}
+SYSTEM_BENCHMARK(BenchmarkStringIntern, "string_intern");
+
+///////////////////////////////////////////////////////////
+// Encoding
+
+void BenchmarkUtf()
+{
+    // ASCII only, then Latin with accents, then mostly CJK.
+    const std::pair<const char*, std::string> texts[] = {
+        { "ascii", MakeMixedCaseText(1 << 20) },
+        { "latin", [] { std::string r; while (r.size() < (1 << 20)) r += "Le cœur déçu mais l'âme plutôt naïve, Louÿs rêva de crapaüter. "; return r; }() },
+        { "cjk", [] { std::string r; while (r.size() < (1 << 20)) r += "統一碼聯盟的目標是，用一個字元集涵蓋所有文字。"; return r; }() },
+    };
+
+    constexpr std::size_t iterations = 50;
+    std::size_t checksum = 0;
+    char label[96];
+
+    for (auto const& text : texts)
+    {
+        const std::size_t bytes = text.second.size() * iterations;
+        auto report = [&](const char* name, clock_type::duration elapsed)
+        {
+            const double seconds = std::chrono::duration<double>(elapsed).count();
+            std::snprintf(label, sizeof(label), "%s, %s (%.2f GB/s)", name, text.first, bytes / seconds / 1e9);
+            PrintResult(label, iterations, elapsed, 0);
+        };
+
+        auto start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += utf8::is_valid(text.second.begin(), text.second.end());
+        report("utf8::is_valid", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::IsValidUtf8(text.second);
+        report("Encoding::IsValidUtf8", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += utf8::utf8to16(text.second).size();
+        report("utf8::utf8to16", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::Utf8ToUtf16(text.second).size();
+        report("Encoding::Utf8ToUtf16", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::Utf8ToUtf32(text.second).size();
+        report("Encoding::Utf8ToUtf32", clock_type::now() - start);
+
+        const std::u16string utf16 = System::Encoding::Utf8ToUtf16(text.second);
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += utf8::utf16to8(utf16).size();
+        report("utf8::utf16to8", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::Utf16ToUtf8(utf16).size();
+        report("Encoding::Utf16ToUtf8", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::Utf8ToUtf16Length(text.second);
+        report("Encoding::Utf8ToUtf16Length", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::Utf16ToUtf8Length(utf16);
+        report("Encoding::Utf16ToUtf8Length", clock_type::now() - start);
+
+        // The same buffers every iteration, as a hot path reusing thread local buffers would.
+        std::u16string buffer16(utf16.size(), u'\0');
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::Convert(text.second, &buffer16[0], buffer16.size()).Written;
+        report("Encoding::Convert utf8 to utf16", clock_type::now() - start);
+
+        std::string buffer8(text.second.size(), '\0');
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::Convert(std::u16string_view(utf16), &buffer8[0], buffer8.size()).Written;
+        report("Encoding::Convert utf16 to utf8", clock_type::now() - start);
+
+        // Network sized chunks that split the sequences.
+        std::u16string chunk_output;
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            System::Encoding::Utf8ToUtf16Transcoder transcoder;
+            for (std::size_t offset = 0; offset < text.second.size(); offset += 4001)
+            {
+                chunk_output.clear();
+                transcoder.Write(std::string_view(text.second).substr(offset, 4001), chunk_output);
+                checksum += chunk_output.size();
+            }
+            transcoder.Finish(chunk_output);
+        }
+        report("Utf8ToUtf16Transcoder 4001B chunks", clock_type::now() - start);
+    }
+
+    if (checksum == 0)
+        std::printf("unexpected checksum\n");
+}
+SYSTEM_BENCHMARK(BenchmarkUtf, "utf");
+
+// The byte loops Encode and Decode had before the vector kernels.
+std::size_t LegacyBase64Encode(char* out, const char* in, std::size_t len)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char* const begin = out;
+    for (auto n = len / 3; n--;)
+    {
+        *out++ = alphabet[(in[0] & 0xfc) >> 2];
+        *out++ = alphabet[((in[0] & 0x03) << 4) + ((in[1] & 0xf0) >> 4)];
+        *out++ = alphabet[((in[2] & 0xc0) >> 6) + ((in[1] & 0x0f) << 2)];
+        *out++ = alphabet[in[2] & 0x3f];
+        in += 3;
+    }
+    return out - begin;
+}
+
+std::size_t LegacyBase64Decode(char* out, const char* src, std::size_t len)
+{
+    static const auto inverse = []
+    {
+        std::array<signed char, 256> r;
+        r.fill(-1);
+        const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; ++i)
+            r[static_cast<unsigned char>(alphabet[i])] = static_cast<signed char>(i);
+        return r;
+    }();
+
+    char* const begin = out;
+    auto in = reinterpret_cast<unsigned char const*>(src);
+    unsigned char c3[3]{}, c4[4]{};
+    int i = 0;
+    while (len-- && *in != '=')
+    {
+        auto const v = inverse[*in];
+        if (v == -1)
+            break;
+        ++in;
+        c4[i] = v;
+        if (++i == 4)
+        {
+            c3[0] = (c4[0] << 2) + ((c4[1] & 0x30) >> 4);
+            c3[1] = ((c4[1] & 0xf) << 4) + ((c4[2] & 0x3c) >> 2);
+            c3[2] = ((c4[2] & 0x3) << 6) + c4[3];
+            for (i = 0; i < 3; i++)
+                *out++ = c3[i];
+            i = 0;
+        }
+    }
+    return out - begin;
+}
+
+void BenchmarkBase64()
+{
+    std::string data;
+    for (std::size_t i = 0; data.size() < (16u << 20); ++i)
+        data += static_cast<char>((i * 2654435761u) >> 13);
+
+    const std::string encoded_data = System::Encoding::Base64::Encode(data, false);
+    std::string encoded(encoded_data.size(), '\0');
+    std::string decoded(data.size(), '\0');
+    std::size_t checksum = 0;
+    char label[96];
+
+    for (std::size_t size : { std::size_t(64), std::size_t(4096), std::size_t(16u << 20) })
+    {
+        // About 64 MB of input per measure.
+        const std::size_t iterations = std::max<std::size_t>(1, (64u << 20) / size);
+        const std::size_t encoded_size = System::Encoding::Base64::EncodedSize(size);
+        auto report = [&](const char* name, clock_type::duration elapsed)
+        {
+            const double seconds = std::chrono::duration<double>(elapsed).count();
+            std::snprintf(label, sizeof(label), "%s, %zu B (%.2f GB/s)", name, size, size * iterations / seconds / 1e9);
+            PrintResult(label, iterations, elapsed, 0);
+        };
+
+        auto start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += LegacyBase64Encode(&encoded[0], data.data(), size);
+        report("legacy Base64 encode", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::Base64::Encode(&encoded[0], data.data(), size, false);
+        report("Base64::Encode", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::Base64::UrlEncode(&encoded[0], data.data(), size, false);
+        report("Base64::UrlEncode", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += LegacyBase64Decode(&decoded[0], encoded_data.data(), encoded_size);
+        report("legacy Base64 decode", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+            checksum += System::Encoding::Base64::Decode(&decoded[0], encoded_data.data(), encoded_size).first;
+        report("Base64::Decode", clock_type::now() - start);
+    }
+
+    // A 16MB payload through 64KB chunks, the output buffers are reused.
+    {
+        constexpr std::size_t chunk_size = 64 * 1024;
+        const std::size_t iterations = 4;
+        const std::size_t size = data.size();
+        auto report = [&](const char* name, clock_type::duration elapsed)
+        {
+            const double seconds = std::chrono::duration<double>(elapsed).count();
+            std::snprintf(label, sizeof(label), "%s (%.2f GB/s)", name, size * iterations / seconds / 1e9);
+            PrintResult(label, iterations, elapsed, 0);
+        };
+
+        const std::string mime = [&]
+        {
+            System::Encoding::Base64::Encoder encoder(System::Encoding::Base64::Alphabet::Standard, true, System::Encoding::Base64::MimeLineLength);
+            std::string r;
+            encoder.Update(data, r);
+            encoder.Finish(r);
+            return r;
+        }();
+
+        std::string chunk_output;
+        auto start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            System::Encoding::Base64::Encoder encoder(System::Encoding::Base64::Alphabet::Standard, true, System::Encoding::Base64::MimeLineLength);
+            for (std::size_t offset = 0; offset < size; offset += chunk_size)
+            {
+                chunk_output.clear();
+                encoder.Update(std::string_view(data).substr(offset, chunk_size), chunk_output);
+                checksum += chunk_output.size();
+            }
+            encoder.Finish(chunk_output);
+        }
+        report("Base64::Encoder MIME, 64KB chunks", clock_type::now() - start);
+
+        start = clock_type::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            System::Encoding::Base64::Decoder decoder;
+            for (std::size_t offset = 0; offset < mime.size(); offset += chunk_size)
+            {
+                chunk_output.clear();
+                decoder.Update(std::string_view(mime).substr(offset, chunk_size), chunk_output);
+                checksum += chunk_output.size();
+            }
+            decoder.Finish(chunk_output);
+        }
+        report("Base64::Decoder MIME, 64KB chunks", clock_type::now() - start);
+    }
+
+    if (checksum == 0)
+        std::printf("unexpected checksum\n");
+}
+SYSTEM_BENCHMARK(BenchmarkBase64, "base64");
+
+}
+
+// Usage: benchmark [filter], runs every benchmark whose name contains filter.
+int main(int argc, char* argv[])
+{
+    const char* filter = argc > 1 ? argv[1] : "";
+    for (auto const& benchmark : Benchmarks())
+    {
+        if (std::strstr(benchmark.Name, filter) == nullptr)
+            continue;
+
+        std::printf("%s\n", benchmark.Name);
+        benchmark.Run();
+    }
+
+    return 0;
+}
@@ -4,7 +4,9 @@
 #include <System/SystemDetector.h>
 #include <System/String.hpp>
 #include <System/Encoding.hpp>
+#include <utfcpp/utf8.h>
 #include <System/StringSwitch.hpp>
+#include <System/InternPool.hpp>
 #include <System/Guid.hpp>
 #include <System/SystemMacro.h>
 #include <System/SystemCompiler.h>
@@ -13,6 +15,13 @@
 #include <System/FunctionName.hpp>
 #include <System/DotNet.hpp>
 #include <System/Date.h>
+#include <System/ThreadPool.hpp>
+#include <System/TaskGroup.hpp>
+#include <System/Future.hpp>
+#include <System/TaskGraph.hpp>
+#include <System/Coroutine.hpp>
+#include <System/MPMCQueue.hpp>
+#include <System/UniqueFunction.hpp>
 
 #include <vector>
 #include <variant>
@@ -24,6 +33,7 @@
 #include <iomanip>
 #include <regex>
 #include <charconv>
+#include <unordered_set>
 
 #define CATCH_CONFIG_RUNNER
 #include "catch.hpp"
@@ -699,6 +709,338 @@ TEST_CASE("String switch", "[string_switch]")
     }
 }
 
+TEST_CASE("UTF conversions", "[utf]")
+{
+    // Code points of every UTF-8 length, in ASCII runs of varied lengths so the vector blocks see every mix.
+    std::u32string code_points;
+    uint32_t seed = 42;
+    for (size_t i = 0; i < 3000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        switch ((seed >> 16) % 6)
+        {
+            case 0: code_points += U"é"; break;
+            case 1: code_points += U"中"; break;
+            case 2: code_points += U"\U0001F600"; break;
+            case 3: code_points += static_cast<char32_t>(0xE000 + (seed >> 8) % 0x1FFF); break;
+            default: code_points += std::u32string((seed >> 4) % 40, U'a' + (seed % 26)); break;
+        }
+    }
+
+    const std::string utf8 = utf8::utf32to8(code_points);
+    const std::u16string utf16 = utf8::utf8to16(utf8);
+
+    for (size_t length : { size_t(0), size_t(1), size_t(15), size_t(16), size_t(33), size_t(200), utf8.length() })
+    {
+        // Cut on a code point boundary.
+        size_t end = std::min(length, utf8.length());
+        while (end < utf8.length() && (static_cast<uint8_t>(utf8[end]) & 0xC0) == 0x80)
+            ++end;
+
+        const std::string_view part(utf8.data(), end);
+        CHECK(System::Encoding::IsValidUtf8(part));
+        CHECK(System::Encoding::Utf8ToUtf16(part) == utf8::utf8to16(part));
+        CHECK(System::Encoding::Utf8ToUtf32(part) == utf8::utf8to32(part));
+        CHECK(System::Encoding::Utf16ToUtf8(utf8::utf8to16(part)) == part);
+        CHECK(System::Encoding::Utf32ToUtf8(utf8::utf8to32(part)) == part);
+        CHECK(System::Encoding::WCharToUtf8(System::Encoding::Utf8ToWChar(part)) == part);
+        CHECK(System::Encoding::EncodedLength(part) == static_cast<size_t>(utf8::distance(part.begin(), part.end())));
+    }
+
+    CHECK(System::Encoding::Utf8ToUtf16(utf8) == utf16);
+    CHECK(System::Encoding::Utf16ToUtf8(utf16) == utf8);
+    CHECK(System::Encoding::Utf8ToUtf32(std::string(utf8)) == code_points);
+    CHECK(System::Encoding::Utf32ToUtf8(code_points) == utf8);
+
+    // Invalid sequences, at every position of a block.
+    const std::string invalid_sequences[] = {
+        "\x80", "\xbf", "\xc0\x80", "\xc1\xbf", "\xc2", "\xe0\x80\x80", "\xe0\x9f\xbf", "\xed\xa0\x80", "\xed\xbf\xbf",
+        "\xe1\x80", "\xf0\x80\x80\x80", "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xf8\x88\x80\x80\x80",
+        "\xff", "\xc2\xc2", "\xe1\x41\x80", "\xf1\x80\x80",
+    };
+    for (auto const& sequence : invalid_sequences)
+    {
+        for (size_t position : { 0, 1, 13, 14, 15, 16, 30, 31, 32, 63 })
+        {
+            std::string text(64, 'x');
+            text.replace(position, sequence.length(), sequence);
+            // Also cut by the end of the string.
+            for (size_t cut : { size_t(0), text.length() - position - sequence.length() })
+            {
+                const std::string_view view(text.data(), text.length() - cut);
+                CHECK(System::Encoding::IsValidUtf8(view) == utf8::is_valid(view.begin(), view.end()));
+                CHECK_THROWS_AS(System::Encoding::Utf8ToUtf16(view), utf8::exception);
+                CHECK_THROWS_AS(System::Encoding::Utf8ToUtf32(view), utf8::exception);
+            }
+        }
+    }
+    CHECK_FALSE(System::Encoding::IsValidUtf8("\xc3"));
+    CHECK(System::Encoding::IsValidUtf8(""));
+    CHECK(System::Encoding::IsValidUtf8("\xf4\x8f\xbf\xbf\xef\xbf\xbf\xed\x9f\xbf\xee\x80\x80"));
+
+    // Random bytes against utfcpp.
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        std::string text = utf8.substr(i, 40);
+        seed = seed * 1103515245 + 12345;
+        text[(seed >> 8) % text.length()] = static_cast<char>(seed >> 16);
+        CHECK(System::Encoding::IsValidUtf8(text) == utf8::is_valid(text.begin(), text.end()));
+    }
+
+    // Unpaired surrogates and code points out of range.
+    std::u16string bad_utf16 = utf16.substr(0, 100);
+    bad_utf16[50] = 0xD800;
+    bad_utf16[51] = u'a';
+    CHECK_THROWS_AS(System::Encoding::Utf16ToUtf8(bad_utf16), utf8::exception);
+    CHECK_THROWS_AS(System::Encoding::Utf16ToUtf8(std::u16string(1, 0xDC00)), utf8::exception);
+    CHECK_THROWS_AS(System::Encoding::Utf16ToUtf8(std::u16string(20, u'a') + char16_t(0xDBFF)), utf8::exception);
+    std::u32string bad_utf32 = code_points.substr(0, 100);
+    bad_utf32[70] = 0x110000;
+    CHECK_THROWS_AS(System::Encoding::Utf32ToUtf8(bad_utf32), utf8::exception);
+    CHECK_THROWS_AS(System::Encoding::Utf32ToUtf8(std::u32string(1, 0xDFFF)), utf8::exception);
+}
+
+TEST_CASE("UTF caller buffers", "[utf]")
+{
+    std::u32string code_points;
+    uint32_t seed = 7;
+    for (size_t i = 0; i < 500; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        switch ((seed >> 16) % 5)
+        {
+            case 0: code_points += U"é"; break;
+            case 1: code_points += U"中"; break;
+            case 2: code_points += U"\U0001F600"; break;
+            default: code_points += std::u32string((seed >> 4) % 70, U'a' + (seed % 26)); break;
+        }
+    }
+    code_points += U"\U0001F600";
+
+    const std::string utf8 = utf8::utf32to8(code_points);
+    const std::u16string utf16 = utf8::utf8to16(utf8);
+
+    CHECK(System::Encoding::Utf8ToUtf16Length(utf8) == utf16.length());
+    CHECK(System::Encoding::Utf8ToUtf32Length(utf8) == code_points.length());
+    CHECK(System::Encoding::Utf8ToWCharLength(utf8) == System::Encoding::Utf8ToWChar(utf8).length());
+    CHECK(System::Encoding::Utf16ToUtf8Length(utf16) == utf8.length());
+    CHECK(System::Encoding::Utf32ToUtf8Length(code_points) == utf8.length());
+    CHECK(System::Encoding::WCharToUtf8Length(System::Encoding::Utf8ToWChar(utf8)) == utf8.length());
+    CHECK(System::Encoding::Utf8ToUtf16Length("") == 0);
+    CHECK(System::Encoding::Utf16ToUtf8Length(u"") == 0);
+
+    // Exact buffers go through the vector kernels, a buffer one unit short stops on the last code point.
+    {
+        std::u16string out(utf16.length(), u'\0');
+        auto result = System::Encoding::Convert(utf8, &out[0], out.length());
+        CHECK(result.Error == System::Encoding::ConvertError::None);
+        CHECK(result.Written == utf16.length());
+        CHECK(result.Consumed == utf8.length());
+        CHECK(out == utf16);
+
+        result = System::Encoding::Convert(utf8, &out[0], out.length() - 1);
+        CHECK(result.Error == System::Encoding::ConvertError::OutputTooSmall);
+        CHECK(result.Consumed == utf8.length() - 4);
+        CHECK(result.Written == utf16.length() - 2);
+    }
+    {
+        std::string out(utf8.length(), '\0');
+        auto result = System::Encoding::Convert(std::u16string_view(utf16), &out[0], out.length());
+        CHECK(result.Error == System::Encoding::ConvertError::None);
+        CHECK(result.Written == utf8.length());
+        CHECK(out == utf8);
+
+        out.assign(utf8.length(), '\0');
+        result = System::Encoding::Convert(std::u32string_view(code_points), &out[0], out.length());
+        CHECK(result.Error == System::Encoding::ConvertError::None);
+        CHECK(result.Consumed == code_points.length());
+        CHECK(out == utf8);
+    }
+
+    // Every buffer size: the output is always the longest prefix of whole code points that fits.
+    const std::string_view part(utf8.data(), 300);
+    for (size_t size = 0; size < 200; ++size)
+    {
+        std::u32string out(size, U'\0');
+        auto result = System::Encoding::Convert(part, out.data(), size);
+        CHECK(result.Written <= size);
+        CHECK(out.substr(0, result.Written) == utf8::utf8to32(part.substr(0, result.Consumed)));
+        if (result.Error == System::Encoding::ConvertError::OutputTooSmall)
+            CHECK(result.Written == size);
+
+        std::string out8(size, '\0');
+        auto result8 = System::Encoding::Convert(std::u16string_view(utf16), out8.data(), size);
+        CHECK(result8.Error == System::Encoding::ConvertError::OutputTooSmall);
+        CHECK(out8.substr(0, result8.Written) == utf8::utf16to8(utf16.substr(0, result8.Consumed)));
+        CHECK(result8.Written + 4 > size);
+    }
+
+    // Errors stop the conversion at their position, a sequence cut by the end of the input is incomplete.
+    char16_t buffer16[256];
+    char buffer8[256];
+    std::string text = std::string(100, 'a') + "\xc3\xa9" + "\xe0\x80\x80" + "bc";
+    auto result = System::Encoding::Convert(text, buffer16, 256);
+    CHECK(result.Error == System::Encoding::ConvertError::InvalidSequence);
+    CHECK(result.Consumed == 102);
+    CHECK(result.Written == 101);
+    CHECK(std::u16string_view(buffer16, result.Written) == std::u16string(100, u'a') + u"é");
+
+    for (std::string_view tail : { "\xc3", "\xe4\xb8", "\xf0\x9f\x98", "\xf0" })
+    {
+        result = System::Encoding::Convert(std::string(10, 'a') + std::string(tail), buffer16, 256);
+        CHECK(result.Error == System::Encoding::ConvertError::Incomplete);
+        CHECK(result.Consumed == 10);
+        CHECK(result.Written == 10);
+    }
+    result = System::Encoding::Convert("a\xe0\x80", buffer16, 256);
+    CHECK(result.Error == System::Encoding::ConvertError::InvalidSequence);
+    CHECK(result.Consumed == 1);
+
+    result = System::Encoding::Convert(std::u16string_view(u"ab\xD83D"), buffer8, 256);
+    CHECK(result.Error == System::Encoding::ConvertError::Incomplete);
+    CHECK(result.Consumed == 2);
+    result = System::Encoding::Convert(std::u16string(100, u'a') + char16_t(0xDC00) + u"b", buffer8, 256);
+    CHECK(result.Error == System::Encoding::ConvertError::InvalidSequence);
+    CHECK(result.Consumed == 100);
+    CHECK(std::string_view(buffer8, result.Written) == std::string(100, 'a'));
+    result = System::Encoding::Convert(std::u32string(70, U'a') + char32_t(0x110000), buffer8, 256);
+    CHECK(result.Error == System::Encoding::ConvertError::InvalidSequence);
+    CHECK(result.Consumed == 70);
+    CHECK(result.Written == 70);
+}
+
+TEST_CASE("UTF stream transcoder", "[utf]")
+{
+    std::u32string code_points;
+    uint32_t seed = 11;
+    for (size_t i = 0; i < 400; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        switch ((seed >> 16) % 5)
+        {
+            case 0: code_points += U"é"; break;
+            case 1: code_points += U"中"; break;
+            case 2: code_points += U"\U0001F600"; break;
+            default: code_points += std::u32string((seed >> 4) % 90, U'a' + (seed % 26)); break;
+        }
+    }
+    const std::string utf8 = utf8::utf32to8(code_points);
+    const std::u16string utf16 = utf8::utf8to16(utf8);
+
+    // Chunks of every size split the sequences everywhere, out is reused for every chunk.
+    for (size_t chunk_size : { 1, 2, 3, 5, 7, 64, 1000 })
+    {
+        System::Encoding::Utf8ToUtf16Transcoder to_utf16;
+        System::Encoding::Utf16ToUtf8Transcoder to_utf8;
+        std::u16string result16, out16;
+        std::string result8, out8;
+        for (size_t i = 0; i < utf8.length(); i += chunk_size)
+        {
+            out16.clear();
+            CHECK(to_utf16.Write(std::string_view(utf8).substr(i, chunk_size), out16));
+            CHECK(to_utf16.Pending() < 4);
+            result16 += out16;
+        }
+        for (size_t i = 0; i < utf16.length(); i += chunk_size)
+        {
+            out8.clear();
+            CHECK(to_utf8.Write(std::u16string_view(utf16).substr(i, chunk_size), out8));
+            result8 += out8;
+        }
+        CHECK(to_utf16.Finish(result16));
+        CHECK(to_utf8.Finish(result8));
+        CHECK(result16 == utf16);
+        CHECK(result8 == utf8);
+        CHECK(to_utf16.Position() == utf8.length());
+        CHECK(to_utf8.Position() == utf16.length());
+    }
+
+    auto transcode = [](System::Encoding::ErrorPolicy policy, std::string_view text, size_t chunk_size)
+    {
+        System::Encoding::Utf8ToUtf32Transcoder transcoder(policy);
+        std::u32string out;
+        for (size_t i = 0; i < text.length(); i += chunk_size)
+            transcoder.Write(text.substr(i, chunk_size), out);
+
+        transcoder.Finish(out);
+        return out;
+    };
+
+    // Replacement of the maximal subparts, the examples of the Unicode standard.
+    const auto replace = System::Encoding::ErrorPolicy::Replace;
+    for (size_t chunk_size : { 1, 2, 3, 100 })
+    {
+        CHECK(transcode(replace, "\x61\xF1\x80\x80\xE1\x80\xC2\x62\x80\x63\x80\xBF\x64", chunk_size) == U"a���b�c��d");
+        CHECK(transcode(replace, "\xC0\xAF\xE0\x80\xBF\xF0\x81\x82\x41", chunk_size) == U"��������A");
+        CHECK(transcode(replace, "\xED\xA0\x80\xED\xBF\xBF\xED\xAF\x41", chunk_size) == U"��������A");
+        CHECK(transcode(replace, "\xF4\x91\x92\x93\xFF\x41\x80\xBF\x42", chunk_size) == U"�����A��B");
+        CHECK(transcode(replace, "ab\xF0\x9F\x98", chunk_size) == U"ab�");
+        CHECK(transcode(replace, "\xE4\xB8" "A\xE4\xB8\xAD", chunk_size) == U"�A中");
+        CHECK(transcode(replace, "\xF0\xC3\x9F", chunk_size) == U"�ß");
+    }
+
+    // Random errors: the result doesn't depend on the chunks.
+    for (size_t i = 0; i < 200; ++i)
+    {
+        std::string text = utf8.substr(i * 3, 200);
+        for (size_t j = 0; j < 3; ++j)
+        {
+            seed = seed * 1103515245 + 12345;
+            text[(seed >> 8) % text.length()] = static_cast<char>(seed >> 16);
+        }
+        const std::u32string expected = transcode(replace, text, text.length());
+        CHECK(transcode(replace, text, 1 + i % 7) == expected);
+        if (utf8::is_valid(text.begin(), text.end()))
+            CHECK(expected == utf8::utf8to32(text));
+    }
+
+    // Strict stops at the first error, also when it started in a previous chunk.
+    {
+        System::Encoding::Utf8ToUtf16Transcoder transcoder(System::Encoding::ErrorPolicy::Strict);
+        std::u16string out;
+        CHECK(transcoder.Write("abc\xE4", out));
+        CHECK(transcoder.Pending() == 1);
+        CHECK_FALSE(transcoder.Write("\xB8!", out));
+        CHECK(transcoder.Failed());
+        CHECK(transcoder.Position() == 3);
+        CHECK(out == u"abc");
+        CHECK_FALSE(transcoder.Write("d", out));
+        CHECK_FALSE(transcoder.Finish(out));
+
+        transcoder.Reset();
+        out.clear();
+        CHECK(transcoder.Write(std::string(100, 'x') + "\xE4\xB8", out));
+        CHECK(transcoder.Write("\xAD", out));
+        CHECK_FALSE(transcoder.Write("y\xFF", out));
+        CHECK(transcoder.Position() == 104);
+        CHECK(out == std::u16string(100, u'x') + u"中y");
+
+        transcoder.Reset();
+        out.clear();
+        CHECK(transcoder.Write("ab\xC3", out));
+        CHECK_FALSE(transcoder.Finish(out));
+        CHECK(transcoder.Position() == 2);
+    }
+
+    // UTF-16 input: a lead surrogate is carried, a lone surrogate is invalid.
+    {
+        System::Encoding::Utf16ToUtf8Transcoder transcoder;
+        std::string out;
+        const std::u16string text = u"a\U0001F600b";
+        CHECK(transcoder.Write(std::u16string_view(text).substr(0, 2), out));
+        CHECK(transcoder.Pending() == 1);
+        CHECK(transcoder.Write(std::u16string_view(text).substr(2), out));
+        CHECK(out == "a\U0001F600b");
+
+        out.clear();
+        const char16_t lone[] = { 0xD83D, u'x', 0xDE00, 0xD83D };
+        CHECK(transcoder.Write(std::u16string_view(lone, 1), out));
+        CHECK(transcoder.Write(std::u16string_view(lone + 1, 3), out));
+        CHECK(transcoder.Finish(out));
+        CHECK(out == "�x��");
+    }
+}
+
 TEST_CASE("Base64", "[base64]")
 {
     CHECK(System::Encoding::Base64::Encode(R"({ "json_key": "json_value" })", true) == "eyAianNvbl9rZXkiOiAianNvbl92YWx1ZSIgfQ==");
@@ -726,6 +1068,177 @@ TEST_CASE("Base64", "[base64]")
     CHECK(System::Encoding::Base64::UrlDecode("-_v7-_v7-_v7-w") == "\xfb\xfb\xfb\xfb\xfb\xfb\xfb\xfb\xfb\xfb");
 }
 
+TEST_CASE("Base64 blocks", "[base64]")
+{
+    // Every length around the vector blocks, both alphabets, against a byte by byte encoder.
+    auto reference = [](std::string_view data, const char* alphabet, bool padding)
+    {
+        std::string r;
+        for (size_t i = 0; i < data.size(); i += 3)
+        {
+            uint32_t group = uint8_t(data[i]) << 16;
+            if (i + 1 < data.size()) group |= uint8_t(data[i + 1]) << 8;
+            if (i + 2 < data.size()) group |= uint8_t(data[i + 2]);
+            const size_t chars = std::min<size_t>(4, (data.size() - i) * 4 / 3 + 1);
+            for (size_t j = 0; j < chars; ++j)
+                r += alphabet[(group >> (18 - 6 * j)) & 0x3F];
+        }
+        while (padding && r.size() % 4)
+            r += '=';
+        return r;
+    };
+    const char standard[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const char url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+    std::string data;
+    uint32_t seed = 5;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        data += static_cast<char>(seed >> 16);
+    }
+
+    for (size_t length = 0; length < 300; ++length)
+    {
+        const std::string_view part(data.data(), length);
+        const std::string encoded = System::Encoding::Base64::Encode(part, true);
+        const std::string url_encoded = System::Encoding::Base64::UrlEncode(part, false);
+        CHECK(encoded == reference(part, standard, true));
+        CHECK(url_encoded == reference(part, url, false));
+        CHECK(System::Encoding::Base64::Decode(encoded) == part);
+        CHECK(System::Encoding::Base64::UrlDecode(url_encoded) == part);
+    }
+    const std::string encoded = System::Encoding::Base64::Encode(data, false);
+    CHECK(System::Encoding::Base64::Decode(encoded) == data);
+
+    // Decoding stops on the first character out of the alphabet, wherever it is in a block.
+    std::string buffer(encoded.size(), '\0');
+    for (char invalid : { '=', '-', '_', ' ', '\n', '\0', '\x80', '\xff', '*' })
+    {
+        for (size_t position : { 0, 1, 2, 3, 15, 16, 31, 32, 33, 63, 64, 65, 100, 127, 128, 200 })
+        {
+            std::string text = encoded.substr(0, 256);
+            text[position] = invalid;
+            const auto result = System::Encoding::Base64::Decode(&buffer[0], text.data(), text.size());
+            const size_t bytes = position / 4 * 3 + std::max<size_t>(position % 4, 1) - 1;
+            CHECK(result.second == position);
+            CHECK(result.first == bytes);
+            CHECK(buffer.substr(0, bytes) == data.substr(0, bytes));
+        }
+    }
+
+    // The URL alphabet rejects + and /, and the other way around.
+    const std::string url_text = System::Encoding::Base64::UrlEncode(std::string(100, '\xfb'), false);
+    CHECK(System::Encoding::Base64::UrlDecode(url_text) == std::string(100, '\xfb'));
+    CHECK(System::Encoding::Base64::Decode(url_text).empty());
+    CHECK(System::Encoding::Base64::UrlDecode(System::Encoding::Base64::Encode(std::string(100, '\xfb'), false)).empty());
+}
+
+TEST_CASE("Base64 streams", "[base64]")
+{
+    std::string data;
+    uint32_t seed = 9;
+    for (size_t i = 0; i < 5000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        data += static_cast<char>(seed >> 16);
+    }
+    const std::string encoded = System::Encoding::Base64::Encode(data, true);
+    std::string wrapped;
+    for (size_t i = 0; i < encoded.size(); i += System::Encoding::Base64::MimeLineLength)
+        wrapped += (i ? "\r\n" : "") + encoded.substr(i, System::Encoding::Base64::MimeLineLength);
+
+    // Any chunks give the same characters, the groups and the lines are carried over.
+    for (size_t chunk_size : { 1, 2, 3, 4, 5, 57, 100, 5000 })
+    {
+        System::Encoding::Base64::Encoder encoder;
+        System::Encoding::Base64::Encoder mime(System::Encoding::Base64::Alphabet::Standard, true, System::Encoding::Base64::MimeLineLength);
+        System::Encoding::Base64::Encoder url(System::Encoding::Base64::Alphabet::Url, false);
+        std::string out, mime_out, url_out;
+        for (size_t i = 0; i < data.size(); i += chunk_size)
+        {
+            encoder.Update(std::string_view(data).substr(i, chunk_size), out);
+            mime.Update(std::string_view(data).substr(i, chunk_size), mime_out);
+            url.Update(std::string_view(data).substr(i, chunk_size), url_out);
+        }
+        encoder.Finish(out);
+        mime.Finish(mime_out);
+        url.Finish(url_out);
+        CHECK(out == encoded);
+        CHECK(mime_out == wrapped);
+        CHECK(url_out == System::Encoding::Base64::UrlEncode(data, false));
+
+        System::Encoding::Base64::Decoder decoder;
+        System::Encoding::Base64::Decoder strict(System::Encoding::Base64::Alphabet::Standard, true);
+        std::string decoded, strict_decoded;
+        bool valid = true;
+        for (size_t i = 0; i < wrapped.size(); i += chunk_size)
+        {
+            valid &= decoder.Update(std::string_view(wrapped).substr(i, chunk_size), decoded);
+            valid &= strict.Update(std::string_view(wrapped).substr(i, chunk_size), strict_decoded);
+        }
+        CHECK(valid);
+        CHECK(decoder.Finish(decoded));
+        CHECK(strict.Finish(strict_decoded));
+        CHECK(decoded == data);
+        CHECK(strict_decoded == data);
+    }
+    CHECK_THROWS_AS(System::Encoding::Base64::Encoder(System::Encoding::Base64::Alphabet::Standard, true, 75), std::invalid_argument);
+
+    // The last groups, in one piece and a character at a time. Bits left in a padded group fail on the padding.
+    auto decode = [](std::string_view text, bool strict_padding, size_t chunk_size)
+    {
+        System::Encoding::Base64::Decoder decoder(System::Encoding::Base64::Alphabet::Standard, strict_padding);
+        std::string out;
+        for (size_t i = 0; i < text.size(); i += chunk_size)
+        {
+            if (!decoder.Update(text.substr(i, chunk_size), out))
+                return std::string("error at ") + std::to_string(decoder.Position());
+        }
+        return decoder.Finish(out) ? out : std::string("error at end");
+    };
+    for (size_t chunk_size : { 1, 100 })
+    {
+        CHECK(decode("QUJD RA==\n", true, chunk_size) == "ABCD");
+        CHECK(decode("QUJDREU=", true, chunk_size) == "ABCDE");
+        CHECK(decode("QUJD\r\nREU", false, chunk_size) == "ABCDE");
+        CHECK(decode("QUJD\r\nREU", true, chunk_size) == "error at end");
+        CHECK(decode("QUJDRA=", false, chunk_size) == "ABCD");
+        CHECK(decode("QUJDRA=", true, chunk_size) == "error at end");
+        CHECK(decode("QUJDRB==", false, chunk_size) == "ABCD");
+        CHECK(decode("QUJDRB==", true, chunk_size) == "error at 6");
+        CHECK(decode("QUJDREV=", true, chunk_size) == "error at 7");
+        CHECK(decode("QUJDRA===", false, chunk_size) == "error at 8");
+        CHECK(decode("QUJDRA==QUJD", false, chunk_size) == "error at 8");
+        CHECK(decode("QUJDR===", false, chunk_size) == "error at 5");
+        CHECK(decode("QUJD=", false, chunk_size) == "error at 4");
+        CHECK(decode("QUJDR", false, chunk_size) == "error at end");
+        CHECK(decode("QUJ*RA==", false, chunk_size) == "error at 3");
+        CHECK(decode("QUJD-_==", false, chunk_size) == "error at 4");
+        CHECK(decode("", true, chunk_size).empty());
+        CHECK(decode(" \n", true, chunk_size).empty());
+    }
+
+    // On top of streams.
+    std::istringstream input(data);
+    std::ostringstream output;
+    System::Encoding::Base64::Encoder encoder(System::Encoding::Base64::Alphabet::Standard, true, System::Encoding::Base64::MimeLineLength);
+    CHECK(System::Encoding::Base64::Encode(input, output, encoder));
+    CHECK(output.str() == wrapped);
+
+    std::istringstream encoded_input(wrapped + "\r\n");
+    std::ostringstream decoded_output;
+    System::Encoding::Base64::Decoder decoder(System::Encoding::Base64::Alphabet::Standard, true);
+    CHECK(System::Encoding::Base64::Decode(encoded_input, decoded_output, decoder));
+    CHECK(decoded_output.str() == data);
+
+    std::istringstream invalid_input(wrapped.substr(0, 1000) + "!" + wrapped.substr(1000));
+    std::ostringstream partial_output;
+    decoder.Reset();
+    CHECK_FALSE(System::Encoding::Base64::Decode(invalid_input, partial_output, decoder));
+    CHECK(decoder.Position() == 1000);
+}
+
 inline std::ostream &operator<<(std::ostream &os, System::TranslatedMode mode)
 {
     switch (mode)
@@ -956,6 +1469,310 @@ TEST_CASE("Split string", "[SplitString]")
     }
 }
 
+TEST_CASE("String join", "[StringJoin]")
+{
+    const std::vector<std::string> strings{ "a", "bc", "", "d" };
+    CHECK(System::String::Join(strings, ", ") == "a, bc, , d");
+    CHECK(System::String::Join(strings.begin() + 1, strings.end(), std::string_view("/")) == "bc//d");
+    CHECK(System::String::Join(std::vector<std::string>(), ",") == "");
+    CHECK(System::String::Join(std::vector<std::string>{ "alone" }, ",") == "alone");
+
+    // Any string-like element, and chars.
+    const std::vector<std::string_view> views{ "x", "y" };
+    CHECK(System::String::Join(views, std::string("::")) == "x::y");
+    const char* c_strings[] = { "1", "2", "3" };
+    CHECK(System::String::Join(c_strings, "") == "123");
+    CHECK(System::String::Join(std::string("abc"), "-") == "a-b-c");
+    CHECK(System::String::Join({ "k", "v" }, "=") == "k=v");
+
+    // Single pass input ranges.
+    std::istringstream stream("one two three");
+    CHECK(System::String::Join(std::istream_iterator<std::string>(stream), std::istream_iterator<std::string>(), "+") == "one+two+three");
+
+    // The caller buffer is appended to and reused.
+    std::string out;
+    out.reserve(64);
+    const char* data = out.data();
+    out = "list: ";
+    System::String::AppendJoin(out, strings, ",");
+    System::String::AppendJoin(out, std::vector<std::string>(), ",");
+    CHECK(out == "list: a,bc,,d");
+    CHECK(out.data() == data);
+
+    out.clear();
+    System::String::AppendJoin(out, views.begin(), views.end(), ";");
+    System::String::AppendJoin(out, { "!", "?" }, "");
+    CHECK(out == "x;y!?");
+    CHECK(out.data() == data);
+}
+
+TEST_CASE("Split", "[split]")
+{
+    using Tokens = std::vector<std::string_view>;
+
+    CHECK(System::String::Split("a,b,,c,", ',').ToVector() == Tokens{ "a", "b", "", "c", "" });
+    CHECK(System::String::Split("", ',').ToVector() == Tokens{ "" });
+
+    System::String::SplitOptions skip_empty;
+    skip_empty.SkipEmpty = true;
+    CHECK(System::String::Split(",,a,b,,c,", ',', skip_empty).ToVector() == Tokens{ "a", "b", "c" });
+    CHECK(System::String::Split(",,,", ',', skip_empty).ToVector().empty());
+    CHECK(System::String::Split("", ',', skip_empty).ToVector().empty());
+
+    System::String::SplitOptions max_split;
+    max_split.MaxSplit = 2;
+    CHECK(System::String::Split("a,b,c,d", ',', max_split).ToVector() == Tokens{ "a", "b", "c,d" });
+    CHECK(System::String::Split("a,b", ',', max_split).ToVector() == Tokens{ "a", "b" });
+    max_split.SkipEmpty = true;
+    CHECK(System::String::Split("a,,b,,,c,d", ',', max_split).ToVector() == Tokens{ "a", "b", "c,d" });
+    max_split.MaxSplit = 0;
+    CHECK(System::String::Split(",,a,b", ',', max_split).ToVector() == Tokens{ "a,b" });
+
+    CHECK(System::String::Split("a::b:c::", "::").ToVector() == Tokens{ "a", "b:c", "" });
+    CHECK(System::String::Split("a:::b", "::").ToVector() == Tokens{ "a", ":b" });
+    CHECK(System::String::Split("a::::b", "::", skip_empty).ToVector() == Tokens{ "a", "b" });
+    CHECK(System::String::Split("a,b", std::string_view()).ToVector() == Tokens{ "a,b" });
+
+    CHECK(System::String::SplitAnyOf("a b\tc\n\nd", " \t\n").ToVector() == Tokens{ "a", "b", "c", "", "d" });
+    CHECK(System::String::SplitAnyOf("a b\tc\n\nd", " \t\n", skip_empty).ToVector() == Tokens{ "a", "b", "c", "d" });
+    CHECK(System::String::SplitAnyOf("abc", "").ToVector() == Tokens{ "abc" });
+
+    // The vector kernels and the lookup table of the large sets.
+    for (std::string_view set : { std::string_view(";,"), std::string_view(";,|/\\-+=*&"), std::string_view("ab;,cdefghijkl") })
+    {
+        std::string text(100, 'x');
+        text[0] = ';';
+        text[31] = ',';
+        text[32] = ';';
+        text[70] = ',';
+        text[99] = ';';
+
+        const auto tokens = System::String::SplitAnyOf(text, set).ToVector();
+        CHECK(tokens.size() == 6);
+        CHECK(tokens[1].size() == 30);
+        CHECK(tokens[2].empty());
+        CHECK(tokens[3].size() == 37);
+        CHECK(tokens[4].size() == 28);
+        CHECK(tokens[5].empty());
+    }
+
+    // The range is lazy and its iterators are forward iterators.
+    const std::string_view text = "key=value=more";
+    auto range = System::String::Split(text, '=');
+    auto it = range.begin();
+    CHECK(*it == "key");
+    CHECK(it->data() == text.data());
+    auto copy = it++;
+    CHECK(*copy == "key");
+    CHECK(*it == "value");
+    CHECK(std::distance(range.begin(), range.end()) == 3);
+
+    size_t count = 0;
+    for (auto token : System::String::Split("1 2 3", ' '))
+        count += token.size();
+
+    CHECK(count == 3);
+}
+
+TEST_CASE("String find", "[StringFind]")
+{
+    std::string text(200, 'a');
+    text.replace(150, 5, "abcde");
+    text.replace(190, 4, "abcd");
+
+    CHECK(System::String::Find(text, "abcde") == 150);
+    CHECK(System::String::Find(text, "abcd", 151) == 190);
+    CHECK(System::String::Find(text, "abcdef") == std::string_view::npos);
+    CHECK(System::String::Find(text, "aab") == 149);
+    CHECK(System::String::Find(text, "b", 190) == 191);
+    CHECK(System::String::Find(text, "") == 0);
+    CHECK(System::String::Find(text, "", 200) == 200);
+    CHECK(System::String::Find(text, "a", 201) == std::string_view::npos);
+    CHECK(System::String::Find("short", "or") == 2);
+
+    // Every position and length against std::string_view::find, first and last bytes often match.
+    std::string haystack;
+    for (size_t i = 0; i < 300; ++i)
+        haystack += "xyxyz"[i * 7 % 5];
+
+    const std::string_view view(haystack);
+    for (size_t length = 1; length < 40; length += 3)
+    {
+        for (size_t position = 0; position + length <= view.length(); position += 11)
+        {
+            const std::string_view pattern = view.substr(position, length);
+            CHECK(System::String::Find(view, pattern) == view.find(pattern));
+            CHECK(System::String::Find(view, pattern, position) == view.find(pattern, position));
+        }
+    }
+}
+
+TEST_CASE("MultiSearcher", "[MultiSearcher]")
+{
+    using Match = System::String::MultiSearcher::Match;
+
+    auto naive_search = [](std::vector<std::string> const& patterns, std::string_view text)
+    {
+        std::vector<Match> matches;
+        for (size_t position = 0; position < text.length(); ++position)
+        {
+            for (size_t index = 0; index < patterns.size(); ++index)
+            {
+                if (!patterns[index].empty() && text.substr(position, patterns[index].length()) == patterns[index])
+                    matches.push_back(Match{ index, position, patterns[index].length() });
+            }
+        }
+        return matches;
+    };
+
+    auto same_matches = [](std::vector<Match> const& l, std::vector<Match> const& r)
+    {
+        return l.size() == r.size() && std::equal(l.begin(), l.end(), r.begin(), [](Match const& a, Match const& b)
+        {
+            return a.Pattern == b.Pattern && a.Position == b.Position && a.Length == b.Length;
+        });
+    };
+
+    {
+        System::String::MultiSearcher searcher{ "he", "she", "his", "hers", "" };
+        CHECK(searcher.PatternCount() == 5);
+        CHECK(searcher.Pattern(3) == "hers");
+
+        const auto matches = searcher.FindAll("ushers");
+        REQUIRE(matches.size() == 3);
+        CHECK((matches[0].Pattern == 1 && matches[0].Position == 1 && matches[0].Length == 3));
+        CHECK((matches[1].Pattern == 0 && matches[1].Position == 2));
+        CHECK((matches[2].Pattern == 3 && matches[2].Position == 2));
+
+        CHECK(searcher.FindFirst("this").Pattern == 2);
+        CHECK(searcher.FindFirst("nothing").Pattern == std::string_view::npos);
+        CHECK(searcher.FindAll("").empty());
+
+        size_t count = 0;
+        searcher.ForEachMatch("he he he", [&](Match const&) { return ++count < 2; });
+        CHECK(count == 2);
+        searcher.ForEachMatch("he he he", [&](Match const&) { ++count; });
+        CHECK(count == 5);
+    }
+
+    CHECK(System::String::MultiSearcher().FindAll("text").empty());
+    CHECK(System::String::MultiSearcher{ "" }.FindAll("text").empty());
+
+    // Small sets use the Teddy prefilter, large ones Aho-Corasick: both against the naive search, on a text long
+    // enough for the vector blocks and their tail.
+    std::string text;
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < 5000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        text += "abcdxyz \n\x80\xff"[(seed >> 16) % 11];
+    }
+
+    for (size_t pattern_count : { 1, 3, 8, 20, 64, 65, 200 })
+    {
+        std::vector<std::string> patterns;
+        for (size_t i = 0; i < pattern_count; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            const size_t position = (seed >> 8) % (text.length() - 8);
+            patterns.push_back(text.substr(position, 1 + (seed >> 4) % 6));
+        }
+        // Duplicates and patterns sharing prefixes.
+        patterns.push_back(patterns[0]);
+        patterns.push_back(patterns[0] + "a");
+
+        System::String::MultiSearcher searcher(patterns);
+        CHECK(same_matches(searcher.FindAll(text), naive_search(patterns, text)));
+        CHECK(same_matches(searcher.FindAll(std::string_view(text).substr(3, 77)), naive_search(patterns, std::string_view(text).substr(3, 77))));
+
+        const Match first = searcher.FindFirst(text);
+        const Match expected = naive_search(patterns, text).front();
+        CHECK((first.Pattern == expected.Pattern && first.Position == expected.Position));
+    }
+}
+
+TEST_CASE("InternPool", "[InternPool]")
+{
+    System::String::InternPool pool(4);
+
+    const auto a = pool.Intern("metric.requests");
+    const auto b = pool.Intern(std::string("metric.errors"));
+    const auto empty = pool.Intern("");
+    CHECK(a.Valid());
+    CHECK(a != b);
+    CHECK(a == pool.Intern(std::string("metric.") + "requests"));
+    CHECK(pool.View(a) == "metric.requests");
+    CHECK(pool.View(a).data()[pool.View(a).length()] == '\0');
+    CHECK(pool.View(empty).empty());
+    CHECK(pool.Size() == 3);
+    CHECK(a.Id() == 0);
+    CHECK(b.Id() == 1);
+
+    CHECK(pool.Find("metric.errors") == b);
+    CHECK_FALSE(pool.Find("metric.unknown").Valid());
+    CHECK_FALSE(System::String::InternPool::Handle().Valid());
+
+    // Views don't move when the pool grows.
+    const std::string_view view = pool.InternView("stable");
+    CHECK(pool.InternView(std::string("stable")).data() == view.data());
+    std::vector<System::String::InternPool::Handle> handles;
+    for (int i = 0; i < 5000; ++i)
+        handles.push_back(pool.Intern("path/" + std::to_string(i)));
+
+    CHECK(pool.Size() == 5004);
+    CHECK(pool.InternView("stable").data() == view.data());
+    for (int i = 0; i < 5000; ++i)
+    {
+        CHECK(pool.View(handles[i]) == "path/" + std::to_string(i));
+        CHECK(pool.Find("path/" + std::to_string(i)) == handles[i]);
+    }
+
+    // Strings larger than an arena chunk.
+    const std::string large(100000, 'x');
+    CHECK(pool.View(pool.Intern(large)) == large);
+
+    std::unordered_set<System::String::InternPool::Handle> set(handles.begin(), handles.end());
+    CHECK(set.size() == handles.size());
+}
+
+TEST_CASE("InternPool concurrent", "[InternPool_concurrent]")
+{
+    System::String::InternPool pool;
+    constexpr int thread_count = 4;
+    constexpr int string_count = 2000;
+
+    // Every thread interns the same strings in a different order, and reads them back without locking.
+    std::vector<std::vector<System::String::InternPool::Handle>> results(thread_count, std::vector<System::String::InternPool::Handle>(string_count));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([&pool, &results, t]()
+        {
+            for (int i = 0; i < string_count; ++i)
+            {
+                const int index = (i * 7 + t * 501) % string_count;
+                const std::string str = "key_" + std::to_string(index);
+                results[t][index] = pool.Intern(str);
+                if (pool.View(results[t][index]) != str || pool.Find(str) != results[t][index])
+                    results[t][index] = System::String::InternPool::Handle();
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    CHECK(pool.Size() == string_count);
+    for (int i = 0; i < string_count; ++i)
+    {
+        for (int t = 0; t < thread_count; ++t)
+        {
+            REQUIRE(results[t][i].Valid());
+            REQUIRE(results[t][i] == results[0][i]);
+        }
+    }
+}
+
 TEST_CASE("LeftTrim", "[left_trim]")
 {
     // inplace std::string&
@@ -1050,6 +1867,43 @@ TEST_CASE("Trim", "[trim]")
         std::string r = System::String::CopyTrim(std::string_view("  both end trim  "));
         CHECK(r == "both end trim");
     }
+    // views
+    {
+        const char* str = " \t\r\n both end trim \v\f ";
+        CHECK(System::String::LeftTrimView(str) == "both end trim \v\f ");
+        CHECK(System::String::RightTrimView(str) == " \t\r\n both end trim");
+        CHECK(System::String::TrimView(str) == "both end trim");
+        CHECK(System::String::TrimView(str).data() == str + 5);
+        CHECK(System::String::TrimView("      ").empty());
+        CHECK(System::String::TrimView("").empty());
+        CHECK(System::String::TrimView("x") == "x");
+        CHECK(System::String::TrimView(std::string(100, ' ')).empty());
+    }
+    // whitespace runs of every length the vector scans handle, non space bytes next to the whitespace range
+    {
+        const std::string_view kept = "\x08a\x0e\x1f!\x80";
+        int mismatches = 0;
+        for (size_t leading = 0; leading < 80; ++leading)
+        {
+            for (size_t trailing = 0; trailing < 80; trailing += 3)
+            {
+                std::string str;
+                for (size_t i = 0; i < leading; ++i)
+                    str += " \t\n\v\f\r"[i % 6];
+                str += kept;
+                for (size_t i = 0; i < trailing; ++i)
+                    str += "\r\f\v\n\t "[i % 6];
+
+                if (System::String::TrimView(str) != kept || System::String::LeftTrimView(str).length() != kept.length() + trailing)
+                    ++mismatches;
+
+                System::String::Trim(str);
+                if (str != kept)
+                    ++mismatches;
+            }
+        }
+        CHECK(mismatches == 0);
+    }
 }
 
 TEST_CASE("ToLower", "[to_lower]")
@@ -1092,6 +1946,31 @@ TEST_CASE("ToLower", "[to_lower]")
         CHECK(strcmp(&buffer[0], "TO LOWER") == 0);
         CHECK(result == "to lower");
     }
+    // every byte value at every length and offset the vector kernels handle, non ASCII bytes are kept
+    {
+        std::string all_bytes;
+        for (int i = 0; i < 256; ++i)
+            all_bytes += static_cast<char>(i);
+        all_bytes += all_bytes;
+
+        int mismatches = 0;
+        for (size_t offset = 0; offset < 40; ++offset)
+        {
+            for (size_t length = 0; offset + length <= all_bytes.size(); length += 7)
+            {
+                std::string buffer = all_bytes;
+                System::String::ToLower(&buffer[offset], length);
+                for (size_t i = 0; i < buffer.size(); ++i)
+                {
+                    const unsigned char c = static_cast<unsigned char>(all_bytes[i]);
+                    const bool converted = i >= offset && i < offset + length && c >= 'A' && c <= 'A' + 25;
+                    if (buffer[i] != static_cast<char>(converted ? c ^ 0x20 : c))
+                        ++mismatches;
+                }
+            }
+        }
+        CHECK(mismatches == 0);
+    }
 }
 
 TEST_CASE("ToUpper", "[to_upper]")
@@ -1134,6 +2013,31 @@ TEST_CASE("ToUpper", "[to_upper]")
         CHECK(strcmp(&buffer[0], "to upper") == 0);
         CHECK(result == "TO UPPER");
     }
+    // every byte value at every length and offset the vector kernels handle, non ASCII bytes are kept
+    {
+        std::string all_bytes;
+        for (int i = 0; i < 256; ++i)
+            all_bytes += static_cast<char>(i);
+        all_bytes += all_bytes;
+
+        int mismatches = 0;
+        for (size_t offset = 0; offset < 40; ++offset)
+        {
+            for (size_t length = 0; offset + length <= all_bytes.size(); length += 7)
+            {
+                std::string buffer = all_bytes;
+                System::String::ToUpper(&buffer[offset], length);
+                for (size_t i = 0; i < buffer.size(); ++i)
+                {
+                    const unsigned char c = static_cast<unsigned char>(all_bytes[i]);
+                    const bool converted = i >= offset && i < offset + length && c >= 'a' && c <= 'a' + 25;
+                    if (buffer[i] != static_cast<char>(converted ? c ^ 0x20 : c))
+                        ++mismatches;
+                }
+            }
+        }
+        CHECK(mismatches == 0);
+    }
 }
 
 TEST_CASE("CloneString", "[clone_string]")
@@ -1253,3 +2157,1050 @@ TEST_CASE("CopyString", "[copy_string]")
         memset(buffer, 0, 5);
     }
 }
+
+TEST_CASE("ThreadPool", "[thread_pool]")
+{
+    for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+    {
+        System::ThreadPool pool;
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 4;
+        options.Mode = mode;
+        pool.Start(options);
+
+        CHECK(pool.WorkerCount() == 4);
+        CHECK(pool.Mode() == mode);
+
+        std::vector<std::future<int>> results;
+        for (int i = 0; i < 1000; ++i)
+            results.emplace_back(pool.Push([](int a, int b) { return a * b; }, i, 2));
+
+        for (int i = 0; i < 1000; ++i)
+            CHECK(results[i].get() == i * 2);
+
+        // Tasks pushed from a worker land in its local deque and are stolen by the others.
+        std::atomic<int> counter{ 0 };
+        pool.Push([&pool, &counter]()
+        {
+            for (int i = 0; i < 1000; ++i)
+                pool.Push([&counter]() { ++counter; });
+        }).get();
+
+        pool.Join();
+        CHECK(counter == 1000);
+        CHECK(pool.WorkerCount() == 0);
+    }
+}
+
+TEST_CASE("ThreadPool idle strategies", "[thread_pool_idle]")
+{
+    System::ThreadPoolIdleStrategy park_only;
+    park_only.SpinCount = 0;
+    park_only.YieldCount = 0;
+
+    for (auto idle : { park_only, System::ThreadPoolIdleStrategy{} })
+    {
+        for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+        {
+            System::ThreadPool pool;
+            System::ThreadPoolOptions options;
+            options.WorkerCount = 3;
+            options.Mode = mode;
+            options.Idle = idle;
+            pool.Start(options);
+
+            // Let the workers go idle between every task so they have to be woken up.
+            std::atomic<int> counter{ 0 };
+            for (int i = 0; i < 50; ++i)
+            {
+                pool.Push([&counter]() { ++counter; }).get();
+                if (i % 10 == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+
+            pool.Join();
+            CHECK(counter == 50);
+        }
+    }
+
+    // A batch submitted while a worker spins after a single task still wakes the parked workers.
+    for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+    {
+        System::ThreadPool pool;
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 8;
+        options.Mode = mode;
+        pool.Start(options);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        std::mutex mutex;
+        std::unordered_set<std::thread::id> threads;
+        pool.Post([]() {});
+        pool.ParallelFor(0, 64, 1, [&mutex, &threads](int)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                threads.emplace(std::this_thread::get_id());
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }).get();
+        CHECK(threads.size() > 2);
+    }
+}
+
+TEST_CASE("ThreadPool Post", "[thread_pool_post]")
+{
+    for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+    {
+        System::ThreadPool pool;
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 2;
+        options.Mode = mode;
+        pool.Start(options);
+
+        std::atomic<int> counter{ 0 };
+        auto value = std::make_unique<int>(5);
+        // Move-only captures are accepted.
+        pool.Post([&counter, value = std::move(value)]() { counter += *value; });
+        for (int i = 0; i < 100; ++i)
+            pool.Post([&counter](int increment) { counter += increment; }, 1);
+
+        pool.Join();
+        CHECK(counter == 105);
+    }
+}
+
+TEST_CASE("ThreadPool priorities", "[thread_pool_priority]")
+{
+    for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+    {
+        // Tasks pushed before Start are queued, a single worker then runs them in order.
+        System::ThreadPool pool;
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 1;
+        options.Mode = mode;
+        options.StarvationLimit = 0;
+
+        std::vector<std::string> order;
+        auto record = [&order](std::string name) { order.emplace_back(std::move(name)); };
+        const auto now = std::chrono::steady_clock::now();
+
+        System::TaskOptions background;
+        background.Priority = System::TaskPriority::Background;
+        System::TaskOptions critical;
+        critical.Priority = System::TaskPriority::Critical;
+        System::TaskOptions late;
+        late.Deadline = now + std::chrono::seconds(2);
+        System::TaskOptions early;
+        early.Deadline = now + std::chrono::seconds(1);
+
+        pool.Post(background, record, "background");
+        pool.Post(record, "normal");
+        pool.Post(late, record, "late");
+        pool.Post(early, record, "early");
+        auto result = pool.Push(critical, [](int v) { return v * 2; }, 21);
+        pool.Post(critical, record, "critical");
+
+        pool.Start(options);
+        CHECK(result.get() == 42);
+        pool.Join();
+        CHECK(order == std::vector<std::string>{ "critical", "early", "late", "normal", "background" });
+
+        // Background tasks get a turn after StarvationLimit normal tasks.
+        order.clear();
+        options.StarvationLimit = 2;
+        pool.Post(background, record, "background");
+        for (int i = 0; i < 5; ++i)
+            pool.Post(record, std::to_string(i));
+
+        pool.Start(options);
+        pool.Join();
+        CHECK(order == std::vector<std::string>{ "0", "1", "background", "2", "3", "4" });
+    }
+}
+
+TEST_CASE("ThreadPool placement", "[thread_pool_placement]")
+{
+    auto topology = System::GetCpuTopology();
+    REQUIRE(!topology.empty());
+
+    auto affinity = System::GetCurrentThreadAffinity();
+#if defined(SYSTEM_OS_WINDOWS) || defined(SYSTEM_OS_LINUX)
+    CHECK(System::SetCurrentThreadAffinity({ topology.front().Id }));
+    CHECK(System::GetCurrentThreadAffinity() == std::vector<uint32_t>{ topology.front().Id });
+    CHECK(System::SetCurrentThreadAffinity(affinity));
+#endif
+
+    // 2 NUMA nodes of 2 cores with 2 hardware threads, the second core of each node is an efficiency core.
+    std::vector<System::CpuLogicalProcessor_t> fake_topology;
+    for (uint32_t id = 0; id < 8; ++id)
+    {
+        fake_topology.emplace_back(System::CpuLogicalProcessor_t{
+            id,
+            id / 2,
+            0,
+            id / 4,
+            id % 2,
+            (id / 2) % 2 == 0 ? System::CpuCoreType::Performance : System::CpuCoreType::Efficiency });
+    }
+
+    auto placement_ids = [&fake_topology](System::ThreadPoolOptions const& options, std::size_t worker_count)
+    {
+        std::vector<uint32_t> ids;
+        for (auto const& processor : System::details::ComputeWorkerPlacement(fake_topology, options, worker_count))
+            ids.emplace_back(processor.Id);
+        return ids;
+    };
+
+    System::ThreadPoolOptions options;
+    CHECK(placement_ids(options, 4).empty());
+
+    options.Placement = System::ThreadPoolPlacement::Compact;
+    CHECK(placement_ids(options, 9) == std::vector<uint32_t>{ 0, 1, 4, 5, 2, 3, 6, 7, 0 });
+    options.PreferPerformanceCores = false;
+    CHECK(placement_ids(options, 8) == std::vector<uint32_t>{ 0, 2, 1, 3, 4, 6, 5, 7 });
+
+    options.Placement = System::ThreadPoolPlacement::Spread;
+    CHECK(placement_ids(options, 8) == std::vector<uint32_t>{ 0, 4, 2, 6, 1, 5, 3, 7 });
+    options.PreferPerformanceCores = true;
+    CHECK(placement_ids(options, 8) == std::vector<uint32_t>{ 0, 4, 1, 5, 2, 6, 3, 7 });
+
+    options.CpuSet = { 6, 7 };
+    CHECK(placement_ids(options, 3) == std::vector<uint32_t>{ 6, 7, 6 });
+
+    // Pin a real pool and read the mapping back.
+    System::ThreadPool pool;
+    options = System::ThreadPoolOptions{};
+    options.WorkerCount = 2;
+    options.Placement = System::ThreadPoolPlacement::Compact;
+    pool.Start(options);
+
+    auto placement = pool.WorkerPlacement();
+    REQUIRE(placement.size() == 2);
+    for (auto const& worker : placement)
+    {
+        CHECK(std::any_of(topology.begin(), topology.end(), [&worker](System::CpuLogicalProcessor_t const& processor) { return processor.Id == worker.Cpu.Id; }));
+#if defined(SYSTEM_OS_WINDOWS) || defined(SYSTEM_OS_LINUX)
+        CHECK(worker.Pinned);
+#endif
+    }
+
+    CHECK(pool.Push([]() { return System::GetCurrentThreadAffinity().size(); }).get() == 1);
+    pool.Join();
+}
+
+TEST_CASE("Effective parallelism", "[effective_parallelism]")
+{
+    const auto parallelism = System::GetEffectiveParallelism();
+    CHECK(parallelism >= 1);
+    CHECK(parallelism <= System::GetCpuTopology().size());
+
+    // The default worker count follows the effective parallelism.
+    System::ThreadPool pool;
+    pool.Start();
+    CHECK(pool.WorkerCount() == parallelism);
+    CHECK(pool.RefreshWorkerCount() == parallelism);
+    CHECK(pool.Push([]() { return 1; }).get() == 1);
+    pool.Join();
+
+    pool.Start(3);
+    CHECK(pool.RefreshWorkerCount() == 3);
+    pool.Join();
+}
+
+TEST_CASE("ThreadPool batches", "[thread_pool_batch]")
+{
+    for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+    {
+        System::ThreadPool pool;
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 4;
+        options.Mode = mode;
+        pool.Start(options);
+
+        std::atomic<int> counter{ 0 };
+        std::vector<std::function<void()>> batch(500, [&counter]() { ++counter; });
+        pool.PushBatch(batch).get();
+        CHECK(counter == 500);
+
+        // Empty batch is immediately ready.
+        CHECK(pool.PushBatch(std::vector<std::function<void()>>{}).wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+
+        batch.emplace_back([]() { throw std::runtime_error("batch"); });
+        CHECK_THROWS_AS(pool.PushBatch(std::move(batch)).get(), std::runtime_error);
+
+        // Fixed grain, per index.
+        std::vector<int> values(10000, 0);
+        pool.ParallelFor(std::size_t(0), values.size(), 64, [&values](std::size_t i) { values[i] = static_cast<int>(i); }).get();
+        bool all_set = true;
+        for (std::size_t i = 0; i < values.size(); ++i)
+            all_set &= values[i] == static_cast<int>(i);
+        CHECK(all_set);
+
+        // Adaptive grain, per chunk.
+        std::atomic<long long> sum{ 0 };
+        pool.ParallelFor(-1000, 1000, 0, [&sum](int chunk_begin, int chunk_end)
+        {
+            long long local = 0;
+            for (int i = chunk_begin; i < chunk_end; ++i)
+                local += i + 1000;
+            sum += local;
+        }).get();
+        CHECK(sum == 1999000);
+
+        CHECK_THROWS_AS(pool.ParallelFor(0, 100, 1, [](int i) { if (i == 50) throw std::runtime_error("parallel for"); }).get(), std::runtime_error);
+        CHECK(pool.ParallelFor(5, 5, 0, [](int) {}).wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    }
+}
+
+TEST_CASE("MPMCQueue", "[mpmc_queue]")
+{
+    System::MPMCQueue<std::unique_ptr<int>> queue(3);
+    CHECK(queue.Capacity() == 4);
+
+    std::unique_ptr<int> value;
+    CHECK(!queue.TryPop(value));
+    for (int i = 0; i < 4; ++i)
+        CHECK(queue.TryPush(std::make_unique<int>(i)));
+
+    // A failed push leaves the value alone.
+    auto overflow = std::make_unique<int>(4);
+    CHECK(!queue.TryPush(std::move(overflow)));
+    CHECK(overflow != nullptr);
+    CHECK(queue.SizeApprox() == 4);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        REQUIRE(queue.TryPop(value));
+        CHECK(*value == i);
+    }
+    CHECK(queue.EmptyApprox());
+    CHECK(queue.TryEmplace(new int(5)));
+
+    // A throwing constructor leaves the queue usable.
+    {
+        struct Throwing
+        {
+            std::string Value;
+
+            explicit Throwing(int value):
+                Value(std::to_string(value))
+            {
+                if (value < 0)
+                    throw std::runtime_error("negative");
+            }
+        };
+
+        System::MPMCQueue<Throwing> throwing_queue(2);
+        CHECK_THROWS_AS(throwing_queue.TryEmplace(-1), std::runtime_error);
+        CHECK(throwing_queue.EmptyApprox());
+        CHECK(throwing_queue.TryEmplace(1));
+        const Throwing copied(2);
+        CHECK(throwing_queue.TryPush(copied));
+
+        Throwing popped(0);
+        REQUIRE(throwing_queue.TryPop(popped));
+        CHECK(popped.Value == "1");
+        REQUIRE(throwing_queue.TryPop(popped));
+        CHECK(popped.Value == "2");
+        CHECK(!throwing_queue.TryPop(popped));
+        CHECK(throwing_queue.TryEmplace(3));
+    }
+
+    // Every pushed value is popped once.
+    System::MPMCQueue<int> shared_queue(64);
+    constexpr int per_producer = 20000;
+    std::atomic<long long> sum{ 0 };
+    std::atomic<int> popped{ 0 };
+    std::vector<std::thread> threads;
+    for (int producer = 0; producer < 2; ++producer)
+    {
+        threads.emplace_back([&shared_queue]()
+        {
+            for (int i = 1; i <= per_producer; ++i)
+            {
+                while (!shared_queue.TryPush(i))
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (int consumer = 0; consumer < 2; ++consumer)
+    {
+        threads.emplace_back([&shared_queue, &sum, &popped]()
+        {
+            int item;
+            while (popped < 2 * per_producer)
+            {
+                if (shared_queue.TryPop(item))
+                {
+                    sum += item;
+                    ++popped;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    CHECK(sum == 2LL * per_producer * (per_producer + 1) / 2);
+
+    // ThreadPool injection queue, small enough to overflow in the shared lanes.
+    for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+    {
+        System::ThreadPool pool;
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 2;
+        options.Mode = mode;
+        options.InjectionQueueCapacity = 16;
+        pool.Start(options);
+
+        std::atomic<int> counter{ 0 };
+        for (int i = 0; i < 1000; ++i)
+            pool.Post([&counter]() { ++counter; });
+
+        System::TaskOptions critical;
+        critical.Priority = System::TaskPriority::Critical;
+        CHECK(pool.Push(critical, []() { return 7; }).get() == 7);
+
+        pool.Join();
+        CHECK(counter == 1000);
+
+        // Pushed while the pool is stopped, run by the next Start whatever its injection queue.
+        for (std::size_t capacity : { std::size_t(16), std::size_t(0) })
+        {
+            auto stopped_future = pool.Push([]() { return 11; });
+            for (int i = 0; i < 100; ++i)
+                pool.Post([&counter]() { ++counter; });
+            CHECK(pool.Metrics().QueueDepth == 101);
+
+            options.InjectionQueueCapacity = capacity;
+            pool.Start(options);
+            CHECK(stopped_future.get() == 11);
+            pool.Join();
+            CHECK(pool.Metrics().QueueDepth == 0);
+        }
+        CHECK(counter == 1200);
+    }
+}
+
+TEST_CASE("ThreadPool timers", "[thread_pool_timer]")
+{
+    // Every timer fires on the tick of its expiry, through all the cascades.
+    {
+        const auto origin = std::chrono::steady_clock::now();
+        System::details::TimerWheel wheel(origin);
+        std::vector<uint64_t> expiries{ 1, 2, 63, 64, 65, 100, 4095, 4096, 4097, 70000, 262144, 300000, 16777216, 16777300, 40000000 };
+        for (auto expiry : expiries)
+        {
+            auto timer = std::make_shared<System::details::TimerNode>();
+            timer->Expiry = expiry;
+            CHECK(wheel.Insert(timer));
+        }
+        CHECK(wheel.Size() == expiries.size());
+
+        std::vector<uint64_t> fired;
+        std::vector<std::shared_ptr<System::details::TimerNode>> expired;
+        while (wheel.Size() != 0)
+        {
+            const auto next_event = wheel.NextEvent();
+            REQUIRE(next_event != std::chrono::steady_clock::time_point::max());
+            wheel.Advance(next_event, expired);
+            for (auto& timer : expired)
+            {
+                CHECK(timer->Expiry == wheel.CurrentTick());
+                fired.emplace_back(timer->Expiry);
+            }
+            expired.clear();
+        }
+        CHECK(fired == expiries);
+
+        auto past = std::make_shared<System::details::TimerNode>();
+        past->Expiry = wheel.CurrentTick();
+        CHECK(!wheel.Insert(past));
+    }
+
+    // A level 0 timer inserted later doesn't hide the earlier cascade of a higher level.
+    {
+        const auto origin = std::chrono::steady_clock::now();
+        System::details::TimerWheel wheel(origin);
+        for (uint64_t expiry : { 70, 60 })
+        {
+            auto timer = std::make_shared<System::details::TimerNode>();
+            timer->Expiry = expiry;
+            CHECK(wheel.Insert(timer));
+        }
+
+        std::vector<std::shared_ptr<System::details::TimerNode>> expired;
+        wheel.Advance(wheel.ToTimePoint(60), expired);
+        REQUIRE(expired.size() == 1);
+        CHECK(expired[0]->Expiry == 60);
+
+        auto late = std::make_shared<System::details::TimerNode>();
+        late->Expiry = 100;
+        CHECK(wheel.Insert(late));
+        CHECK(wheel.NextEvent() == wheel.ToTimePoint(64));
+
+        expired.clear();
+        wheel.Advance(wheel.NextEvent(), expired);
+        CHECK(expired.empty());
+        CHECK(wheel.NextEvent() == wheel.ToTimePoint(70));
+    }
+
+    System::ThreadPool pool;
+    System::ThreadPoolOptions options;
+    options.WorkerCount = 2;
+    pool.Start(options);
+
+    std::promise<std::chrono::steady_clock::time_point> fired_promise;
+    const auto start = std::chrono::steady_clock::now();
+    pool.PushAfter(std::chrono::milliseconds(20), [&fired_promise]() { fired_promise.set_value(std::chrono::steady_clock::now()); });
+    CHECK(fired_promise.get_future().get() - start >= std::chrono::milliseconds(20));
+
+    std::promise<int> past_promise;
+    pool.PushAt(start - std::chrono::seconds(1), [&past_promise](int value) { past_promise.set_value(value); }, 3);
+    CHECK(past_promise.get_future().get() == 3);
+
+    std::atomic<bool> cancelled_ran{ false };
+    auto cancelled = pool.PushAfter(std::chrono::milliseconds(50), [&cancelled_ran]() { cancelled_ran = true; });
+    CHECK(cancelled.Cancel());
+    CHECK(!cancelled.Cancel());
+
+    std::atomic<int> ticks{ 0 };
+    auto periodic = pool.PushEvery(std::chrono::milliseconds(2), [&ticks]() { ++ticks; });
+    while (ticks < 3)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    CHECK(periodic.Cancel());
+    const int ticks_after_cancel = ticks;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(ticks <= ticks_after_cancel + 1);
+
+    // Many pending timers, cheap to insert and cancel.
+    std::vector<System::TimerHandle> handles;
+    handles.reserve(100000);
+    for (int i = 0; i < 100000; ++i)
+        handles.emplace_back(pool.PushAfter(std::chrono::seconds(1 + i % 3600), []() {}));
+    CHECK(pool.TimerCount() == 100000);
+    std::size_t cancel_count = 0;
+    for (auto& handle : handles)
+        cancel_count += handle.Cancel() ? 1 : 0;
+    CHECK(cancel_count == 100000);
+    CHECK(pool.TimerCount() == 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    CHECK(!cancelled_ran);
+    pool.Join();
+}
+
+TEST_CASE("ThreadPool metrics", "[thread_pool_metrics]")
+{
+    System::ThreadPoolHistogram histogram;
+    histogram.Buckets[3] = 90;
+    histogram.Buckets[10] = 10;
+    histogram.Count = 100;
+    CHECK(histogram.Percentile(0.5) == std::chrono::nanoseconds(16));
+    CHECK(histogram.Percentile(0.99) == std::chrono::nanoseconds(2048));
+
+    for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+    {
+        System::ThreadPool pool;
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 2;
+        options.Mode = mode;
+        options.CollectTimings = true;
+
+        // Queued before Start so the depth high-water mark is known.
+        std::atomic<int> counter{ 0 };
+        for (int i = 0; i < 100; ++i)
+            pool.Post([&counter]() { ++counter; });
+        pool.Start(options);
+
+        pool.ParallelFor(0, 1000, 10, [&counter](int) { ++counter; }).get();
+        while (counter != 1100)
+            std::this_thread::yield();
+
+        const auto metrics = pool.Metrics();
+        CHECK(metrics.Workers.size() == 2);
+        CHECK(metrics.QueueDepthHighWater >= 100);
+        CHECK(metrics.Total.TasksExecuted >= 100);
+        // The 100 posted tasks and one ParallelFor runner per worker.
+        CHECK(metrics.TasksSubmitted == 102);
+        CHECK(metrics.Total.TasksSubmitted == 102);
+
+        uint64_t worker_tasks = 0;
+        for (auto const& worker : metrics.Workers)
+            worker_tasks += worker.TasksExecuted;
+        CHECK(worker_tasks == metrics.Total.TasksExecuted);
+
+        pool.Join();
+        const auto joined_metrics = pool.Metrics();
+        CHECK(joined_metrics.Workers.empty());
+        CHECK(joined_metrics.TasksSubmitted == 102);
+        CHECK(joined_metrics.Total.TasksExecuted == 102);
+        CHECK(joined_metrics.TasksCleared == 0);
+        CHECK(joined_metrics.QueueDepth == 0);
+        // Only the runners were timed, the 100 tasks were posted before Start enabled timings.
+        // Both histograms are complete once the workers are joined.
+        CHECK(joined_metrics.Total.QueuedTime.Count == 2);
+        CHECK(joined_metrics.Total.RunTime.Count == 2);
+
+        // Cleared tasks are submitted but never executed.
+        for (int i = 0; i < 5; ++i)
+            pool.Post([]() {});
+        pool.Clear();
+        const auto cleared_metrics = pool.Metrics();
+        CHECK(cleared_metrics.TasksSubmitted == 107);
+        CHECK(cleared_metrics.TasksCleared == 5);
+        CHECK(cleared_metrics.Total.TasksExecuted == 102);
+        CHECK(cleared_metrics.QueueDepth == 0);
+    }
+}
+
+TEST_CASE("ThreadPool elastic", "[thread_pool_elastic]")
+{
+    auto wait_for = [](auto&& predicate)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!predicate() && std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return predicate();
+    };
+
+    for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+    {
+        System::ThreadPool pool;
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 1;
+        options.MaxWorkers = 3;
+        options.Mode = mode;
+        options.GrowLatency = std::chrono::milliseconds(5);
+        options.IdleTimeout = std::chrono::milliseconds(50);
+        pool.Start(options);
+        CHECK(pool.WorkerCount() == 1);
+        CHECK(pool.Metrics().Workers.size() == 3);
+
+        // The only worker blocks, the monitor adds workers for the queued tasks.
+        std::atomic<bool> release{ false };
+        std::atomic<int> counter{ 0 };
+        pool.Post([&release]()
+        {
+            while (!release)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+        for (int i = 0; i < 4; ++i)
+            pool.Post([&counter]() { ++counter; });
+
+        CHECK(wait_for([&counter]() { return counter == 4; }));
+        CHECK(pool.WorkerCount() > 1);
+        CHECK(pool.WorkerCount() <= 3);
+
+        // Idle workers retire down to MinWorkers.
+        release = true;
+        CHECK(wait_for([&pool]() { return pool.WorkerCount() == 1; }));
+
+        // Retired slots are reused.
+        release = false;
+        counter = 0;
+        pool.Post([&release]()
+        {
+            while (!release)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+        pool.Post([&counter]() { ++counter; });
+        CHECK(wait_for([&counter]() { return counter == 1; }));
+        release = true;
+        pool.Join();
+        CHECK(pool.WorkerCount() == 0);
+    }
+
+    // A task waiting inside a BlockingRegion for a task queued after it only finishes with the added worker.
+    System::ThreadPool pool;
+    System::ThreadPoolOptions options;
+    options.WorkerCount = 1;
+    options.MaxWorkers = 2;
+    options.GrowLatency = std::chrono::hours(1);
+    options.IdleTimeout = std::chrono::milliseconds(20);
+    pool.Start(options);
+
+    auto done = pool.Push([&pool]()
+    {
+        std::promise<void> promise;
+        auto future = promise.get_future();
+        pool.Post([&promise]() { promise.set_value(); });
+
+        System::ThreadPool::BlockingRegion region(pool);
+        future.wait();
+        return true;
+    });
+    CHECK(done.get());
+    CHECK(wait_for([&pool]() { return pool.WorkerCount() == 1; }));
+
+    // Outside of the pool workers it does nothing.
+    {
+        System::ThreadPool::BlockingRegion region(pool);
+        CHECK(pool.WorkerCount() == 1);
+    }
+
+    // A pool that can't grow keeps WorkerCount workers whatever MinWorkers says.
+    System::ThreadPoolOptions fixed_options;
+    fixed_options.WorkerCount = 2;
+    fixed_options.MinWorkers = 1;
+    fixed_options.IdleTimeout = std::chrono::milliseconds(5);
+    pool.Start(fixed_options);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(pool.WorkerCount() == 2);
+    CHECK(pool.Push([]() { return 5; }).get() == 5);
+}
+
+TEST_CASE("TaskGroup", "[task_group]")
+{
+    for (auto mode : { System::ThreadPoolMode::SharedQueue, System::ThreadPoolMode::WorkStealing })
+    {
+        // A single worker waiting on nested groups only makes progress by helping.
+        System::ThreadPool pool;
+        System::ThreadPoolOptions options;
+        options.WorkerCount = 1;
+        options.Mode = mode;
+        pool.Start(options);
+
+        std::atomic<int> counter{ 0 };
+        System::TaskGroup group(pool);
+        for (int i = 0; i < 8; ++i)
+        {
+            group.Run([&pool, &counter]()
+            {
+                System::TaskGroup nested(pool);
+                for (int j = 0; j < 8; ++j)
+                    nested.Run([&counter](int increment) { counter += increment; }, 1);
+                nested.Wait();
+            });
+        }
+        group.Wait();
+        CHECK(counter == 64);
+
+        // First exception is rethrown and cancels the tasks not started yet.
+        System::ThreadPool stopped_pool;
+        System::TaskGroup first_group(stopped_pool);
+        counter = 0;
+        first_group.Run([]() { throw std::runtime_error("first"); });
+        for (int i = 0; i < 4; ++i)
+            first_group.Run([&counter]() { ++counter; });
+        CHECK_THROWS_WITH(first_group.Wait(), "first");
+        CHECK(counter == 0);
+        CHECK(!first_group.IsCancelled());
+
+        System::TaskGroup aggregate_group(pool, System::TaskGroupExceptionPolicy::Aggregate);
+        aggregate_group.Run([]() { throw std::runtime_error("first"); });
+        aggregate_group.Run([]() { throw std::logic_error("second"); });
+        try
+        {
+            aggregate_group.Wait();
+            FAIL("AggregateException not thrown");
+        }
+        catch (System::AggregateException const& e)
+        {
+            CHECK(e.Exceptions().size() >= 1);
+        }
+
+        // Cooperative cancellation.
+        System::TaskGroup cancelled_group(pool);
+        auto token = cancelled_group.Token();
+        std::atomic<bool> started{ false };
+        cancelled_group.Run([&started, token]()
+        {
+            started = true;
+            while (!token.IsCancellationRequested())
+                std::this_thread::yield();
+        });
+        while (!started)
+            std::this_thread::yield();
+        cancelled_group.Cancel();
+        cancelled_group.Wait();
+        CHECK(token.IsCancellationRequested());
+        CHECK(!cancelled_group.Token().IsCancellationRequested());
+        CHECK(!System::CancellationToken().IsCancellationRequested());
+
+        // A watchdog cancels while the owner starts new rounds.
+        System::TaskGroup watched_group(pool);
+        std::atomic<bool> watching{ true };
+        std::thread watchdog([&watched_group, &watching]()
+        {
+            while (watching)
+            {
+                watched_group.Cancel();
+                (void)watched_group.IsCancelled();
+                std::this_thread::yield();
+            }
+        });
+        for (int i = 0; i < 200; ++i)
+        {
+            watched_group.Run([]() {});
+            watched_group.Wait();
+        }
+        watching = false;
+        watchdog.join();
+
+        pool.Join();
+    }
+
+    // A helper with nothing to run sleeps until a task is queued instead of polling.
+    System::ThreadPool stopped_pool;
+    std::atomic<bool> done{ false };
+    std::atomic<int> checks{ 0 };
+    std::thread helper([&stopped_pool, &done, &checks]()
+    {
+        stopped_pool.HelpUntil([&done, &checks]() { ++checks; return done.load(); });
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    stopped_pool.Post([&stopped_pool, &done]()
+    {
+        done = true;
+        stopped_pool.NotifyHelpers();
+    });
+    helper.join();
+    CHECK(done);
+    CHECK(checks < 10);
+}
+
+TEST_CASE("Future", "[future]")
+{
+    System::ThreadPool pool;
+    pool.Start(2);
+
+    // Continuations chain without blocking, a returned Future is unwrapped.
+    auto chained = System::Async(pool, [](int value) { return value * 2; }, 21)
+        .Then([](int value) { return std::to_string(value); })
+        .Then([&pool](std::string value) { return System::Async(pool, [value]() { return value + "!"; }); });
+    CHECK(chained.Get() == "42!");
+    CHECK(!chained.Valid());
+
+    // Exceptions skip value continuations and reach the ones taking the future.
+    auto failed = System::Async(pool, []() -> int { throw std::runtime_error("failed"); })
+        .Then([](int value) { return value + 1; })
+        .Then([](System::Future<int> future)
+        {
+            try
+            {
+                return future.Get();
+            }
+            catch (std::runtime_error const&)
+            {
+                return -1;
+            }
+        });
+    CHECK(failed.Get() == -1);
+
+    std::vector<System::Future<int>> futures;
+    for (int i = 0; i < 16; ++i)
+        futures.emplace_back(System::Async(pool, [i]() { return i; }));
+    auto all = System::WhenAll(std::move(futures)).Get();
+    REQUIRE(all.size() == 16);
+    CHECK(all[0] == 0);
+    CHECK(all[15] == 15);
+
+    std::vector<System::Future<void>> void_futures;
+    void_futures.emplace_back(System::Async(pool, []() {}));
+    void_futures.emplace_back(System::Async(pool, []() { throw std::logic_error("second"); }));
+    CHECK_THROWS_AS(System::WhenAll(std::move(void_futures)).Get(), std::logic_error);
+    System::WhenAll(std::vector<System::Future<void>>{}).Get();
+
+    // WhenAny gives the futures back, the ready one included.
+    System::Promise<int> never(pool);
+    std::vector<System::Future<int>> any_futures;
+    any_futures.emplace_back(never.GetFuture());
+    any_futures.emplace_back(System::Async(pool, []() { return 7; }));
+    auto any = System::WhenAny(std::move(any_futures)).Get();
+    CHECK(any.Index == 1);
+    REQUIRE(any.Futures.size() == 2);
+    CHECK(any.Futures[1].Get() == 7);
+    CHECK(!any.Futures[0].IsReady());
+    never.SetValue(1);
+    CHECK(any.Futures[0].Get() == 1);
+    CHECK_THROWS_AS(never.SetValue(2), std::future_error);
+
+    // A promise going away breaks its future, a promise without pool runs continuations inline.
+    System::Future<int> broken;
+    {
+        System::Promise<int> promise(pool);
+        broken = promise.GetFuture();
+    }
+    CHECK_THROWS_AS(broken.Get(), std::future_error);
+
+    System::Promise<int> inline_promise;
+    const auto caller = std::this_thread::get_id();
+    auto inline_future = inline_promise.GetFuture().Then([caller](int value) { return std::this_thread::get_id() == caller ? value : -1; });
+    inline_promise.SetValue(5);
+    CHECK(inline_future.IsReady());
+    CHECK(inline_future.Get() == 5);
+
+    // Waiting from the only worker helps instead of deadlocking.
+    System::ThreadPool single_pool;
+    single_pool.Start(1);
+    auto nested = System::Async(single_pool, [&single_pool]()
+    {
+        return System::Async(single_pool, []() { return 3; }).Get() + 1;
+    });
+    CHECK(nested.Get() == 4);
+}
+
+TEST_CASE("TaskGraph", "[task_graph]")
+{
+    System::ThreadPool pool;
+    pool.Start(4);
+
+    // Diamond with a fan-out: every node must see its dependencies done.
+    std::vector<std::atomic<int>> done(10);
+    std::atomic<int> order_errors{ 0 };
+    System::TaskGraph graph;
+    auto node = [&done, &order_errors](std::size_t index, std::vector<std::size_t> dependencies)
+    {
+        return [&done, &order_errors, index, dependencies]()
+        {
+            for (auto dependency : dependencies)
+            {
+                if (done[dependency] == 0)
+                    ++order_errors;
+            }
+            ++done[index];
+        };
+    };
+
+    const auto source = graph.Add(node(0, {}));
+    std::vector<std::size_t> middle;
+    for (std::size_t i = 1; i < 9; ++i)
+    {
+        middle.emplace_back(graph.Add(node(i, { 0 })));
+        graph.AddDependency(middle.back(), source);
+    }
+    const auto sink = graph.Add(node(9, { 1, 2, 3, 4, 5, 6, 7, 8 }));
+    for (auto dependency : middle)
+        graph.AddDependency(sink, dependency);
+
+    for (int run = 0; run < 3; ++run)
+        graph.Run(pool).Get();
+
+    CHECK(order_errors == 0);
+    for (auto& count : done)
+        CHECK(count == 3);
+
+    // The first exception skips the nodes not started and reaches the future.
+    System::TaskGraph failing;
+    std::atomic<int> ran{ 0 };
+    const auto thrower = failing.Add([]() { throw std::runtime_error("node"); });
+    const auto after = failing.Add([&ran]() { ++ran; });
+    failing.AddDependency(after, thrower);
+    CHECK_THROWS_WITH(failing.Run(pool).Get(), "node");
+    CHECK(ran == 0);
+
+    System::TaskGraph cycle;
+    const auto first = cycle.Add([]() {});
+    const auto second = cycle.Add([]() {});
+    cycle.AddDependency(first, second);
+    cycle.AddDependency(second, first);
+    CHECK_THROWS_AS(cycle.Run(pool), std::logic_error);
+    CHECK_THROWS_AS(cycle.AddDependency(first, 5), std::out_of_range);
+
+    System::TaskGraph empty;
+    empty.Run(pool).Get();
+}
+
+#if defined(SYSTEM_HAS_COROUTINES)
+TEST_CASE("Coroutines", "[coroutine]")
+{
+    System::ThreadPool pool;
+    pool.Start(2);
+
+    auto square = [&pool](int value) -> System::Task<int>
+    {
+        co_await pool.Schedule();
+        co_return value * value;
+    };
+    auto sum = [&square]() -> System::Task<int>
+    {
+        int total = 0;
+        for (int i = 1; i <= 4; ++i)
+            total += co_await square(i);
+        co_return total;
+    };
+    CHECK(System::SyncWait(sum()) == 30);
+
+    auto worker_id = [&pool]() -> System::Task<std::thread::id>
+    {
+        co_await pool.Schedule();
+        co_return std::this_thread::get_id();
+    };
+    CHECK(System::SyncWait(worker_id()) != std::this_thread::get_id());
+
+    auto thrower = [&pool]() -> System::Task<>
+    {
+        co_await pool.Schedule();
+        throw std::runtime_error("coroutine");
+    };
+    CHECK_THROWS_WITH(System::SyncWait(thrower()), "coroutine");
+
+    // Tasks completing synchronously resume their caller right away.
+    auto one = []() -> System::Task<int> { co_return 1; };
+    auto many = [&one]() -> System::Task<int>
+    {
+        int total = 0;
+        for (int i = 0; i < 1000; ++i)
+            total += co_await one();
+        co_return total;
+    };
+    CHECK(System::SyncWait(many()) == 1000);
+
+    System::AsyncScope scope;
+    std::atomic<int> counter{ 0 };
+    auto increment = [&pool, &counter]() -> System::Task<>
+    {
+        co_await pool.Schedule();
+        ++counter;
+    };
+    for (int i = 0; i < 100; ++i)
+        scope.Spawn(increment());
+    System::SyncWait(scope.Join());
+    CHECK(counter == 100);
+    CHECK(scope.Pending() == 0);
+
+    scope.Spawn(thrower());
+    scope.Spawn(increment());
+    CHECK_THROWS_WITH(System::SyncWait(scope.Join()), "coroutine");
+    CHECK(counter == 101);
+}
+#endif
+
+TEST_CASE("UniqueFunction", "[unique_function]")
+{
+    System::UniqueFunction<int(int)> empty;
+    CHECK_FALSE(empty);
+
+    // Small callable, stored inline.
+    int offset = 3;
+    System::UniqueFunction<int(int)> small([offset](int v) { return v + offset; });
+    REQUIRE(small);
+    CHECK(small(2) == 5);
+
+    // Big callable, stored on the heap.
+    std::array<int, 64> values{};
+    values[63] = 7;
+    System::UniqueFunction<int(int)> big([values](int v) { return v + values[63]; });
+    CHECK(big(1) == 8);
+
+    // Moves transfer ownership.
+    System::UniqueFunction<int(int)> moved(std::move(big));
+    CHECK_FALSE(big);
+    CHECK(moved(2) == 9);
+
+    moved = std::move(small);
+    CHECK(moved(1) == 4);
+
+    auto shared = std::make_shared<int>(1);
+    {
+        System::UniqueFunction<void()> holder([shared]() {});
+        CHECK(shared.use_count() == 2);
+    }
+    CHECK(shared.use_count() == 1);
+}